@@ -0,0 +1,455 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+/* Affix-compressed dictionary.  A dictionary of russian words has
+   every form of every word, and the forms of a word differ in the
+   ending: `voshishhat'', `voshishhat'sya', `voshishhayushhij'.  As in
+   hunspell, every key is split into a stem and a suffix; a stem is kept
+   once, with its class, the set of suffixes it takes, and a suffix is
+   kept once for all the stems.  The stems and the suffixes are in two
+   tries, built at once from the sorted strings, with the children of
+   every node next to each other in one array and the edges in one text,
+   as the dictionary does not change after it is built.
+
+   The suffixes are found in the keys: the suffix of a key is its
+   longest ending that at least AFFIX_MIN_SHARE keys have, and the rest
+   is the stem, which gives the endings like `ost'', `ny'j' and
+   `ayushhij'.  For misc/ru-words.txt in translit, this takes 2Mb
+   instead of the 13Mb of a trie from trie.h.
+
+   A lookup walks down the stems over the text, and at every stem
+   compares the text after it with the suffixes of its class starting
+   with the same byte, keeping the longest key.  For that the suffixes
+   are also kept whole in the text, one after another, which is faster
+   than walking down their trie; the trie is for the fuzzy search, which
+   computes a row of distances per byte along its edges.  */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affix.h"
+
+/* A stem or a suffix with its number, or an ending of the key KEY at
+   the offset VALUE while the suffixes are looked for.  */
+struct piece
+{
+  const char *s;
+  uint32_t len;
+  uint32_t value;
+  uint32_t key;
+};
+
+/* The suffixes of the stem number STEM, while the classes are made.  */
+struct stem_class
+{
+  const uint32_t *suffixes;
+  uint32_t count;
+  uint32_t stem;
+};
+
+/* Add the key KEY of length LEN with VALUE to A.  KEY must stay until
+   AFFIX_BUILD, after which no keys are added; a later key equal to an
+   earlier one replaces it.  Returns false if the key is empty.  */
+bool
+affix_add (struct affix *a, const char *key, size_t len, uint32_t value)
+{
+  if (len == 0)
+    return false;
+
+  if (a->keys_count == a->keys_size)
+    {
+      a->keys_size = a->keys_size ? a->keys_size * 2 : 64;
+      a->keys = (struct affix_key *)
+                realloc (a->keys, a->keys_size * sizeof (struct affix_key));
+    }
+
+  a->keys[a->keys_count] = (struct affix_key) {key, len, value,
+                                               a->keys_count};
+  a->keys_count++;
+  return true;
+}
+
+static int
+cmp_bytes (const char *s1, size_t len1, const char *s2, size_t len2)
+{
+  int ret = memcmp (s1, s2, len1 < len2 ? len1 : len2);
+
+  if (ret != 0)
+    return ret;
+
+  return len1 < len2 ? -1 : len1 > len2;
+}
+
+/* Helper for qsort: the keys in order, the same ones as they were
+   added.  */
+static int
+cmp_keys (const void *k1, const void *k2)
+{
+  const struct affix_key *a = (const struct affix_key *) k1;
+  const struct affix_key *b = (const struct affix_key *) k2;
+  int ret = cmp_bytes (a->key, a->len, b->key, b->len);
+
+  if (ret != 0)
+    return ret;
+
+  return a->order < b->order ? -1 : a->order > b->order;
+}
+
+/* Helper for qsort: the pieces in order.  */
+static int
+cmp_pieces (const void *p1, const void *p2)
+{
+  const struct piece *a = (const struct piece *) p1;
+  const struct piece *b = (const struct piece *) p2;
+
+  return cmp_bytes (a->s, a->len, b->s, b->len);
+}
+
+/* Helper for qsort: keys by the stem, then by the number of the
+   suffix.  */
+static int
+cmp_stems (const void *p1, const void *p2)
+{
+  const struct piece *a = (const struct piece *) p1;
+  const struct piece *b = (const struct piece *) p2;
+  int ret = cmp_bytes (a->s, a->len, b->s, b->len);
+
+  if (ret != 0)
+    return ret;
+
+  return a->value < b->value ? -1 : a->value > b->value;
+}
+
+/* Helper for qsort: stems by their lists of suffixes.  */
+static int
+cmp_classes (const void *p1, const void *p2)
+{
+  const struct stem_class *a = (const struct stem_class *) p1;
+  const struct stem_class *b = (const struct stem_class *) p2;
+  size_t i;
+
+  for (i = 0; i < a->count && i < b->count; i++)
+    if (a->suffixes[i] != b->suffixes[i])
+      return a->suffixes[i] < b->suffixes[i] ? -1 : 1;
+
+  return a->count < b->count ? -1 : a->count > b->count;
+}
+
+/* Append COUNT zeroed nodes to A.  Returns the number of the first.  */
+static size_t
+add_nodes (struct affix *a, size_t count)
+{
+  size_t ret = a->nodes_count;
+
+  while (a->nodes_count + count > a->nodes_size)
+    {
+      a->nodes_size = a->nodes_size ? a->nodes_size * 2 : 64;
+      a->nodes = (struct affix_node *)
+                 realloc (a->nodes, a->nodes_size * sizeof (struct affix_node));
+    }
+
+  memset (&a->nodes[ret], 0, count * sizeof (struct affix_node));
+  a->nodes_count += count;
+  return ret;
+}
+
+/* Append S of length LEN to the text of A.  Returns its offset.  */
+static size_t
+add_text (struct affix *a, const char *s, size_t len)
+{
+  size_t ret = a->text_len;
+
+  while (a->text_len + len > a->text_size)
+    {
+      a->text_size = a->text_size ? a->text_size * 2 : 256;
+      a->text = (char *) realloc (a->text, a->text_size);
+    }
+
+  memcpy (&a->text[ret], s, len);
+  a->text_len += len;
+  return ret;
+}
+
+/* Add the children of the node PARENT for the pieces P[0 .. N),
+   sorted, with the same first DEPTH bytes and longer than that.  */
+static void
+build_children (struct affix *a, size_t parent, const struct piece *p,
+                size_t n, size_t depth)
+{
+  size_t i, k, first, count = 0;
+
+  if (n == 0)
+    return;
+
+  for (i = 0; i < n; i++)
+    if (i == 0 || p[i].s[depth] != p[i - 1].s[depth])
+      count++;
+
+  first = add_nodes (a, count);
+  a->nodes[parent].children = first;
+  a->nodes[parent].children_count = count;
+  for (i = 0, k = 0; i < n; k++)
+    {
+      size_t j = i + 1, len = 1;
+      bool final;
+
+      while (j < n && p[j].s[depth] == p[i].s[depth])
+        j++;
+
+      /* The edge goes on while all the pieces go on the same way; the
+         first piece is the shortest of them.  */
+      while (len < AFFIX_MAX_LABEL && p[i].len > depth + len
+             && p[j - 1].len > depth + len
+             && p[i].s[depth + len] == p[j - 1].s[depth + len])
+        len++;
+
+      final = p[i].len == depth + len;
+      a->nodes[first + k] = (struct affix_node)
+                            {
+                              .label = add_text (a, p[i].s + depth, len),
+                              .symb = (unsigned char) p[i].s[depth],
+                              .value = p[i].value,
+                              .final = final,
+                              .last = k == count - 1,
+                              .label_len = len
+                            };
+      build_children (a, first + k, p + i + final, j - i - final,
+                      depth + len);
+      i = j;
+    }
+}
+
+/* Add a trie of the pieces P[0 .. N), sorted, distinct and numbered in
+   order.  Returns the number of its root.  */
+static size_t
+build_trie (struct affix *a, const struct piece *p, size_t n)
+{
+  size_t root = add_nodes (a, 1), rest = n > 0 && p[0].len == 0;
+
+  a->nodes[root].final = rest;
+  build_children (a, root, p + rest, n - rest, 0);
+  return root;
+}
+
+/* Split the keys of A into stems and suffixes and build the tries.
+   Returns false, leaving A empty, if there are too many stems, suffixes,
+   nodes or bytes of the edges.  */
+bool
+affix_build (struct affix *a)
+{
+  struct piece *endings, *suffixes, *stems;
+  struct stem_class *classes;
+  uint32_t *split, *stem_of;
+  size_t i, j, n = 0, count = 0, distinct;
+  bool ok;
+
+  qsort (a->keys, a->keys_count, sizeof (struct affix_key), cmp_keys);
+  for (i = 0; i < a->keys_count; i++)
+    if (i + 1 == a->keys_count
+        || cmp_bytes (a->keys[i].key, a->keys[i].len,
+                      a->keys[i + 1].key, a->keys[i + 1].len))
+      a->keys[n++] = a->keys[i];
+  a->keys_count = n;
+
+  /* Every ending of every key after the shortest stem, sorted, gives
+     the number of keys with the same ending.  */
+  for (i = 0; i < n; i++)
+    if (a->keys[i].len > AFFIX_MIN_STEM)
+      count += a->keys[i].len - AFFIX_MIN_STEM;
+
+  endings = (struct piece *) malloc ((count + 1) * sizeof (struct piece));
+  split = (uint32_t *) malloc ((n + 1) * sizeof (uint32_t));
+  for (i = 0, count = 0; i < n; i++)
+    {
+      split[i] = a->keys[i].len;
+      for (j = AFFIX_MIN_STEM; j < a->keys[i].len; j++)
+        endings[count++] = (struct piece)
+                           {
+                             .s = a->keys[i].key + j,
+                             .len = a->keys[i].len - j,
+                             .value = j,
+                             .key = i
+                           };
+    }
+
+  qsort (endings, count, sizeof (struct piece), cmp_pieces);
+  for (i = 0; i < count; i = j)
+    {
+      for (j = i + 1; j < count && !cmp_pieces (&endings[i], &endings[j]);
+           j++)
+        ;
+
+      if (j - i >= AFFIX_MIN_SHARE)
+        for (; i < j; i++)
+          if (endings[i].value < split[endings[i].key])
+            split[endings[i].key] = endings[i].value;
+    }
+  free (endings);
+
+  /* Number the suffixes in order.  */
+  suffixes = (struct piece *) malloc ((n + 1) * sizeof (struct piece));
+  stem_of = (uint32_t *) malloc ((n + 1) * sizeof (uint32_t));
+  for (i = 0; i < n; i++)
+    suffixes[i] = (struct piece) {a->keys[i].key + split[i],
+                                  a->keys[i].len - split[i], 0, i};
+  qsort (suffixes, n, sizeof (struct piece), cmp_pieces);
+  for (i = 0, distinct = 0; i < n; i++)
+    {
+      if (i > 0 && cmp_pieces (&suffixes[i - 1], &suffixes[i]))
+        suffixes[distinct++] = suffixes[i - 1];
+      stem_of[suffixes[i].key] = distinct;
+    }
+  if (n > 0)
+    suffixes[distinct++] = suffixes[n - 1];
+  for (i = 0; i < distinct; i++)
+    suffixes[i].value = i;
+  a->suffixes_count = distinct;
+
+  /* The keys by the stem and the suffix give the values of every stem
+     in the order of its suffixes.  */
+  stems = (struct piece *) malloc ((n + 1) * sizeof (struct piece));
+  for (i = 0; i < n; i++)
+    stems[i] = (struct piece) {a->keys[i].key, split[i], stem_of[i], i};
+  qsort (stems, n, sizeof (struct piece), cmp_stems);
+
+  a->values = (uint32_t *) malloc ((n + 1) * sizeof (uint32_t));
+  a->values_count = n;
+  for (i = 0; i < n; i++)
+    {
+      a->values[i] = a->keys[stems[i].key].value;
+      split[i] = stems[i].value;
+    }
+
+  /* Now STEMS[I] is a stem with the suffixes SPLIT[VALUE .. VALUE + KEY)
+     and the number I.  */
+  for (i = 0, distinct = 0; i < n; i = j)
+    {
+      for (j = i + 1; j < n && !cmp_pieces (&stems[i], &stems[j]); j++)
+        ;
+      stems[distinct++] = (struct piece) {stems[i].s, stems[i].len, i,
+                                          j - i};
+    }
+  a->stems_count = distinct;
+  a->stems = (struct affix_stem *)
+             malloc ((distinct + 1) * sizeof (struct affix_stem));
+
+  /* Stems with the same suffixes share the class.  */
+  classes = (struct stem_class *)
+            malloc ((distinct + 1) * sizeof (struct stem_class));
+  for (i = 0; i < distinct; i++)
+    classes[i] = (struct stem_class) {&split[stems[i].value], stems[i].key,
+                                      i};
+  qsort (classes, distinct, sizeof (struct stem_class), cmp_classes);
+
+  a->classes = (struct affix_class *)
+               malloc ((distinct + 1) * sizeof (struct affix_class));
+  a->class_suffixes = (uint32_t *) malloc ((n + 1) * sizeof (uint32_t));
+  for (i = 0; i < distinct; i++)
+    {
+      const struct stem_class *c = &classes[i];
+
+      if (i == 0 || cmp_classes (&classes[i - 1], c))
+        {
+          a->classes[a->classes_count++] = (struct affix_class)
+                                           {a->class_suffixes_count,
+                                            c->count};
+          memcpy (&a->class_suffixes[a->class_suffixes_count], c->suffixes,
+                  c->count * sizeof (uint32_t));
+          a->class_suffixes_count += c->count;
+        }
+
+      a->stems[c->stem] = (struct affix_stem)
+                          {a->classes_count - 1, stems[c->stem].value};
+    }
+
+  for (i = 0; i < distinct; i++)
+    stems[i].value = i;
+
+  ok = a->stems_count <= AFFIX_MAX_PIECES
+       && a->suffixes_count <= AFFIX_MAX_PIECES;
+  if (ok)
+    {
+      build_trie (a, stems, a->stems_count);
+      for (i = 0; i < a->nodes[0].children_count; i++)
+        a->first[a->nodes[a->nodes[0].children + i].symb] = i + 1;
+      a->suffix_root = build_trie (a, suffixes, a->suffixes_count);
+
+      a->suffixes = (uint32_t *) malloc ((a->suffixes_count + 1)
+                                         * sizeof (uint32_t));
+      for (i = 0; i < a->suffixes_count; i++)
+        a->suffixes[i] = add_text (a, suffixes[i].s, suffixes[i].len);
+      a->suffixes[i] = a->text_len;
+      ok = a->nodes_count <= AFFIX_MAX_NODES
+           && a->text_len <= AFFIX_MAX_TEXT;
+    }
+
+  if (ok)
+    {
+      /* Nothing is added any more.  */
+      a->nodes = (struct affix_node *)
+                 realloc (a->nodes, a->nodes_count
+                                    * sizeof (struct affix_node));
+      a->text = (char *) realloc (a->text, a->text_len + 1);
+      a->classes = (struct affix_class *)
+                   realloc (a->classes, (a->classes_count + 1)
+                                        * sizeof (struct affix_class));
+      a->class_suffixes = (uint32_t *)
+                          realloc (a->class_suffixes,
+                                   (a->class_suffixes_count + 1)
+                                   * sizeof (uint32_t));
+      a->nodes_size = a->nodes_count;
+      a->text_size = a->text_len;
+    }
+
+  free (classes);
+  free (stems);
+  free (stem_of);
+  free (suffixes);
+  free (split);
+  if (!ok)
+    affix_free (a);
+
+  free (a->keys);
+  a->keys = NULL;
+  a->keys_count = a->keys_size = 0;
+  return ok;
+}
+
+/* Memory taken by the dictionary after AFFIX_BUILD.  */
+size_t
+affix_bytes (const struct affix *a)
+{
+  return a->nodes_count * sizeof (struct affix_node) + a->text_len
+         + a->stems_count * sizeof (struct affix_stem)
+         + a->classes_count * sizeof (struct affix_class)
+         + (a->class_suffixes_count + a->values_count + a->suffixes_count
+            + 1) * sizeof (uint32_t)
+         + sizeof (a->first);
+}
+
+void
+affix_free (struct affix *a)
+{
+  free (a->keys);
+  free (a->nodes);
+  free (a->text);
+  free (a->stems);
+  free (a->classes);
+  free (a->class_suffixes);
+  free (a->values);
+  free (a->suffixes);
+  memset (a, 0, sizeof (struct affix));
+}
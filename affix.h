@@ -0,0 +1,310 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+#ifndef __AFFIX_H__
+#define __AFFIX_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "utf8.h"
+
+/* Stems are at least that many bytes long, or the whole key if it is
+   shorter, so the first letter of a key is always in its stem.  */
+#define AFFIX_MIN_STEM          4
+
+/* The ending of a key is a suffix if at least that many keys end with
+   it.  */
+#define AFFIX_MIN_SHARE         8
+
+/* Longest edge of the tries, in bytes; longer ones are split.  */
+#define AFFIX_MAX_LABEL         127
+
+/* Most stems or suffixes in a dictionary, most nodes of the tries and
+   most bytes of their edges.  */
+#define AFFIX_MAX_PIECES        ((1u << 23) - 1)
+#define AFFIX_MAX_NODES         (1u << 23)
+#define AFFIX_MAX_TEXT          (1u << 24)
+
+/* Nodes with more children than that are searched by halves.  */
+#define AFFIX_SCAN              8
+
+/* A key given to AFFIX_ADD, kept until AFFIX_BUILD.  */
+struct affix_key
+{
+  const char *key;
+  size_t len;
+  uint32_t value;
+  size_t order;
+};
+
+/* A node of the tries of the stems and of the suffixes.  The children
+   of a node are next to each other, sorted by the first byte of their
+   edges.  Stems and suffixes are numbered in order, so the ones under a
+   node have the numbers from its VALUE up to the VALUE of the next
+   child of its parent.  */
+struct affix_node
+{
+  /* The edge to the node is TEXT[LABEL .. LABEL + LABEL_LEN), starting
+     with the byte SYMB.  */
+  uint32_t label : 24;
+  uint32_t symb : 8;
+  /* The children are NODES[CHILDREN .. CHILDREN + CHILDREN_COUNT),
+     the one with LAST set is the last.  */
+  uint32_t children : 23;
+  uint32_t children_count : 9;
+  /* Number of the first stem or suffix under the node, which ends here
+     if FINAL is set.  */
+  uint32_t value : 23;
+  uint32_t final : 1;
+  uint32_t last : 1;
+  uint32_t label_len : 7;
+};
+
+/* A stem takes the suffixes of the class CLS; the value of the key
+   made of the stem and the I-th of them is VALUES[FIRST + I].  */
+struct affix_stem
+{
+  uint32_t cls;
+  uint32_t first;
+};
+
+/* Suffixes of a class, CLASS_SUFFIXES[START .. START + COUNT), sorted.  */
+struct affix_class
+{
+  uint32_t start;
+  uint32_t count;
+};
+
+/* Dictionary of keys made of a stem and a suffix, see affix.c.  KEYS
+   are the keys added until AFFIX_BUILD.  The stems are under NODES[0]
+   and the suffixes under NODES[SUFFIX_ROOT].  */
+struct affix
+{
+  struct affix_key *keys;
+  size_t keys_count, keys_size;
+
+  struct affix_node *nodes;
+  size_t nodes_count, nodes_size, suffix_root;
+  char *text;
+  size_t text_len, text_size;
+  struct affix_stem *stems;
+  struct affix_class *classes;
+  uint32_t *class_suffixes;
+  uint32_t *values;
+  /* The suffix number I is TEXT[SUFFIXES[I] .. SUFFIXES[I + 1]).  */
+  uint32_t *suffixes;
+  size_t stems_count, suffixes_count, classes_count, class_suffixes_count;
+  size_t values_count;
+  /* The child of the root of the stems starting with the byte C is the
+     FIRST[C]-th one, counting from 1, or none if it is 0.  */
+  uint16_t first[256];
+};
+
+#define AFFIX_INIT {NULL, 0, 0, NULL, 0, 0, 0, NULL, 0, 0, NULL, NULL, \
+                    NULL, NULL, NULL, 0, 0, 0, 0, 0, {0}}
+
+__BEGIN_DECLS
+bool affix_add (struct affix *, const char *, size_t, uint32_t);
+bool affix_build (struct affix *);
+size_t affix_bytes (const struct affix *);
+void affix_free (struct affix *);
+__END_DECLS
+
+/* The child of the node N with the edge starting with the byte C, or
+   NULL.  */
+static inline const struct affix_node *
+affix_child (const struct affix *a, const struct affix_node *n,
+             unsigned char c)
+{
+  const struct affix_node *child = &a->nodes[n->children];
+  size_t lo = 0, hi = n->children_count;
+
+  while (hi - lo > AFFIX_SCAN)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+
+      if (child[mid].symb < c)
+        lo = mid + 1;
+      else
+        hi = mid + 1;
+    }
+
+  for (; lo < hi; lo++)
+    if (child[lo].symb == c)
+      return &child[lo];
+    else if (child[lo].symb > c)
+      return NULL;
+
+  return NULL;
+}
+
+/* Whether the rest of the edge to N, found by its first byte, is at S
+   of length LEN, with the ASCII letters of S in any case.  */
+static inline bool
+affix_label (const struct affix *a, const struct affix_node *n,
+             const char *s, size_t len)
+{
+  const char *label = &a->text[n->label];
+  size_t i;
+
+  if (len < n->label_len)
+    return false;
+
+  for (i = 1; i < n->label_len; i++)
+    if (ascii_lower (s[i]) != (unsigned char) label[i])
+      return false;
+
+  return true;
+}
+
+/* The first of the COUNT numbers at S, sorted, that is at least N, or
+   COUNT if there is none.  */
+static inline size_t
+affix_lower_bound (const uint32_t *s, size_t count, uint32_t n)
+{
+  size_t lo = 0, hi = count;
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+
+      if (s[mid] < n)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+/* The value of the key made of STEM and the suffix number SUFFIX in
+   *VALUE.  Returns false if the stem does not take the suffix.  */
+static inline bool
+affix_value (const struct affix *a, const struct affix_stem *stem,
+             uint32_t suffix, uint32_t *value)
+{
+  const struct affix_class *cls = &a->classes[stem->cls];
+  const uint32_t *s = &a->class_suffixes[cls->start];
+  size_t i = affix_lower_bound (s, cls->count, suffix);
+
+  if (i == cls->count || s[i] != suffix)
+    return false;
+
+  *value = a->values[stem->first + i];
+  return true;
+}
+
+/* The longest key made of STEM and a suffix it takes at S, from the
+   byte POS of LEN on; its end is put in *MATCH and its value in *VALUE
+   if it is longer than *MATCH.  The suffixes of the class are sorted, so
+   the ones starting with the byte at POS are next to each other, and
+   the ones that match are prefixes of each other, the longest last.  */
+static inline void
+affix_suffix_match (const struct affix *a, const struct affix_stem *stem,
+                    const char *s, size_t pos, size_t len, size_t *match,
+                    uint32_t *value, uint64_t *probes)
+{
+  const struct affix_class *cls = &a->classes[stem->cls];
+  const uint32_t *suffixes = &a->class_suffixes[cls->start];
+  size_t i = 0, found = cls->count, lo, hi;
+  unsigned char c;
+
+  /* The empty suffix is the first one, if there is one.  */
+  if (a->suffixes[suffixes[0] + 1] == a->suffixes[suffixes[0]])
+    found = i++;
+
+  if (pos < len)
+    {
+      c = ascii_lower (s[pos]);
+      lo = i;
+      hi = cls->count;
+      while (lo < hi)
+        {
+          size_t mid = lo + (hi - lo) / 2;
+
+          if ((unsigned char) a->text[a->suffixes[suffixes[mid]]] < c)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+
+      for (i = lo; i < cls->count; i++)
+        {
+          const char *suffix = &a->text[a->suffixes[suffixes[i]]];
+          size_t k, suffix_len = a->suffixes[suffixes[i] + 1]
+                                 - a->suffixes[suffixes[i]];
+
+          (*probes)++;
+          if ((unsigned char) suffix[0] != c)
+            break;
+          if (suffix_len > len - pos)
+            continue;
+          for (k = 1; k < suffix_len; k++)
+            if (ascii_lower (s[pos + k]) != (unsigned char) suffix[k])
+              break;
+          if (k == suffix_len)
+            found = i;
+        }
+    }
+
+  if (found < cls->count)
+    {
+      size_t end = pos + a->suffixes[suffixes[found] + 1]
+                   - a->suffixes[suffixes[found]];
+
+      if (end > *match)
+        {
+          *match = end;
+          *value = a->values[stem->first + found];
+        }
+    }
+}
+
+/* The longest key at the beginning of S of length LEN, with the ASCII
+   letters of S in any case, and its value in *VALUE.  Returns the
+   length of the key, or 0 if there is none.  The nodes visited are
+   counted in *PROBES.  */
+static inline size_t
+affix_match (const struct affix *a, const char *s, size_t len,
+             uint32_t *value, uint64_t *probes)
+{
+  const struct affix_node *n;
+  size_t pos = 0, match = 0;
+
+  (*probes)++;
+  if (len == 0 || a->first[ascii_lower (s[0])] == 0)
+    return 0;
+
+  n = &a->nodes[a->nodes[0].children + a->first[ascii_lower (s[0])] - 1];
+  while (affix_label (a, n, s + pos, len - pos))
+    {
+      pos += n->label_len;
+      if (n->final)
+        affix_suffix_match (a, &a->stems[n->value], s, pos, len, &match,
+                            value, probes);
+
+      if (pos == len)
+        break;
+
+      (*probes)++;
+      if ((n = affix_child (a, n, ascii_lower (s[pos]))) == NULL)
+        break;
+    }
+
+  return match;
+}
+
+#endif  /* __AFFIX_H__  */
@@ -0,0 +1,189 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+/* Cache of the results of the recent messages.  The same message often
+   comes several times: from bridged channels, from several accounts in
+   the same conference, or from the buffers of a relay, and each copy
+   would be converted again.  The cache is a table of a fixed number of
+   entries indexed by a 64-bit hash of the message, its language and
+   the mode; a new message takes the place of the one with the same
+   slot.  The message is compared in full on a hit, so collisions only
+   cost a miss.  Entries are dropped TTL seconds after they are added,
+   never if TTL is 0.
+
+   The cache is not thread-safe, it is used through a client.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "cache.h"
+
+#define HASH_MUL        0x9e3779b97f4a7c15ULL
+
+/* Hash of MSG of length LEN with FLAGS, eight bytes at a time.  */
+static inline uint64_t
+cache_hash (const char *msg, size_t len, uint32_t flags)
+{
+  uint64_t h = HASH_MUL ^ len ^ (uint64_t) flags << 32, w;
+
+  for (; len >= sizeof (w); msg += sizeof (w), len -= sizeof (w))
+    {
+      memcpy (&w, msg, sizeof (w));
+      h = (h ^ w) * HASH_MUL;
+      h ^= h >> 29;
+    }
+
+  if (len > 0)
+    {
+      w = 0;
+      memcpy (&w, msg, len);
+      h = (h ^ w) * HASH_MUL;
+    }
+
+  /* Finalizer of murmur3, so that all the bits count in the slot.  */
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  return h ^ h >> 33;
+}
+
+static void
+entry_clear (struct detrans_cache *c, struct cache_entry *e)
+{
+  if (e->msg == NULL)
+    return;
+
+  c->bytes -= e->msg_len + e->result_len + 2;
+  c->used--;
+  free (e->msg);
+  e->msg = NULL;
+}
+
+/* Drop all the entries and keep at most SIZE of them (rounded up to a
+   power of two) for TTL seconds from now on.  SIZE 0 turns the cache
+   off.  The counters are kept.  */
+void
+cache_resize (struct detrans_cache *c, size_t size, unsigned ttl)
+{
+  size_t i;
+
+  for (i = 0; i < c->size; i++)
+    entry_clear (c, &c->entries[i]);
+  free (c->entries);
+
+  for (c->size = size ? 1 : 0; c->size < size; c->size *= 2)
+    ;
+
+  c->entries = c->size ? (struct cache_entry *)
+                         calloc (c->size, sizeof (struct cache_entry))
+                       : NULL;
+  if (c->entries == NULL)
+    c->size = 0;
+  c->ttl = ttl;
+  c->used = c->bytes = 0;
+}
+
+/* The result for MSG of length LEN with FLAGS at the time NOW, or NULL
+   if it is not in the cache.  The result is valid until the next
+   CACHE_PUT or CACHE_RESIZE.  */
+const char *
+cache_get (struct detrans_cache *c, uint32_t flags, const char *msg,
+           size_t len, time_t now)
+{
+  struct cache_entry *e;
+  uint64_t h;
+
+  if (c->size == 0 || len > CACHE_MAX_MESSAGE)
+    return NULL;
+
+  c->lookups++;
+  h = cache_hash (msg, len, flags);
+  e = &c->entries[h & (c->size - 1)];
+  if (e->msg == NULL || e->hash != h || e->flags != flags
+      || e->msg_len != len || memcmp (e->msg, msg, len))
+    return NULL;
+
+  if (c->ttl != 0 && now - e->time >= (time_t) c->ttl)
+    {
+      entry_clear (c, e);
+      return NULL;
+    }
+
+  c->hits++;
+  return e->msg + len + 1;
+}
+
+/* Keep RESULT for MSG of length LEN with FLAGS, added at NOW.  */
+void
+cache_put (struct detrans_cache *c, uint32_t flags, const char *msg,
+           size_t len, const char *result, time_t now)
+{
+  struct cache_entry *e;
+  size_t result_len = strlen (result);
+  uint64_t h;
+
+  if (c->size == 0 || len > CACHE_MAX_MESSAGE)
+    return;
+
+  h = cache_hash (msg, len, flags);
+  e = &c->entries[h & (c->size - 1)];
+  entry_clear (c, e);
+
+  e->msg = (char *) malloc (len + result_len + 2);
+  memcpy (e->msg, msg, len);
+  e->msg[len] = '\0';
+  memcpy (e->msg + len + 1, result, result_len + 1);
+  e->hash = h;
+  e->flags = flags;
+  e->time = now;
+  e->msg_len = len;
+  e->result_len = result_len;
+
+  c->bytes += len + result_len + 2;
+  c->used++;
+}
+
+/* Memory used by the cache, in bytes.  */
+size_t
+cache_bytes (const struct detrans_cache *c)
+{
+  return c->bytes + c->size * sizeof (struct cache_entry);
+}
+
+/* Human-readable report of the hits and the memory used.  The string is
+   allocated with malloc.  */
+char *
+cache_stats_string (const struct detrans_cache *c)
+{
+  char *ret;
+
+  if (asprintf (&ret, "cache: %llu lookups, %.1f%% hits, %zu of %zu "
+                "entries, %zu bytes",
+                (unsigned long long) c->lookups,
+                c->lookups ? 100.0 * c->hits / c->lookups : 0.0,
+                c->used, c->size, cache_bytes (c)) == -1)
+    return NULL;
+
+  return ret;
+}
+
+void
+cache_free (struct detrans_cache *c)
+{
+  cache_resize (c, 0, 0);
+  *c = (struct detrans_cache) DETRANS_CACHE_INIT;
+}
@@ -0,0 +1,59 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+/* Longest message kept in the cache.  */
+#define CACHE_MAX_MESSAGE       4096
+
+struct cache_entry
+{
+  uint64_t hash;
+  /* Language and mode of the result, as sent to detransd.  */
+  uint32_t flags;
+  time_t time;
+  /* The message and its result, in one allocation; NULL if the entry
+     is empty.  */
+  char *msg;
+  size_t msg_len, result_len;
+};
+
+/* Results of the recent messages, see cache.c.  */
+struct detrans_cache
+{
+  struct cache_entry *entries;
+  size_t size, used, bytes;
+  unsigned ttl;
+  uint64_t lookups, hits;
+};
+
+#define DETRANS_CACHE_INIT {NULL, 0, 0, 0, 0, 0, 0}
+
+__BEGIN_DECLS
+void cache_resize (struct detrans_cache *, size_t, unsigned);
+const char *  cache_get (struct detrans_cache *, uint32_t, const char *,
+                         size_t, time_t);
+void cache_put (struct detrans_cache *, uint32_t, const char *, size_t,
+                const char *, time_t);
+size_t cache_bytes (const struct detrans_cache *);
+char *  cache_stats_string (const struct detrans_cache *);
+void cache_free (struct detrans_cache *);
+__END_DECLS
+
+#endif  /* __CACHE_H__  */
@@ -0,0 +1,160 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "detrans.h"
+
+/* Number of symbols in the model: word boundary, 'a'..'z' and
+   the apostrophe.  */
+#define MODEL_SYMBOLS   28
+
+/* Messages with less trigrams than that are considered translit,
+   as we cannot say anything reliable about them, and we'd rather
+   keep the old behaviour.  */
+#define CLASSIFY_MIN_TRIGRAMS   6
+
+/* Average log-likelihood ratio per trigram (in the units of the
+   model) above which the text is considered translit.  */
+#define CLASSIFY_THRESHOLD      0
+
+/* Log-likelihood ratios of translit against english for all the
+   trigrams, see misc/gen-translit-model.py.  */
+static const signed char translit_model[MODEL_SYMBOLS * MODEL_SYMBOLS
+                                        * MODEL_SYMBOLS] = {
+#include "translit-model.def"
+};
+
+static inline unsigned
+model_symbol (unsigned char c)
+{
+  unsigned l = (c | 0x20) - 'a';
+
+  if (l < 26)
+    return l + 1;
+
+  return c == '\'' ? 27 : 0;
+}
+
+/* Skip over the things that detrans leaves as is: html tags,
+   &xxxx; symbols (but &apos; is an apostrophe) and urls.  Returns
+   the position after the skipped part, or S itself.  */
+static inline const char *
+skip_markup (const char *s, const char *end)
+{
+  const char *p;
+
+  switch (*s)
+    {
+    case '<':
+      p = memchr (s, '>', end - s);
+      return p ? p + 1 : end;
+
+    case '&':
+      if (end - s >= 6 && !memcmp (s, "&apos;", 6))
+        return s;
+      /* Entities are short, an '&' without ';' nearby is just a
+         character.  */
+      for (p = s + 1; p < end && p < s + 10; p++)
+        if (*p == ';')
+          return p + 1;
+      return s;
+
+    case 'h':
+    case 'w':
+      if ((end - s >= 7 && !memcmp (s, "http://", 7))
+          || (end - s >= 8 && !memcmp (s, "https://", 8))
+          || (end - s >= 4 && !memcmp (s, "www.", 4)))
+        {
+          p = memchr (s, ' ', end - s);
+          return p ? p : end;
+        }
+      return s;
+
+    default:
+      return s;
+    }
+}
+
+/* Score the text S of length LEN.  Returns the sum of the log-likelihood
+   ratios of all the trigrams, and sets *COUNT to their number.  */
+int
+detrans_translit_score (const char *s, size_t len, size_t *count)
+{
+  const char *end = s + len;
+  unsigned a = 0, b = 0;
+  size_t n = 0;
+  int score = 0;
+
+  while (s < end)
+    {
+      unsigned c = model_symbol (*s);
+
+      /* Plain letters are the most common case.  */
+      if (c != 0 && *s != 'h' && *s != 'w')
+        s++;
+      else
+        {
+          const char *next = skip_markup (s, end);
+
+          if (next != s)
+            s = next, c = 0;
+          else if (*s == '&' && end - s >= 6 && !memcmp (s, "&apos;", 6))
+            s += 6, c = 27;
+          else
+            s++;
+        }
+
+      /* Several boundaries in a row say nothing.  */
+      if (c == 0 && b == 0)
+        continue;
+
+      score += translit_model[(a * MODEL_SYMBOLS + b) * MODEL_SYMBOLS + c];
+      n++;
+
+      /* The model knows words only, so every word starts from
+         scratch.  */
+      if (c == 0)
+        a = b = 0;
+      else
+        a = b, b = c;
+    }
+
+  if (b != 0)
+    {
+      score += translit_model[(a * MODEL_SYMBOLS + b) * MODEL_SYMBOLS];
+      n++;
+    }
+
+  if (count)
+    *count = n;
+
+  return score;
+}
+
+/* Decide whether the text looks like russian translit and has to be
+   passed to detrans.  */
+bool
+detrans_is_translit (const char *s, size_t len)
+{
+  size_t n;
+  int score = detrans_translit_score (s, len, &n);
+
+  if (n < CLASSIFY_MIN_TRIGRAMS)
+    return true;
+
+  return score > CLASSIFY_THRESHOLD * (int) n;
+}
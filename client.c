@@ -0,0 +1,295 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+
+/* Client of detransd.  The plugins de-transliterate through the
+   service when a socket is configured, so that the rules are loaded
+   once per host rather than once per process.  If the service does not
+   answer within CLIENT_TIMEOUT, the message is decoded in the process
+   (the rules are loaded then) and the service is not tried again for
+   CLIENT_RETRY seconds, so a dead service costs one timeout, not one
+   per message.  Either way, a message that came recently is not
+   converted again, see cache.c.
+
+   The messages are private, so the client talks only to a service run
+   by the same user, by root, or by the owner of the directory of the
+   socket if nobody else can write there: anyone can put a socket in
+   /tmp, but only the owner of /run/detransd in it.  */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include "detrans.h"
+#include "detransd.h"
+#include "client.h"
+#include "cache.h"
+
+static bool
+send_all (int fd, const void *buf, size_t len)
+{
+  while (len > 0)
+    {
+      /* A plugin must not die of SIGPIPE if the service goes away.  */
+      ssize_t n = send (fd, buf, len, MSG_NOSIGNAL);
+
+      if (n <= 0)
+        return false;
+      buf = (const char *) buf + n;
+      len -= n;
+    }
+
+  return true;
+}
+
+static bool
+recv_all (int fd, void *buf, size_t len)
+{
+  while (len > 0)
+    {
+      ssize_t n = recv (fd, buf, len, 0);
+
+      if (n <= 0)
+        return false;
+      buf = (char *) buf + n;
+      len -= n;
+    }
+
+  return true;
+}
+
+static void
+client_close (struct detrans_client *c)
+{
+  if (c->fd != -1)
+    close (c->fd);
+  c->fd = -1;
+}
+
+/* If the directory of the socket PATH can only be written by its
+   owner, sets *OWNER and returns true.  */
+bool
+detrans_client_dir_owner (const char *path, uid_t *owner)
+{
+  const char *slash = strrchr (path, '/');
+  char *dir;
+  struct stat st;
+  bool ret;
+
+  if (slash == NULL)
+    dir = strdup (".");
+  else if (slash == path)
+    dir = strdup ("/");
+  else
+    dir = strndup (path, slash - path);
+
+  ret = stat (dir, &st) == 0 && S_ISDIR (st.st_mode)
+        && !(st.st_mode & (S_IWGRP | S_IWOTH));
+  if (ret)
+    *owner = st.st_uid;
+
+  free (dir);
+  return ret;
+}
+
+/* Default socket of the service, shared by all the users if SHARED is
+   set, see detransd.h.  Returns NULL if there is none.  */
+char *
+detrans_client_default_path (bool shared)
+{
+  const char *dir = getenv ("XDG_RUNTIME_DIR");
+  char *path;
+
+  if (shared)
+    return strdup (DETRANSD_SHARED);
+  if (dir == NULL || *dir == '\0')
+    return NULL;
+
+  path = (char *) malloc (strlen (dir) + sizeof (DETRANSD_SOCKET_NAME) + 1);
+  sprintf (path, "%s/%s", dir, DETRANSD_SOCKET_NAME);
+  return path;
+}
+
+/* Whether the service on the other end of FD, listening on PATH, can be
+   trusted with the messages.  */
+static bool
+peer_trusted (int fd, const char *path)
+{
+  uid_t uid, owner;
+#ifdef SO_PEERCRED
+  struct ucred cred;
+  socklen_t len = sizeof (cred);
+
+  if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &len))
+    return false;
+  uid = cred.uid;
+#else
+  gid_t gid;
+
+  if (getpeereid (fd, &uid, &gid))
+    return false;
+#endif
+
+  return uid == getuid () || uid == 0
+         || (detrans_client_dir_owner (path, &owner) && uid == owner);
+}
+
+static bool
+client_connect (struct detrans_client *c)
+{
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  struct timeval tv = {.tv_sec = CLIENT_TIMEOUT};
+
+  if (strlen (c->path) >= sizeof (addr.sun_path))
+    return false;
+  strcpy (addr.sun_path, c->path);
+
+  if ((c->fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+    return false;
+
+  if (setsockopt (c->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv))
+      || setsockopt (c->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof (tv))
+      || connect (c->fd, (struct sockaddr *) &addr, sizeof (addr))
+      || !peer_trusted (c->fd, c->path))
+    {
+      client_close (c);
+      return false;
+    }
+
+  return true;
+}
+
+/* Send the request for MSG of length LEN with FLAGS.  The reply is put
+   in C->REPLY.  Returns false if the service is not available.  */
+static bool
+client_request (struct detrans_client *c, const char *msg, size_t len,
+                uint32_t flags)
+{
+  struct detransd_header h = {htonl (len), htonl (flags)};
+  size_t reply_len;
+
+  if (c->path == NULL || len > DETRANSD_MAX_MESSAGE)
+    return false;
+
+  if (c->fd == -1 && time (NULL) < c->retry)
+    return false;
+
+  if (c->fd == -1 && !client_connect (c))
+    goto fail;
+
+  if (!send_all (c->fd, &h, sizeof (h)) || !send_all (c->fd, msg, len)
+      || !recv_all (c->fd, &h, sizeof (h)))
+    goto fail;
+
+  /* A reply longer than the rules can make it, or statistics longer
+     than a request may be, is not from detransd.  */
+  reply_len = ntohl (h.len);
+  if (reply_len > ((flags & DETRANSD_STATS) ? DETRANSD_MAX_MESSAGE
+                   : detrans_max_output (len)))
+    goto fail;
+
+  if (c->reply_size < reply_len + 1)
+    {
+      c->reply_size = reply_len + 1;
+      c->reply = (char *) realloc (c->reply, c->reply_size);
+    }
+
+  if (!recv_all (c->fd, c->reply, reply_len))
+    goto fail;
+
+  c->reply[reply_len] = '\0';
+  return true;
+
+fail:
+  client_close (c);
+  c->retry = time (NULL) + CLIENT_RETRY;
+  return false;
+}
+
+/* Use the service listening at PATH; NULL or an empty string means
+   the engine in the process.  */
+void
+detrans_client_set_path (struct detrans_client *c, const char *path)
+{
+  client_close (c);
+  free (c->path);
+  c->path = path && *path ? strdup (path) : NULL;
+  c->retry = 0;
+}
+
+/* Keep the results of at most SIZE recent messages for TTL seconds (0
+   for ever); SIZE 0 turns the cache off.  */
+void
+detrans_client_set_cache (struct detrans_client *c, size_t size,
+                          unsigned ttl)
+{
+  cache_resize (&c->cache, size, ttl);
+}
+
+/* De-transliteration of MSG of length LEN with the rules of LANG (NULL
+   for russian) in MODE.  The result is valid until the next call with
+   the same client.  */
+const char *
+detrans_client (struct detrans_client *c, const struct detrans_lang *lang,
+                const char *msg, size_t len, enum detrans_mode mode)
+{
+  uint32_t flags = detrans_lang_id (lang) << DETRANSD_LANG_SHIFT;
+  time_t now = time (NULL);
+  const char *ret;
+
+  if (mode == DETRANS_LATTICE)
+    flags |= DETRANSD_LATTICE;
+  else if (mode == DETRANS_FUZZY)
+    flags |= DETRANSD_FUZZY;
+
+  if ((ret = cache_get (&c->cache, flags, msg, len, now)) != NULL)
+    return ret;
+
+  if (client_request (c, msg, len, flags))
+    ret = c->reply;
+  else
+    {
+      detrans_init ();
+      ret = detrans_ctx_lang (&c->ctx, lang, msg, len, mode);
+    }
+
+  cache_put (&c->cache, flags, msg, len, ret, now);
+  return ret;
+}
+
+/* Statistics of the service, allocated with malloc, or NULL if it
+   is not available.  */
+char *
+detrans_client_stats (struct detrans_client *c)
+{
+  return client_request (c, "", 0, DETRANSD_STATS) ? strdup (c->reply) : NULL;
+}
+
+void
+detrans_client_free (struct detrans_client *c)
+{
+  client_close (c);
+  free (c->path);
+  free (c->reply);
+  detrans_ctx_free (&c->ctx);
+  cache_free (&c->cache);
+  *c = (struct detrans_client) DETRANS_CLIENT_INIT;
+}
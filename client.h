@@ -0,0 +1,65 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+
+#ifndef __CLIENT_H__
+#define __CLIENT_H__
+
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include "detrans.h"
+#include "cache.h"
+
+/* Connection to detransd, see client.c.  */
+struct detrans_client
+{
+  /* Path to the socket, or NULL to use the engine in the process.  */
+  char *path;
+  int fd;
+  /* When to try to connect again after a failure.  */
+  time_t retry;
+  char *reply;
+  size_t reply_size;
+  /* Buffers of the engine, when the service is not available.  */
+  struct detrans_ctx ctx;
+  /* Results of the recent messages, off until set.  */
+  struct detrans_cache cache;
+};
+
+#define DETRANS_CLIENT_INIT {NULL, -1, 0, NULL, 0, DETRANS_CTX_INIT, \
+                             DETRANS_CACHE_INIT}
+
+/* Seconds to wait for the service before using the engine in the
+   process, and before trying the service again.  */
+#define CLIENT_TIMEOUT          1
+#define CLIENT_RETRY            30
+
+/* Default number of the results cached, and for how many seconds.  */
+#define CLIENT_CACHE_SIZE       64
+#define CLIENT_CACHE_TTL        60
+
+__BEGIN_DECLS
+void detrans_client_set_path (struct detrans_client *, const char *);
+char *  detrans_client_default_path (bool);
+bool detrans_client_dir_owner (const char *, uid_t *);
+void detrans_client_set_cache (struct detrans_client *, size_t, unsigned);
+const char *  detrans_client (struct detrans_client *,
+                              const struct detrans_lang *, const char *,
+                              size_t, enum detrans_mode);
+char *  detrans_client_stats (struct detrans_client *);
+void detrans_client_free (struct detrans_client *);
+__END_DECLS
+
+#endif  /* __CLIENT_H__  */
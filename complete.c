@@ -0,0 +1,789 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+/* Word completion.  The words of a dictionary are kept in a trie, and
+   every node of the trie has the list of the best words that start with
+   the prefix of the node.  The lists are computed once, in
+   COMPLETE_BUILD, so a lookup is a walk down the trie over the prefix
+   and a copy of the list, whatever the size of the dictionary.
+
+   The generic trie from trie.h takes a node per byte and a malloc per
+   node, which is about 150Mb for misc/ru-words.txt.  As the dictionary
+   doesn't change after it is loaded, the trie here is built at once
+   from the sorted words, over unicode characters, with the children of
+   every node kept next to each other in one array.
+
+   Words are better if they are more frequent, then if they are shorter,
+   then if they come earlier in the dictionary.
+
+   Building the whole dictionary takes a while and most of it is never
+   used, so COMPLETE_LOAD only reads the file and sorts the lines by the
+   first character of the word.  The words with the same first character
+   are a partition, built into a trie of its own on the first lookup of
+   a prefix starting with the character, and the lines are freed then.
+   All completions of a prefix are in its partition, so the results are
+   the same.
+
+   A lookup doesn't wait for the build, which may take a few
+   milliseconds: the partition is queued to a thread building them one
+   at a time, and the lookups find no completions until it is built.  */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "complete.h"
+
+#define NO_WORD         UINT32_MAX
+
+struct complete_word
+{
+  char *word;
+  /* Lowercase characters of the word.  */
+  uint32_t *key;
+  uint32_t key_len;
+  unsigned freq;
+};
+
+struct complete_node
+{
+  /* Children are NODES[CHILDREN .. CHILDREN + CHILDREN_COUNT), sorted.  */
+  uint32_t children;
+  /* Best words under the node are TOPS[TOP .. TOP + TOP_COUNT).  */
+  uint32_t top;
+  /* The word ending at this node, or NO_WORD.  */
+  uint32_t word;
+  uint32_t symb;
+  uint16_t children_count;
+  uint8_t top_count;
+};
+
+/* Words of the file from COMPLETE_LOAD starting with SYMB: COUNT lines
+   of the file in TEXT, every one ending with a newline, until the trie
+   is built of them; the trie or NULL.  QUEUED is set once the partition
+   is queued to be built.  */
+struct complete_part
+{
+  uint32_t symb;
+  char *text;
+  size_t text_len, text_size, count;
+  struct complete *trie;
+  int queued;
+};
+
+struct complete
+{
+  struct complete_word *words;
+  size_t count, size;
+
+  struct complete_node *nodes;
+  size_t nodes_count, nodes_size;
+  uint32_t *tops;
+  size_t tops_count, tops_size;
+
+  /* Partitions sorted by SYMB, for a dictionary from COMPLETE_LOAD.
+     BUILDER, if STARTED, builds QUEUE[HEAD .. HEAD + QUEUED) in order
+     until STOP is set; PENDING of them are not built yet.  LOCK guards
+     all that and the text of the partitions; WAKE is signalled when a
+     partition is queued and DONE when one is built.  */
+  struct complete_part *parts;
+  size_t parts_count, parts_size;
+  struct complete_part **queue;
+  size_t head, queued, pending;
+  pthread_mutex_t lock;
+  pthread_cond_t wake, done;
+  pthread_t builder;
+  bool started, stop;
+};
+
+
+/* Decode one utf-8 character of S (LEN bytes left) to *CP.  Returns its
+   length, or 0 if the sequence is broken.  */
+static inline size_t
+utf8_decode (const unsigned char *s, size_t len, uint32_t *cp)
+{
+  if (s[0] < 0x80)
+    {
+      *cp = s[0];
+      return 1;
+    }
+  else if ((s[0] & 0xe0) == 0xc0 && len >= 2 && (s[1] & 0xc0) == 0x80)
+    {
+      *cp = (s[0] & 0x1f) << 6 | (s[1] & 0x3f);
+      return 2;
+    }
+  else if ((s[0] & 0xf0) == 0xe0 && len >= 3 && (s[1] & 0xc0) == 0x80
+           && (s[2] & 0xc0) == 0x80)
+    {
+      *cp = (s[0] & 0x0f) << 12 | (s[1] & 0x3f) << 6 | (s[2] & 0x3f);
+      return 3;
+    }
+
+  return 0;
+}
+
+/* Lowercase latin and russian letters.  */
+static inline uint32_t
+fold (uint32_t cp)
+{
+  if ((cp >= 'A' && cp <= 'Z') || (cp >= 0x410 && cp <= 0x42f))
+    return cp + 0x20;
+  else if (cp == 0x401)
+    return 0x451;
+
+  return cp;
+}
+
+/* Decode and lowercase S of length LEN to KEY, which has place for
+   COMPLETE_MAX_PREFIX characters.  Returns the number of characters,
+   or -1 if S is not valid utf-8 or too long.  */
+static ssize_t
+make_key (const char *s, size_t len, uint32_t *key)
+{
+  size_t i, n = 0;
+
+  for (i = 0; i < len; n++)
+    {
+      size_t l;
+
+      if (n == COMPLETE_MAX_PREFIX
+          || (l = utf8_decode ((const unsigned char *) &s[i],
+                               len - i, &key[n])) == 0)
+        return -1;
+
+      key[n] = fold (key[n]);
+      i += l;
+    }
+
+  return n;
+}
+
+
+struct complete *
+complete_new ()
+{
+  struct complete *c = (struct complete *) calloc (1, sizeof (struct complete));
+
+  pthread_mutex_init (&c->lock, NULL);
+  pthread_cond_init (&c->wake, NULL);
+  pthread_cond_init (&c->done, NULL);
+  return c;
+}
+
+/* Add WORD of length LEN with frequency FREQ.  Words that differ only
+   in case are merged by COMPLETE_BUILD.  */
+void
+complete_add (struct complete *c, const char *word, size_t len,
+              unsigned freq)
+{
+  uint32_t key[COMPLETE_MAX_PREFIX];
+  ssize_t n;
+
+  if (len == 0 || (n = make_key (word, len, key)) <= 0)
+    return;
+
+  if (c->count == c->size)
+    {
+      c->size = c->size ? c->size * 2 : 1024;
+      c->words = (struct complete_word *)
+                 realloc (c->words, c->size * sizeof (struct complete_word));
+    }
+
+  c->words[c->count].word = strndup (word, len);
+  c->words[c->count].key = (uint32_t *) malloc (n * sizeof (uint32_t));
+  memcpy (c->words[c->count].key, key, n * sizeof (uint32_t));
+  c->words[c->count].key_len = n;
+  c->words[c->count].freq = freq;
+  c->count++;
+}
+
+
+static int
+cmp_keys (const void *a, const void *b)
+{
+  const struct complete_word *x = (const struct complete_word *) a;
+  const struct complete_word *y = (const struct complete_word *) b;
+  uint32_t i;
+
+  for (i = 0; i < x->key_len && i < y->key_len; i++)
+    if (x->key[i] != y->key[i])
+      return x->key[i] < y->key[i] ? -1 : 1;
+
+  return (x->key_len > y->key_len) - (x->key_len < y->key_len);
+}
+
+static inline bool
+better (const struct complete *c, uint32_t a, uint32_t b)
+{
+  if (c->words[a].freq != c->words[b].freq)
+    return c->words[a].freq > c->words[b].freq;
+  if (c->words[a].key_len != c->words[b].key_len)
+    return c->words[a].key_len < c->words[b].key_len;
+  return a < b;
+}
+
+/* Insert word W into the sorted list TOP of length *COUNT.  */
+static inline void
+top_insert (const struct complete *c, uint32_t *top, unsigned *count,
+            uint32_t w)
+{
+  unsigned i;
+
+  if (*count == COMPLETE_TOP && !better (c, w, top[COMPLETE_TOP - 1]))
+    return;
+
+  if (*count < COMPLETE_TOP)
+    (*count)++;
+
+  for (i = *count - 1; i > 0 && better (c, w, top[i - 1]); i--)
+    top[i] = top[i - 1];
+  top[i] = w;
+}
+
+static uint32_t
+new_nodes (struct complete *c, size_t n)
+{
+  uint32_t ret = c->nodes_count;
+
+  while (c->nodes_count + n > c->nodes_size)
+    {
+      c->nodes_size = c->nodes_size ? c->nodes_size * 2 : 1024;
+      c->nodes = (struct complete_node *)
+                 realloc (c->nodes,
+                          c->nodes_size * sizeof (struct complete_node));
+    }
+
+  c->nodes_count += n;
+  return ret;
+}
+
+/* Fill the node NODE with the words [LO, HI), which all share the
+   first DEPTH characters.  */
+static void
+build_node (struct complete *c, uint32_t node, size_t lo, size_t hi,
+            uint32_t depth)
+{
+  uint32_t top[COMPLETE_TOP];
+  unsigned top_count = 0;
+  size_t i, j, n = 0;
+  uint32_t first;
+
+  c->nodes[node].word = NO_WORD;
+  if (lo < hi && c->words[lo].key_len == depth)
+    c->nodes[node].word = lo++;
+
+  for (i = lo; i < hi; i = j, n++)
+    for (j = i; j < hi && c->words[j].key[depth] == c->words[i].key[depth]; )
+      j++;
+
+  first = new_nodes (c, n);
+  c->nodes[node].children = first;
+  c->nodes[node].children_count = n;
+
+  for (i = lo, n = 0; i < hi; i = j, n++)
+    {
+      struct complete_node *child;
+      uint32_t k;
+
+      for (j = i; j < hi && c->words[j].key[depth] == c->words[i].key[depth]; )
+        j++;
+
+      c->nodes[first + n].symb = c->words[i].key[depth];
+      build_node (c, first + n, i, j, depth + 1);
+
+      child = &c->nodes[first + n];
+      if (child->word != NO_WORD)
+        top_insert (c, top, &top_count, child->word);
+      for (k = 0; k < child->top_count; k++)
+        top_insert (c, top, &top_count, c->tops[child->top + k]);
+    }
+
+  if (c->tops_count + top_count > c->tops_size)
+    {
+      c->tops_size = c->tops_size ? c->tops_size * 2 : 1024;
+      c->tops = (uint32_t *) realloc (c->tops,
+                                      c->tops_size * sizeof (uint32_t));
+    }
+
+  memcpy (&c->tops[c->tops_count], top, top_count * sizeof (uint32_t));
+  c->nodes[node].top = c->tops_count;
+  c->nodes[node].top_count = top_count;
+  c->tops_count += top_count;
+}
+
+/* Build the trie and precompute the lists.  Has to be called after the
+   last COMPLETE_ADD and before the first COMPLETE_LOOKUP.  */
+void
+complete_build (struct complete *c)
+{
+  size_t i, n;
+
+  qsort (c->words, c->count, sizeof (struct complete_word), cmp_keys);
+
+  /* Merge the words that differ in case only, keeping the first
+     spelling.  */
+  for (i = n = 0; i < c->count; i++)
+    if (n > 0 && !cmp_keys (&c->words[n - 1], &c->words[i]))
+      {
+        c->words[n - 1].freq += c->words[i].freq;
+        free (c->words[i].word);
+        free (c->words[i].key);
+      }
+    else
+      c->words[n++] = c->words[i];
+  c->count = n;
+
+  c->nodes_count = c->tops_count = 0;
+  new_nodes (c, 1);
+  build_node (c, 0, 0, c->count, 0);
+
+  /* Keys are needed for building only.  */
+  for (i = 0; i < c->count; i++)
+    {
+      free (c->words[i].key);
+      c->words[i].key = NULL;
+    }
+}
+
+
+/* Find the word and its frequency in LINE of length LEN, one word
+   optionally followed by a tab and the frequency.  Returns the length
+   of the word.  */
+static size_t
+parse_line (const char *line, size_t len, unsigned *freq)
+{
+  const char *tab;
+
+  while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+    len--;
+
+  *freq = 1;
+  if ((tab = (const char *) memchr (line, '\t', len)) != NULL)
+    {
+      *freq = strtoul (tab + 1, NULL, 10);
+      len = tab - line;
+    }
+
+  return len;
+}
+
+/* The partition of the words starting with SYMB; a new one if CREATE
+   is set, NULL otherwise.  */
+static struct complete_part *
+find_part (struct complete *c, uint32_t symb, bool create)
+{
+  size_t lo = 0, hi = c->parts_count;
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+
+      if (c->parts[mid].symb < symb)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  if (lo < c->parts_count && c->parts[lo].symb == symb)
+    return &c->parts[lo];
+  if (!create)
+    return NULL;
+
+  if (c->parts_count == c->parts_size)
+    {
+      c->parts_size = c->parts_size ? c->parts_size * 2 : 64;
+      c->parts = (struct complete_part *)
+                 realloc (c->parts,
+                          c->parts_size * sizeof (struct complete_part));
+    }
+
+  memmove (&c->parts[lo + 1], &c->parts[lo],
+           (c->parts_count - lo) * sizeof (struct complete_part));
+  memset (&c->parts[lo], 0, sizeof (struct complete_part));
+  c->parts[lo].symb = symb;
+  c->parts_count++;
+  return &c->parts[lo];
+}
+
+/* Build the trie of the partition PART.  */
+static struct complete *
+part_build (const struct complete_part *part)
+{
+  struct complete *trie = complete_new ();
+  const char *line, *end;
+
+  for (line = part->text; line < part->text + part->text_len; line = end + 1)
+    {
+      unsigned freq;
+      size_t len;
+
+      end = (const char *) memchr (line, '\n',
+                                   part->text + part->text_len - line);
+      len = parse_line (line, end - line, &freq);
+      complete_add (trie, line, len, freq);
+    }
+  complete_build (trie);
+  return trie;
+}
+
+/* Make TRIE the trie of the partition PART of C and free its lines.
+   LOCK is held.  */
+static void
+part_publish (struct complete *c, struct complete_part *part,
+              struct complete *trie)
+{
+  __atomic_store_n (&part->trie, trie, __ATOMIC_RELEASE);
+  free (part->text);
+  part->text = NULL;
+  part->text_len = part->text_size = 0;
+  c->pending--;
+  pthread_cond_broadcast (&c->done);
+}
+
+/* The thread building the partitions of the dictionary ARG queued by
+   the lookups.  */
+static void *
+parts_build (void *arg)
+{
+  struct complete *c = (struct complete *) arg;
+
+  pthread_mutex_lock (&c->lock);
+  for (;;)
+    {
+      struct complete_part *part;
+      struct complete *trie;
+
+      while (c->queued == 0 && !c->stop)
+        pthread_cond_wait (&c->wake, &c->lock);
+      if (c->stop)
+        break;
+
+      part = c->queue[c->head++];
+      c->queued--;
+      pthread_mutex_unlock (&c->lock);
+      trie = part_build (part);
+      pthread_mutex_lock (&c->lock);
+      part_publish (c, part, trie);
+    }
+  pthread_mutex_unlock (&c->lock);
+
+  return NULL;
+}
+
+/* Queue the partition PART of C to be built, unless it is queued
+   already.  Without the builder, the partition is built here.  */
+static void
+part_queue (struct complete *c, struct complete_part *part)
+{
+  if (__atomic_exchange_n (&part->queued, 1, __ATOMIC_ACQ_REL))
+    return;
+
+  pthread_mutex_lock (&c->lock);
+  c->pending++;
+  if (c->started)
+    {
+      c->queue[c->head + c->queued++] = part;
+      pthread_cond_signal (&c->wake);
+    }
+  else
+    part_publish (c, part, part_build (part));
+  pthread_mutex_unlock (&c->lock);
+}
+
+/* Load the dictionary from FNAME, one word per line, optionally
+   followed by a tab and the frequency.  The partitions are built on
+   the first lookup, see COMPLETE_LOOKUP.  Returns NULL if the file
+   cannot be read.  */
+struct complete *
+complete_load (const char *fname)
+{
+  FILE *f = fopen (fname, "r");
+  struct complete *c;
+  char *text;
+  long size;
+  size_t pos, next, text_len;
+
+  if (f == NULL)
+    return NULL;
+
+  if (fseek (f, 0, SEEK_END) != 0 || (size = ftell (f)) < 0
+      || fseek (f, 0, SEEK_SET) != 0)
+    {
+      fclose (f);
+      return NULL;
+    }
+
+  text = (char *) malloc (size + 1);
+  text_len = fread (text, 1, size, f);
+  fclose (f);
+
+  c = complete_new ();
+  for (pos = 0; pos < text_len; pos = next)
+    {
+      const char *line = &text[pos], *end;
+      struct complete_part *part;
+      unsigned freq;
+      uint32_t symb;
+      size_t len;
+
+      end = (const char *) memchr (line, '\n', text_len - pos);
+      next = end ? (size_t) (end - text) + 1 : text_len;
+      len = parse_line (line, next - pos, &freq);
+
+      if (len == 0 || utf8_decode ((const unsigned char *) line, len,
+                                   &symb) == 0)
+        continue;
+
+      /* The line without the newline, if any, and a newline.  */
+      len = end ? (size_t) (end - line) : next - pos;
+      part = find_part (c, fold (symb), true);
+      while (part->text_len + len + 1 > part->text_size)
+        {
+          part->text_size = part->text_size ? part->text_size * 2 : 4096;
+          part->text = (char *) realloc (part->text, part->text_size);
+        }
+      memcpy (&part->text[part->text_len], line, len);
+      part->text[part->text_len + len] = '\n';
+      part->text_len += len + 1;
+      part->count++;
+    }
+  free (text);
+
+  for (pos = 0; pos < c->parts_count; pos++)
+    {
+      struct complete_part *part = &c->parts[pos];
+
+      part->text = (char *) realloc (part->text, part->text_len);
+      part->text_size = part->text_len;
+    }
+
+  /* The builder waits for the first partition to build, so the lookups
+     don't wait for the thread to start.  */
+  c->queue = (struct complete_part **)
+             malloc ((c->parts_count + 1) * sizeof (struct complete_part *));
+  c->started = pthread_create (&c->builder, NULL, parts_build, c) == 0;
+  return c;
+}
+
+/* Lookup of COMPLETE_LOOKUP in the trie of C.  */
+static size_t
+trie_lookup (const struct complete *c, const char *prefix, size_t len,
+             const char **out, size_t k)
+{
+  const struct complete_node *node;
+  size_t i = 0;
+
+  if (c->nodes_count == 0)
+    return 0;
+
+  node = &c->nodes[0];
+  while (i < len)
+    {
+      const struct complete_node *lo, *hi;
+      uint32_t cp;
+      size_t l = utf8_decode ((const unsigned char *) &prefix[i],
+                              len - i, &cp);
+
+      if (l == 0)
+        return 0;
+
+      cp = fold (cp);
+      i += l;
+
+      /* Binary search over the children.  */
+      lo = &c->nodes[node->children];
+      hi = lo + node->children_count;
+      while (lo < hi)
+        {
+          const struct complete_node *mid = lo + (hi - lo) / 2;
+
+          if (mid->symb < cp)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+
+      if (lo == &c->nodes[node->children] + node->children_count
+          || lo->symb != cp)
+        return 0;
+
+      node = lo;
+    }
+
+  for (i = 0; i < k && i < node->top_count; i++)
+    out[i] = c->words[c->tops[node->top + i]].word;
+
+  return i;
+}
+
+/* Find at most K best completions of PREFIX of length LEN and store them
+   in OUT.  The prefix itself is not a completion.  If the partition of
+   the prefix is not built yet, it is queued to be built and nothing is
+   found.  Returns the number of completions found.  */
+size_t
+complete_lookup (struct complete *c, const char *prefix, size_t len,
+                 const char **out, size_t k)
+{
+  struct complete_part *part;
+  const struct complete *trie;
+  uint32_t symb;
+
+  if (c == NULL || len == 0)
+    return 0;
+
+  if (c->parts_count == 0)
+    return trie_lookup (c, prefix, len, out, k);
+
+  if (utf8_decode ((const unsigned char *) prefix, len, &symb) == 0
+      || (part = find_part (c, fold (symb), false)) == NULL)
+    return 0;
+
+  if ((trie = __atomic_load_n (&part->trie, __ATOMIC_ACQUIRE)) == NULL)
+    {
+      part_queue (c, part);
+      return 0;
+    }
+
+  return trie_lookup (trie, prefix, len, out, k);
+}
+
+/* Wait until the partitions of C queued so far are built.  */
+void
+complete_wait (struct complete *c)
+{
+  if (c == NULL)
+    return;
+
+  pthread_mutex_lock (&c->lock);
+  while (c->pending > 0 && !c->stop)
+    pthread_cond_wait (&c->done, &c->lock);
+  pthread_mutex_unlock (&c->lock);
+}
+
+/* Number of nodes of the trie of C and bytes it uses.  */
+static size_t
+trie_nodes (const struct complete *c, size_t *bytes)
+{
+  size_t i;
+
+  *bytes = c->nodes_count * sizeof (struct complete_node)
+           + c->tops_count * sizeof (uint32_t)
+           + c->count * sizeof (struct complete_word);
+  for (i = 0; i < c->count; i++)
+    *bytes += strlen (c->words[i].word) + 1;
+
+  return c->nodes_count;
+}
+
+/* Number of trie nodes and bytes used, for the curious; of a dictionary
+   from COMPLETE_LOAD, the lines of the partitions not built yet and the
+   partitions built so far.  */
+size_t
+complete_nodes (struct complete *c, size_t *bytes)
+{
+  size_t i, nodes, size;
+
+  nodes = trie_nodes (c, &size);
+  size += c->parts_size * sizeof (struct complete_part)
+          + c->parts_count * sizeof (struct complete_part *);
+
+  pthread_mutex_lock (&c->lock);
+  for (i = 0; i < c->parts_count; i++)
+    {
+      const struct complete *trie = c->parts[i].trie;
+      size_t part_size;
+
+      size += c->parts[i].text_size;
+      if (trie != NULL)
+        {
+          nodes += trie_nodes (trie, &part_size);
+          size += part_size;
+        }
+    }
+  pthread_mutex_unlock (&c->lock);
+
+  if (bytes)
+    *bytes = size;
+  return nodes;
+}
+
+/* Describe at most N partitions of a dictionary from COMPLETE_LOAD in
+   PARTS, in the order of the first character.  Returns the number of
+   partitions, which is 0 for a dictionary built with COMPLETE_BUILD.  */
+size_t
+complete_partitions (struct complete *c, struct complete_partition *parts,
+                     size_t n)
+{
+  size_t i;
+
+  pthread_mutex_lock (&c->lock);
+  for (i = 0; i < n && i < c->parts_count; i++)
+    {
+      const struct complete *trie = c->parts[i].trie;
+
+      parts[i].first = c->parts[i].symb;
+      parts[i].words = c->parts[i].count;
+      parts[i].resident = trie != NULL;
+      parts[i].bytes = 0;
+      if (trie != NULL)
+        trie_nodes (trie, &parts[i].bytes);
+    }
+  pthread_mutex_unlock (&c->lock);
+
+  return c->parts_count;
+}
+
+void
+complete_free (struct complete *c)
+{
+  size_t i;
+
+  if (c == NULL)
+    return;
+
+  /* The builder stops after the partition it builds, if any.  */
+  pthread_mutex_lock (&c->lock);
+  c->stop = true;
+  pthread_cond_broadcast (&c->wake);
+  pthread_cond_broadcast (&c->done);
+  pthread_mutex_unlock (&c->lock);
+  if (c->started)
+    pthread_join (c->builder, NULL);
+
+  for (i = 0; i < c->count; i++)
+    {
+      free (c->words[i].word);
+      free (c->words[i].key);
+    }
+
+  for (i = 0; i < c->parts_count; i++)
+    {
+      complete_free (c->parts[i].trie);
+      free (c->parts[i].text);
+    }
+
+  free (c->words);
+  free (c->nodes);
+  free (c->tops);
+  free (c->parts);
+  free (c->queue);
+  pthread_cond_destroy (&c->done);
+  pthread_cond_destroy (&c->wake);
+  pthread_mutex_destroy (&c->lock);
+  free (c);
+}
@@ -0,0 +1,56 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+#ifndef __COMPLETE_H__
+#define __COMPLETE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of completions precomputed for every prefix, and so the
+   maximum number of completions one can ask for.  */
+#define COMPLETE_TOP            8
+
+/* Longest word (in characters) we know about.  */
+#define COMPLETE_MAX_PREFIX     256
+
+struct complete;
+
+/* A partition of a dictionary from COMPLETE_LOAD: the words starting
+   with the character FIRST (in small letters, for letters), and whether
+   it is built, using BYTES.  */
+struct complete_partition
+{
+  uint32_t first;
+  size_t words;
+  bool resident;
+  size_t bytes;
+};
+
+__BEGIN_DECLS
+struct complete *  complete_new (void);
+void complete_add (struct complete *, const char *, size_t, unsigned);
+void complete_build (struct complete *);
+struct complete *  complete_load (const char *);
+size_t complete_lookup (struct complete *, const char *, size_t,
+                        const char **, size_t);
+size_t complete_nodes (struct complete *, size_t *);
+size_t complete_partitions (struct complete *, struct complete_partition *,
+                            size_t);
+void complete_wait (struct complete *);
+void complete_free (struct complete *);
+__END_DECLS
+
+#endif  /* __COMPLETE_H__  */
@@ -0,0 +1,1402 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+/* Benchmarks of the de-transliteration engine.  Messages are made of
+   random words from misc/ru-words.txt (transliterated) and from
+   misc/en-words.txt, so the numbers are reproducible without any
+   private chat logs.
+
+     detrans-bench [-d misc-dir] [-n messages] [benchmark ...]
+
+   Without arguments all the benchmarks are run.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <ctype.h>
+#include <err.h>
+
+#include "detrans.h"
+#include "trie.h"
+#include "rules.h"
+#include "utf8.h"
+#include "complete.h"
+#include "affix.h"
+
+/* The generated matcher of the russian rules, see detrans-gen.c.  */
+#include "ru-matcher.def"
+
+struct symbol
+{
+  const char *str;
+  const char *repl;
+};
+
+/* Russian letter to translit.  */
+static const struct symbol ru_translit[] = {
+#define INPUT(a, b) {b, a},
+#include "ru-translit.def"
+#undef INPUT
+};
+
+/* Capital russian letter to the small one.  */
+static const struct symbol ru_small[] = {
+#define INPUT(a, b) {b, a},
+#include "ru-capital-letters.def"
+#undef INPUT
+};
+
+/* Russian letters written with diacritics in ISO-9 proper, and their
+   capital letters.  */
+static const struct symbol iso9_diacritics[] = {
+  {"ё", "ë"}, {"ж", "ž"}, {"ч", "č"}, {"ш", "š"}, {"щ", "ŝ"}, {"ъ", "ʺ"},
+  {"ь", "ʹ"}, {"э", "è"}, {"ю", "û"}, {"я", "â"}
+};
+
+static const struct symbol iso9_capitals[] = {
+  {"ë", "Ë"}, {"ž", "Ž"}, {"č", "Č"}, {"š", "Š"}, {"ŝ", "Ŝ"}, {"è", "È"},
+  {"û", "Û"}, {"â", "Â"}
+};
+
+#define array_size(a) (sizeof (a) / sizeof ((a)[0]))
+
+/* Every HOLDOUT-th word of the lists is left out of the classifier
+   model, see misc/gen-translit-model.py.  */
+#define HOLDOUT         10
+
+/* A list of strings.  */
+struct strings
+{
+  char **s;
+  size_t count, size;
+};
+
+static struct strings ru_words, ru_orig, en_words;
+static struct strings ru_held, en_held;
+static struct strings ru_msgs, en_msgs;
+static size_t msgs_count = 20000;
+static const char *misc_dir = "misc";
+
+
+static void
+strings_add (struct strings *l, char *s)
+{
+  if (l->count == l->size)
+    {
+      l->size = l->size ? l->size * 2 : 1024;
+      l->s = (char **) realloc (l->s, l->size * sizeof (char *));
+    }
+
+  l->s[l->count++] = s;
+}
+
+static void
+strings_free (struct strings *l)
+{
+  size_t i;
+
+  for (i = 0; i < l->count; i++)
+    free (l->s[i]);
+  free (l->s);
+}
+
+static size_t
+strings_bytes (const struct strings *l)
+{
+  size_t i, n = 0;
+
+  for (i = 0; i < l->count; i++)
+    n += strlen (l->s[i]);
+
+  return n;
+}
+
+static const struct symbol *
+find_letter (const struct symbol *tab, size_t n, const char *s)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    if (!strncmp (s, tab[i].str, strlen (tab[i].str)))
+      return &tab[i];
+
+  return NULL;
+}
+
+/* Transliterate a russian word, keeping the capital first letter, with
+   the letters with diacritics of ISO-9 if DIACRITICS is set.  Returns
+   NULL if the word has something strange inside.  */
+static char *
+translit_word (const char *ru, bool diacritics)
+{
+  char *ret = (char *) malloc (strlen (ru) * 2 + 1), *r = ret;
+  bool first = true;
+
+  while (*ru != '\0')
+    {
+      const struct symbol *c = find_letter (ru_small, array_size (ru_small), ru);
+      const char *s = c ? c->repl : ru;
+      const struct symbol *t = NULL, *cap;
+
+      if (diacritics)
+        t = find_letter (iso9_diacritics, array_size (iso9_diacritics), s);
+      if (!t)
+        t = find_letter (ru_translit, array_size (ru_translit), s);
+
+      if (!t)
+        {
+          free (ret);
+          return NULL;
+        }
+
+      memcpy (r, t->repl, strlen (t->repl));
+      if (c && first
+          && (cap = find_letter (iso9_capitals, array_size (iso9_capitals),
+                                 t->repl)) != NULL)
+        memcpy (r, cap->repl, strlen (cap->repl));
+      else if (c && first)
+        *r = *r - 'a' + 'A';
+      r += strlen (t->repl);
+      ru += strlen (t->str);
+      first = false;
+    }
+
+  *r = '\0';
+  return ret;
+}
+
+/* Load the words from NAME to L.  If TRANSLIT is set, the words are
+   transliterated and the original ones are stored in ORIG.  The words
+   left out of the classifier model are also copied to HELD.  */
+static void
+load_words (struct strings *l, struct strings *orig, struct strings *held,
+            const char *name, bool translit)
+{
+  char fname[1024], *line = NULL;
+  size_t line_size = 0, n = 0;
+  ssize_t len;
+  FILE *f;
+
+  snprintf (fname, sizeof (fname), "%s/%s", misc_dir, name);
+  if ((f = fopen (fname, "r")) == NULL)
+    err (EXIT_FAILURE, "cannot open '%s'", fname);
+
+  while ((len = getline (&line, &line_size, f)) != -1)
+    {
+      char *w;
+
+      while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        line[--len] = '\0';
+
+      if (len == 0)
+        continue;
+
+      w = translit ? translit_word (line, false) : strdup (line);
+      if (w)
+        {
+          strings_add (l, w);
+          if (orig)
+            strings_add (orig, strdup (line));
+          if (n % HOLDOUT == HOLDOUT - 1)
+            strings_add (held, strdup (w));
+        }
+      n++;
+    }
+
+  free (line);
+  fclose (f);
+}
+
+/* Make COUNT chat-like messages of 3 to 15 random words.  */
+static void
+make_messages (struct strings *msgs, const struct strings *words, size_t count)
+{
+  size_t i;
+
+  for (i = 0; i < count; i++)
+    {
+      size_t n = 3 + rand () % 13, j, len = 0;
+      const char *w[n];
+      char *msg, *m;
+
+      for (j = 0; j < n; j++)
+        {
+          w[j] = words->s[rand () % words->count];
+          len += strlen (w[j]) + 1;
+        }
+
+      m = msg = (char *) malloc (len + 1);
+      for (j = 0; j < n; j++)
+        {
+          m = stpcpy (m, w[j]);
+          *m++ = j == n - 1 ? '.' : ' ';
+        }
+      *m = '\0';
+      strings_add (msgs, msg);
+    }
+}
+
+static double
+now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+/* Cost of detrans itself.  Returns ns per byte.  */
+static double
+time_detrans (const struct strings *msgs)
+{
+  double start = now ();
+  size_t i;
+
+  for (i = 0; i < msgs->count; i++)
+    free (detrans (msgs->s[i], strlen (msgs->s[i])));
+
+  return (now () - start) / strings_bytes (msgs);
+}
+
+/* Cost of the classifier, and the number of messages it lets through.  */
+static double
+time_classify (const struct strings *msgs, size_t *passed)
+{
+  double start, ret;
+  size_t i, n = 0;
+  int rep;
+
+  /* The classifier is too fast to measure it in one go.  */
+  start = now ();
+  for (rep = 0; rep < 10; rep++)
+    for (i = 0, n = 0; i < msgs->count; i++)
+      n += detrans_is_translit (msgs->s[i], strlen (msgs->s[i]));
+  ret = (now () - start) / 10 / strings_bytes (msgs);
+
+  *passed = n;
+  return ret;
+}
+
+/* Cost of the classifier against detrans, and its accuracy on
+   messages made of the words the model has not seen.  */
+static void
+bench_classify ()
+{
+  struct strings ru = {NULL, 0, 0}, en = {NULL, 0, 0};
+  double d, c_ru, c_en;
+  size_t ru_passed, en_passed;
+
+  d = time_detrans (&ru_msgs);
+  c_ru = time_classify (&ru_msgs, &ru_passed);
+  c_en = time_classify (&en_msgs, &en_passed);
+
+  printf ("classify: detrans            %8.2f ns/byte\n", d);
+  printf ("classify: classifier translit %7.2f ns/byte (%.1f%% of detrans)\n",
+          c_ru, 100 * c_ru / d);
+  printf ("classify: classifier english  %7.2f ns/byte (%.1f%% of detrans)\n",
+          c_en, 100 * c_en / d);
+
+  make_messages (&ru, &ru_held, msgs_count);
+  make_messages (&en, &en_held, msgs_count);
+  time_classify (&ru, &ru_passed);
+  time_classify (&en, &en_passed);
+
+  printf ("classify: held-out words      %zu translit, %zu english\n",
+          ru_held.count, en_held.count);
+  printf ("classify: translit detected   %6.2f%% (%zu of %zu)\n",
+          100.0 * ru_passed / ru.count, ru_passed, ru.count);
+  printf ("classify: english skipped     %6.2f%% (%zu of %zu)\n",
+          100.0 * (en.count - en_passed) / en.count,
+          en.count - en_passed, en.count);
+
+  time_classify (&ru_held, &ru_passed);
+  time_classify (&en_held, &en_passed);
+  printf ("classify: single words        %6.2f%% translit detected, "
+          "%6.2f%% english skipped\n",
+          100.0 * ru_passed / ru_held.count,
+          100.0 * (en_held.count - en_passed) / en_held.count);
+
+  strings_free (&ru);
+  strings_free (&en);
+}
+
+
+/* Number of dictionary words decoded correctly with TRIE.  */
+static size_t
+count_correct (struct trie *trie)
+{
+  size_t i, n = 0;
+
+  for (i = 0; i < ru_words.count; i++)
+    {
+      char *out = detrans_with_trie (trie, ru_words.s[i],
+                                     strlen (ru_words.s[i]));
+      n += !strcmp (out, ru_orig.s[i]);
+      free (out);
+    }
+
+  return n;
+}
+
+/* ISO-9 letters without the exceptions.  */
+static const struct symbol iso9_letters[] = {
+#define INPUT(a, b) {a, b},
+#include "ru-replacement.def"
+#undef INPUT
+};
+
+/* A trie with ISO-9 letters only, RULES has place for the rules of
+   all of them.  */
+static struct trie *
+iso9_trie (struct detrans_rule *rules)
+{
+  struct trie *iso9 = trie_new ();
+  size_t i;
+
+  for (i = 0; i < array_size (iso9_letters); i++)
+    {
+      rules[i] = (struct detrans_rule)
+                 {
+                   .repl = iso9_letters[i].repl,
+                   .repl_len = strlen (iso9_letters[i].repl),
+                   .kind = DETRANS_RULE_LETTER
+                 };
+      trie_add_word (iso9, iso9_letters[i].str, strlen (iso9_letters[i].str),
+                     (ssize_t) &rules[i]);
+    }
+
+  return iso9;
+}
+
+static void
+bench_lattice ()
+{
+  struct detrans_rule rules[array_size (iso9_letters)];
+  struct trie *iso9 = iso9_trie (rules);
+  struct trie *full;
+  size_t n = ru_words.count;
+  double g, l;
+
+  /* The default trie, as detrans uses it.  */
+  full = detrans_trie_get ();
+
+  detrans_set_mode (DETRANS_GREEDY);
+  printf ("lattice: greedy, iso-9 only      %6.2f%% words correct\n",
+          100.0 * count_correct (iso9) / n);
+  printf ("lattice: greedy, with exceptions %6.2f%% words correct\n",
+          100.0 * count_correct (full) / n);
+  g = time_detrans (&ru_msgs);
+
+  detrans_set_mode (DETRANS_LATTICE);
+  printf ("lattice: lattice, iso-9 only     %6.2f%% words correct\n",
+          100.0 * count_correct (iso9) / n);
+  printf ("lattice: lattice, with exceptions %5.2f%% words correct\n",
+          100.0 * count_correct (full) / n);
+  l = time_detrans (&ru_msgs);
+  detrans_set_mode (DETRANS_GREEDY);
+
+  printf ("lattice: greedy  %8.2f ns/byte\n", g);
+  printf ("lattice: lattice %8.2f ns/byte\n", l);
+
+  trie_free (iso9);
+}
+
+
+/* Split the utf-8 string S into letters, at most 64 of them, each
+   packed into an unsigned.  Returns the number of letters.  */
+static size_t
+utf8_letters (const char *s, unsigned *letters)
+{
+  size_t n = 0;
+
+  for (; *s != '\0' && n < 64; n++)
+    {
+      letters[n] = (unsigned char) *s++;
+      while ((*s & 0xc0) == 0x80)
+        letters[n] = letters[n] << 8 | (unsigned char) *s++;
+    }
+
+  return n;
+}
+
+/* Edit distance between the words A and B in letters.  */
+static size_t
+letters_distance (const char *a, const char *b)
+{
+  unsigned la[64], lb[64];
+  size_t n = utf8_letters (a, la), m = utf8_letters (b, lb);
+  size_t d[65][65], i, j;
+
+  for (i = 0; i <= n; i++)
+    d[i][0] = i;
+  for (j = 0; j <= m; j++)
+    d[0][j] = j;
+
+  for (i = 1; i <= n; i++)
+    for (j = 1; j <= m; j++)
+      {
+        d[i][j] = d[i - 1][j - 1] + (la[i - 1] != lb[j - 1]);
+        if (d[i - 1][j] + 1 < d[i][j])
+          d[i][j] = d[i - 1][j] + 1;
+        if (d[i][j - 1] + 1 < d[i][j])
+          d[i][j] = d[i][j - 1] + 1;
+      }
+
+  return d[n][m];
+}
+
+/* W with a random typo after the first letter: a letter dropped, added
+   or replaced.  */
+static char *
+make_typo (const char *w)
+{
+  size_t len = strlen (w), pos = 1 + rand () % (len - 1);
+  char *t = (char *) malloc (len + 2), c = 'a' + rand () % 26;
+
+  memcpy (t, w, pos);
+  switch (rand () % 3)
+    {
+    case 0:
+      strcpy (t + pos, w + pos + 1);
+      break;
+    case 1:
+      t[pos] = c;
+      strcpy (t + pos + 1, w + pos);
+      break;
+    default:
+      t[pos] = c;
+      strcpy (t + pos + 1, w + pos + 1);
+    }
+
+  return t;
+}
+
+/* Typos in the words which need the exceptions: how many of them come
+   out a letter away from the right word, which is the typo itself, with
+   and without the fuzzy mode.  Then the price: correct words broken by
+   the fuzzy mode, and the time on the usual messages.  */
+static void
+bench_fuzzy ()
+{
+  struct detrans_rule rules[array_size (iso9_letters)];
+  struct trie *iso9 = iso9_trie (rules), *full = detrans_trie_get ();
+  size_t i, n = 0, near_greedy = 0, near_fuzzy = 0, clean_greedy, clean_fuzzy;
+  double g, f;
+
+  srand (42);
+  for (i = 0; i < ru_words.count; i++)
+    {
+      const char *w = ru_words.s[i];
+      char *out, *typo;
+
+      if (strlen (w) < 5)
+        continue;
+
+      detrans_set_mode (DETRANS_GREEDY);
+      out = detrans_with_trie (iso9, w, strlen (w));
+      if (!strcmp (out, ru_orig.s[i]))
+        {
+          free (out);
+          continue;
+        }
+      free (out);
+
+      typo = make_typo (w);
+      out = detrans_with_trie (full, typo, strlen (typo));
+      near_greedy += letters_distance (out, ru_orig.s[i]) <= 1;
+      free (out);
+
+      detrans_set_mode (DETRANS_FUZZY);
+      out = detrans_with_trie (full, typo, strlen (typo));
+      near_fuzzy += letters_distance (out, ru_orig.s[i]) <= 1;
+      free (out);
+
+      free (typo);
+      n++;
+    }
+
+  detrans_set_mode (DETRANS_GREEDY);
+  clean_greedy = count_correct (full);
+  g = time_detrans (&ru_msgs);
+
+  detrans_set_mode (DETRANS_FUZZY);
+  clean_fuzzy = count_correct (full);
+  f = time_detrans (&ru_msgs);
+  detrans_set_mode (DETRANS_GREEDY);
+
+  printf ("fuzzy: typos in %zu words needing exceptions\n", n);
+  printf ("fuzzy: greedy, a letter off  %6.2f%%\n", 100.0 * near_greedy / n);
+  printf ("fuzzy: fuzzy, a letter off   %6.2f%%\n", 100.0 * near_fuzzy / n);
+  printf ("fuzzy: greedy, clean words   %6.2f%% correct\n",
+          100.0 * clean_greedy / ru_words.count);
+  printf ("fuzzy: fuzzy, clean words    %6.2f%% correct\n",
+          100.0 * clean_fuzzy / ru_words.count);
+  printf ("fuzzy: greedy %8.2f ns/byte\n", g);
+  printf ("fuzzy: fuzzy  %8.2f ns/byte (%.2f times greedy)\n", f, f / g);
+
+  trie_free (iso9);
+}
+
+
+/* Cost of the child lookups, as detrans does them: the longest match
+   from every position of every dictionary word.  The best of several
+   runs, as this is a few milliseconds.  */
+static void
+bench_trie ()
+{
+  struct trie *trie = detrans_trie_get ();
+  double best = 0;
+  size_t lookups = 0;
+  ssize_t sum = 0;
+  int rep;
+
+  for (rep = 0; rep < 10; rep++)
+    {
+      double start = now (), t;
+      size_t i;
+
+      lookups = 0;
+      for (i = 0; i < ru_words.count; i++)
+        {
+          const char *w = ru_words.s[i];
+
+          const char *end = w + strlen (w);
+
+          for (; w < end; w++)
+            {
+              struct trie *t = trie;
+              const char *p;
+
+              for (p = w; p < end && t != NULL; p++)
+                {
+                  struct child *c = trie_search_child (t, tolower (*p));
+
+                  lookups++;
+                  if (c == NULL
+                      || (c->label_len
+                          && !trie_match_label (c, p + 1, end - p - 1)))
+                    break;
+                  sum += c->last;
+                  t = c->next;
+                  p += c->label_len;
+                }
+            }
+        }
+
+      t = (now () - start) / lookups;
+      if (rep == 0 || t < best)
+        best = t;
+    }
+
+  printf ("trie: %zu edges, %.2f ns per edge (%zd)\n",
+          lookups, best, sum & 1);
+}
+
+/* Length of the longest russian rule in TRIE at S of length LEN.  */
+static size_t
+trie_longest (struct trie *trie, const char *s, size_t len)
+{
+  size_t pos = 0, match = 0;
+
+  while (trie != NULL && pos < len)
+    {
+      struct child *c = trie_search_child (trie, ascii_lower (s[pos]));
+
+      if (c == NULL
+          || (c->label_len
+              && !trie_match_label (c, s + pos + 1, len - pos - 1)))
+        break;
+
+      pos += c->label_len + 1;
+      /* Russian is the first language of the leaves.  */
+      if (leaf_rule (c->last, 0) != NULL)
+        match = pos;
+      trie = c->next;
+    }
+
+  return match;
+}
+
+/* The same with the generated matcher.  */
+static size_t
+compiled_longest (const char *s, size_t len)
+{
+  size_t index, letter = ru_letters_match (s, len, &index),
+         word = ru_words_match (s, len, &index);
+
+  return word > letter ? word : letter;
+}
+
+/* The matcher generated from the tables against the trie: the longest
+   russian rule from every position of every dictionary word, the best
+   of several runs.  The sums of the lengths matched must be the same.  */
+static void
+bench_matcher ()
+{
+  struct trie *trie = detrans_trie_get ();
+  double best[2] = {0, 0};
+  size_t sum[2] = {0, 0}, positions = 0;
+  int rep, m;
+
+  for (rep = 0; rep < 10; rep++)
+    for (m = 0; m < 2; m++)
+      {
+        double start = now (), t;
+        size_t i;
+
+        sum[m] = positions = 0;
+        for (i = 0; i < ru_words.count; i++)
+          {
+            const char *w = ru_words.s[i], *end = w + strlen (w);
+
+            for (; w < end; w++, positions++)
+              sum[m] += m == 0 ? trie_longest (trie, w, end - w)
+                               : compiled_longest (w, end - w);
+          }
+
+        t = (now () - start) / positions;
+        if (rep == 0 || t < best[m])
+          best[m] = t;
+      }
+
+  printf ("matcher: %zu positions\n", positions);
+  printf ("matcher: trie      %8.2f ns per position (%zu)\n", best[0], sum[0]);
+  printf ("matcher: compiled  %8.2f ns per position (%zu)\n", best[1], sum[1]);
+  if (sum[0] != sum[1])
+    printf ("matcher: the matchers differ\n");
+}
+
+/* Bytes used by the nodes of TRIE, the leaves not counted.  */
+static size_t
+trie_bytes (const struct trie *trie)
+{
+  size_t i, n = sizeof (struct trie);
+
+  if (trie->children != &trie->one)
+    n += trie->children_size * sizeof (struct child);
+  if (trie->kind == TRIE_NODE_WIDE)
+    n += 256 * sizeof (unsigned short);
+
+  for (i = 0; i < trie->children_count; i++)
+    {
+      n += trie->children[i].label_len;
+      if (trie->children[i].next != NULL)
+        n += trie_bytes (trie->children[i].next);
+    }
+
+  return n;
+}
+
+/* Length of the longest key of TRIE at S of length LEN, its value
+   in *VALUE.  */
+static size_t
+trie_longest_key (struct trie *trie, const char *s, size_t len,
+                  ssize_t *value)
+{
+  size_t pos = 0, match = 0;
+
+  while (trie != NULL && pos < len)
+    {
+      struct child *c = trie_search_child (trie, ascii_lower (s[pos]));
+
+      if (c == NULL
+          || (c->label_len
+              && !trie_match_label (c, s + pos + 1, len - pos - 1)))
+        break;
+
+      pos += c->label_len + 1;
+      if (c->last != TRIE_NOT_LAST)
+        {
+          match = pos;
+          *value = c->last;
+        }
+      trie = c->next;
+    }
+
+  return match;
+}
+
+/* The keys KEYS[0 .. N) as a trie and as stems and suffixes (see
+   affix.c), described as NAME: the size of both, and the longest key
+   from every position of every dictionary word, the best of several
+   runs.  The sums of the lengths and the values matched must be the
+   same.  */
+static void
+compare_affix (const char *name, const char *const *keys, size_t n)
+{
+  struct trie *trie = trie_new ();
+  struct affix a = AFFIX_INIT;
+  double best[2] = {0, 0}, start;
+  size_t sum[2] = {0, 0}, positions = 0, i;
+  uint64_t probes = 0;
+  int rep, m;
+
+  for (i = 0; i < n; i++)
+    {
+      trie_add_word (trie, keys[i], strlen (keys[i]), i);
+      affix_add (&a, keys[i], strlen (keys[i]), i);
+    }
+
+  start = now ();
+  if (!affix_build (&a))
+    {
+      printf ("affix: %s: the dictionary is too large\n", name);
+      trie_free (trie);
+      return;
+    }
+
+  printf ("affix: %s: %zu stems, %zu suffixes, %zu classes, "
+          "built in %.2f ms\n", name, a.stems_count, a.suffixes_count,
+          a.classes_count, (now () - start) / 1e6);
+  printf ("affix: %s: trie %zu bytes, affix %zu bytes\n",
+          name, trie_bytes (trie), affix_bytes (&a));
+
+  for (rep = 0; rep < 10; rep++)
+    for (m = 0; m < 2; m++)
+      {
+        double t;
+
+        start = now ();
+        sum[m] = positions = 0;
+        for (i = 0; i < ru_words.count; i++)
+          {
+            const char *w = ru_words.s[i], *end = w + strlen (w);
+
+            for (; w < end; w++, positions++)
+              if (m == 0)
+                {
+                  ssize_t value = 0;
+
+                  sum[m] += trie_longest_key (trie, w, end - w, &value);
+                  sum[m] += value;
+                }
+              else
+                {
+                  uint32_t value = 0;
+
+                  sum[m] += affix_match (&a, w, end - w, &value, &probes);
+                  sum[m] += value;
+                }
+          }
+
+        t = (now () - start) / positions;
+        if (rep == 0 || t < best[m])
+          best[m] = t;
+      }
+
+  printf ("affix: %s: %zu positions\n", name, positions);
+  printf ("affix: %s: trie   %8.2f ns per position (%zu)\n",
+          name, best[0], sum[0]);
+  printf ("affix: %s: affix  %8.2f ns per position (%zu)\n",
+          name, best[1], sum[1]);
+  if (sum[0] != sum[1])
+    printf ("affix: %s: the dictionaries differ\n", name);
+
+  affix_free (&a);
+  trie_free (trie);
+}
+
+/* The exceptions, which the engine looks up at word starts, and the
+   whole dictionary, as a trie and as stems and suffixes.  */
+static void
+bench_affix ()
+{
+  static const char *special[] = {
+#define INPUT(a, b) a,
+#include "ru-special-words.def"
+#undef INPUT
+  };
+
+  compare_affix ("exceptions", special, array_size (special));
+  compare_affix ("words", (const char *const *) ru_words.s, ru_words.count);
+}
+
+/* The statistics collected by detrans over the russian messages.  */
+static void
+bench_stats ()
+{
+  char *report;
+
+  detrans_stats_reset ();
+  printf ("stats: detrans %8.2f ns/byte\n", time_detrans (&ru_msgs));
+
+  report = detrans_stats_string ();
+  printf ("%s\n", report);
+  free (report);
+}
+
+/* Messages per batch, about a screen of a replayed backlog.  */
+#define BENCH_BATCH     200
+
+/* Messages one by one, against DETRANS_BATCH in batches of BENCH_BATCH
+   messages, the best of five rounds.  */
+static void
+bench_batch ()
+{
+  struct detrans_arena arena = DETRANS_ARENA_INIT;
+  size_t *lens = (size_t *) malloc (ru_msgs.count * sizeof (size_t));
+  size_t i, bytes = strings_bytes (&ru_msgs);
+  /* Keeps the compiler from dropping the work.  */
+  volatile char sum = 0;
+  double start, t, single = 0, batch = 0;
+  int round;
+
+  for (i = 0; i < ru_msgs.count; i++)
+    lens[i] = strlen (ru_msgs.s[i]);
+
+  for (round = 0; round < 5; round++)
+    {
+      start = now ();
+      for (i = 0; i < ru_msgs.count; i++)
+        {
+          char *out = detrans (ru_msgs.s[i], lens[i]);
+
+          sum += out[0];
+          free (out);
+        }
+      t = (now () - start) / bytes;
+      if (round == 0 || t < single)
+        single = t;
+
+      start = now ();
+      for (i = 0; i < ru_msgs.count; i += BENCH_BATCH)
+        {
+          size_t n = ru_msgs.count - i < BENCH_BATCH
+                     ? ru_msgs.count - i : BENCH_BATCH;
+          const char **out = detrans_batch ((const char *const *) &ru_msgs.s[i],
+                                            &lens[i], NULL, n, &arena);
+
+          sum += out[0][0];
+        }
+      t = (now () - start) / bytes;
+      if (round == 0 || t < batch)
+        batch = t;
+    }
+
+  printf ("batch: one by one  %8.2f ns/byte\n", single);
+  printf ("batch: %4d a batch %8.2f ns/byte (%.1f%% of one by one)\n",
+          BENCH_BATCH, batch, 100 * batch / single);
+
+  detrans_arena_free (&arena);
+  free (lens);
+}
+
+/* The dictionary and the messages written with the letters with
+   diacritics of ISO-9 against the usual ones.  */
+static void
+bench_diacritics ()
+{
+  struct strings words = {NULL, 0, 0}, msgs = {NULL, 0, 0};
+  size_t i, plain = 0, dia = 0;
+  double tp, td;
+
+  for (i = 0; i < ru_orig.count; i++)
+    {
+      char *w = translit_word (ru_orig.s[i], true);
+      char *out;
+
+      if (w == NULL)
+        continue;
+
+      out = detrans (ru_words.s[i], strlen (ru_words.s[i]));
+      plain += !strcmp (out, ru_orig.s[i]);
+      free (out);
+
+      out = detrans (w, strlen (w));
+      dia += !strcmp (out, ru_orig.s[i]);
+      free (out);
+
+      strings_add (&words, w);
+    }
+
+  srand (42);
+  make_messages (&msgs, &words, msgs_count);
+  tp = time_detrans (&ru_msgs);
+  td = time_detrans (&msgs);
+
+  printf ("diacritics: %zu words, plain %6.2f%% correct, "
+          "diacritics %6.2f%% correct\n", words.count,
+          100.0 * plain / words.count, 100.0 * dia / words.count);
+  printf ("diacritics: plain %8.2f ns/byte, diacritics %8.2f ns/byte\n",
+          tp, td);
+
+  strings_free (&words);
+  strings_free (&msgs);
+}
+
+/* The whole result of the messages MSGS against the list of edits,
+   described as NAME, the best of 3 rounds.  */
+static void
+time_edits (const char *name, const struct strings *msgs)
+{
+  struct detrans_ctx ctx = DETRANS_CTX_INIT;
+  struct detrans_edits edits = DETRANS_EDITS_INIT;
+  size_t i, bytes = strings_bytes (msgs), count = 0, changed = 0;
+  volatile char sum = 0;
+  double start, t, te, best = 0, best_edits = 0;
+  int round;
+
+  for (round = 0; round < 3; round++)
+    {
+      start = now ();
+      for (i = 0; i < msgs->count; i++)
+        sum += *detrans_ctx (&ctx, msgs->s[i], strlen (msgs->s[i]));
+      t = (now () - start) / bytes;
+
+      start = now ();
+      for (i = count = changed = 0; i < msgs->count; i++)
+        {
+          size_t n = detrans_edits (&edits, msgs->s[i], strlen (msgs->s[i]));
+
+          count += n;
+          while (n-- > 0)
+            changed += edits.edit[n].len;
+        }
+      te = (now () - start) / bytes;
+
+      if (round == 0 || t < best)
+        best = t;
+      if (round == 0 || te < best_edits)
+        best_edits = te;
+    }
+
+  printf ("markup: %s: %zu messages, %zu bytes, %8.2f ns/byte\n",
+          name, msgs->count, bytes, best);
+  printf ("markup: %s: edits %8.2f ns/byte, %.1f edits a message, "
+          "%.1f%% of the bytes replaced\n", name, best_edits,
+          (double) count / msgs->count, 100.0 * changed / bytes);
+
+  detrans_ctx_free (&ctx);
+  detrans_edits_free (&edits);
+}
+
+/* Messages the way pidgin hands them over: formatting tags, entities
+   and a link here and there.  In translit, and in cyrillic with a
+   translit word in every message, which the edits leave as they are.  */
+static void
+bench_markup ()
+{
+  struct strings msgs = {NULL, 0, 0}, mixed = {NULL, 0, 0};
+  size_t i;
+
+  for (i = 0; i < ru_msgs.count; i++)
+    {
+      const char *link = i % 4 ? "" : " <a href=\"http://example.com/a?b=c\">"
+                                      "http://example.com/a?b=c</a>";
+      char *m;
+
+      if (asprintf (&m, "<font color=\"#A82F2F\"><b>%s</b> &quot;%s&quot;"
+                    "%s</font><br/>", ru_msgs.s[i], ru_msgs.s[(i + 1)
+                                                   % ru_msgs.count],
+                    link) == -1)
+        err (EXIT_FAILURE, "asprintf");
+      strings_add (&msgs, m);
+
+      if (asprintf (&m, "<font color=\"#A82F2F\"><b>%s %s</b> %s "
+                    "&quot;%s %s&quot; %s%s</font><br/>",
+                    ru_orig.s[i % ru_orig.count],
+                    ru_orig.s[(i * 7 + 1) % ru_orig.count],
+                    ru_orig.s[(i * 13 + 2) % ru_orig.count],
+                    ru_orig.s[(i * 17 + 3) % ru_orig.count],
+                    ru_orig.s[(i * 19 + 4) % ru_orig.count],
+                    ru_words.s[(i * 23 + 5) % ru_words.count], link) == -1)
+        err (EXIT_FAILURE, "asprintf");
+      strings_add (&mixed, m);
+    }
+
+  time_edits ("translit", &msgs);
+  time_edits ("cyrillic", &mixed);
+
+  strings_free (&msgs);
+  strings_free (&mixed);
+}
+
+/* Length of the message typed in the incremental benchmark.  */
+#define BENCH_INCREMENTAL       (4 * 1024)
+
+/* A long message typed a character at a time, and then corrected at
+   random places, with the preview decoded after every keystroke: the
+   whole message every time against the updates.  */
+static void
+bench_incremental ()
+{
+  struct detrans_ctx ctx = DETRANS_CTX_INIT;
+  struct detrans_incr incr = DETRANS_INCR_INIT;
+  char *msg = (char *) malloc (BENCH_INCREMENTAL + 1), *edit;
+  size_t i, len = 0, keys = 0, converted = 0;
+  volatile char sum = 0;
+  double start, tf, tu, ef, eu;
+
+  for (i = 0; len < BENCH_INCREMENTAL; i++)
+    len += snprintf (msg + len, BENCH_INCREMENTAL + 1 - len, "%s ",
+                     ru_msgs.s[i % ru_msgs.count]);
+  len = BENCH_INCREMENTAL;
+  edit = strdup (msg);
+
+  start = now ();
+  for (i = 1; i <= len; i++)
+    sum += *detrans_ctx (&ctx, msg, i);
+  tf = (now () - start) / len;
+
+  start = now ();
+  for (i = 1; i <= len; i++)
+    {
+      sum += *detrans_update (&incr, NULL, msg, i, DETRANS_GREEDY);
+      converted += incr.converted;
+    }
+  tu = (now () - start) / len;
+
+  printf ("incremental: typing %d bytes, whole %8.2f us/key, "
+          "update %8.2f us/key (%.1f times faster), %.1f bytes decoded "
+          "a key\n", BENCH_INCREMENTAL, tf / 1000, tu / 1000, tf / tu,
+          (double) converted / len);
+
+  /* Corrections: a letter replaced, the previous one put back.  */
+  srand (42);
+  converted = 0;
+  start = now ();
+  for (keys = 0; keys < 1000; keys++)
+    {
+      edit[rand () % len] = 'a' + rand () % 26;
+      sum += *detrans_ctx (&ctx, edit, len);
+    }
+  ef = (now () - start) / keys;
+
+  srand (42);
+  memcpy (edit, msg, len);
+  start = now ();
+  for (keys = 0; keys < 1000; keys++)
+    {
+      edit[rand () % len] = 'a' + rand () % 26;
+      sum += *detrans_update (&incr, NULL, edit, len, DETRANS_GREEDY);
+      converted += incr.converted;
+    }
+  eu = (now () - start) / keys;
+
+  printf ("incremental: editing, whole %8.2f us/key, update %8.2f us/key "
+          "(%.1f times faster), %.1f bytes decoded a key\n",
+          ef / 1000, eu / 1000, ef / eu, (double) converted / keys);
+
+  detrans_ctx_free (&ctx);
+  detrans_incr_free (&incr);
+  free (edit);
+  free (msg);
+}
+
+/* Length of the adversarial messages.  */
+#define BENCH_ADVERSARIAL       (64 * 1024)
+
+/* Message of LEN bytes made of PATTERN over and over.  */
+static char *
+repeat (const char *pattern, size_t len)
+{
+  char *s = (char *) malloc (len + 1);
+  size_t i, n = strlen (pattern);
+
+  for (i = 0; i < len; i++)
+    s[i] = pattern[i % n];
+  s[len] = '\0';
+  return s;
+}
+
+/* Messages crafted to hit the worst cases of every part of the engine,
+   in both modes, against the usual messages.  The worst ns/byte is what
+   a flagged contact can make us spend on one message.  */
+static void
+bench_adversarial ()
+{
+  static const char *special[] = {
+#define INPUT(a, b) a,
+#include "ru-special-words.def"
+#undef INPUT
+  };
+  static const char *mode_names[] = {
+    [DETRANS_GREEDY] = "greedy",
+    [DETRANS_LATTICE] = "lattice",
+    [DETRANS_FUZZY] = "fuzzy"
+  };
+  /* The longest special word without its last letter: the matcher
+     walks all of it at every position and finds nothing longer.  With
+     the last letters changed, the fuzzy search goes as deep.  */
+  char prefix[256] = "", typos[256] = "";
+  struct
+  {
+    const char *name;
+    const char *pattern;
+  } cases[] = {
+    {"rule prefixes", prefix},
+    {"typo prefixes", typos},
+    {"one long word", "shhjajojushh"},
+    {"longest words", "shhjajojushhjajojushhjajojushhjajojushhjajojushhjajojushhjajoju "},
+    {"capitals", "SHHJAJOJU"},
+    {"ampersands", "&"},
+    {"entity, no ;", "&abcdefghijklmnopqrstuvwxyz0123456789"},
+    {"apostrophes", "&apos;"},
+    {"unclosed tag", "<"},
+    {"url prefixes", "ttp:w."},
+    {"url, no end", "http://"},
+    {"parentheses", "http://a) "},
+  };
+  struct detrans_ctx ctx = DETRANS_CTX_INIT;
+  double worst = 0, usual = 0;
+  const char *worst_name = "";
+  size_t i, j;
+  int mode;
+
+  for (i = 0; i < array_size (special); i++)
+    if (strlen (special[i]) > strlen (prefix) + 1
+        && strlen (special[i]) < sizeof (prefix))
+      {
+        strcpy (prefix, special[i]);
+        prefix[strlen (prefix) - 1] = '\0';
+      }
+
+  strcpy (typos, prefix);
+  typos[strlen (typos) - 1] = typos[strlen (typos) - 2] = 'q';
+  strcat (typos, " ");
+
+  for (mode = DETRANS_GREEDY; mode <= DETRANS_FUZZY; mode++)
+    {
+      double start = now ();
+
+      for (j = 0; j < ru_msgs.count; j++)
+        detrans_ctx_mode (&ctx, ru_msgs.s[j], strlen (ru_msgs.s[j]), mode);
+      usual = (now () - start) / strings_bytes (&ru_msgs);
+      printf ("adversarial: %-7s %-15s %8.2f ns/byte\n", mode_names[mode],
+              "usual messages", usual);
+
+      for (i = 0; i < array_size (cases); i++)
+        {
+          char *msg = repeat (cases[i].pattern, BENCH_ADVERSARIAL);
+          double t;
+          int rep;
+
+          detrans_ctx_mode (&ctx, msg, BENCH_ADVERSARIAL, mode);
+          start = now ();
+          for (rep = 0; rep < 10; rep++)
+            detrans_ctx_mode (&ctx, msg, BENCH_ADVERSARIAL, mode);
+          t = (now () - start) / 10 / BENCH_ADVERSARIAL;
+
+          printf ("adversarial: %-7s %-15s %8.2f ns/byte\n", mode_names[mode],
+                  cases[i].name, t);
+          if (t > worst)
+            worst = t, worst_name = cases[i].name;
+          free (msg);
+        }
+    }
+
+  printf ("adversarial: worst %s, %.2f ns/byte, %.2f ms for %zu Kb\n",
+          worst_name, worst, worst * DETRANS_MAX_INPUT / 1e6,
+          (size_t) DETRANS_MAX_INPUT / 1024);
+
+  detrans_ctx_free (&ctx);
+}
+
+
+static int
+cmp_double (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/* The utf-8 of the character CP, which is less than 0x10000, in S.
+   Returns the length.  */
+static size_t
+utf8_encode (uint32_t cp, char *s)
+{
+  if (cp < 0x80)
+    {
+      s[0] = cp;
+      return 1;
+    }
+  else if (cp < 0x800)
+    {
+      s[0] = 0xc0 | cp >> 6;
+      s[1] = 0x80 | (cp & 0x3f);
+      return 2;
+    }
+
+  s[0] = 0xe0 | cp >> 12;
+  s[1] = 0x80 | (cp >> 6 & 0x3f);
+  s[2] = 0x80 | (cp & 0x3f);
+  return 3;
+}
+
+/* Completion latency for every prefix of every dictionary word, one
+   keystroke at a time, as it happens while typing.  Loading reads the
+   file only.  The first lookup of every first letter queues its
+   partition to be built in the background, and is timed apart, as is
+   the build.  Every lookup is the best of 3.  */
+static void
+bench_complete ()
+{
+  char fname[1024];
+  struct complete *c;
+  struct complete_partition *parts;
+  const char *out[COMPLETE_TOP];
+  double start, *times, t, worst = 0;
+  size_t i, n = 0, max = 0, found = 0, nodes, bytes, parts_count;
+
+  snprintf (fname, sizeof (fname), "%s/ru-words.txt", misc_dir);
+  start = now ();
+  if ((c = complete_load (fname)) == NULL)
+    err (EXIT_FAILURE, "cannot open '%s'", fname);
+  t = now () - start;
+  complete_nodes (c, &bytes);
+  parts_count = complete_partitions (c, NULL, 0);
+  printf ("complete: load      %8.2f ms, %zu partitions, %.1f Mb\n",
+          t / 1e6, parts_count, bytes / 1048576.0);
+
+  parts = (struct complete_partition *)
+          malloc (parts_count * sizeof (struct complete_partition));
+  complete_partitions (c, parts, parts_count);
+  start = now ();
+  for (i = 0; i < parts_count; i++)
+    {
+      char s[3];
+
+      t = now ();
+      found += complete_lookup (c, s, utf8_encode (parts[i].first, s),
+                                out, 5) != 0;
+      t = now () - t;
+      if (t > worst)
+        worst = t;
+    }
+  printf ("complete: first lookups, %zu of %zu letters complete, "
+          "worst %.2f ns\n", found, parts_count, worst);
+  free (parts);
+
+  complete_wait (c);
+  t = now () - start;
+  nodes = complete_nodes (c, &bytes);
+  printf ("complete: built in the background %8.2f ms, "
+          "%zu nodes, %.1f Mb\n", t / 1e6, nodes, bytes / 1048576.0);
+
+  found = 0;
+  for (i = 0; i < ru_orig.count; i++)
+    max += strlen (ru_orig.s[i]);
+  times = (double *) malloc (max * sizeof (double));
+
+  for (i = 0; i < ru_orig.count; i++)
+    {
+      const char *w = ru_orig.s[i];
+      size_t len;
+
+      /* Russian letters are two bytes long.  */
+      for (len = 2; len <= strlen (w); len += 2)
+        {
+          size_t round;
+
+          /* The best of a few runs, to take the worst case of the
+             lookups rather than of the scheduler.  */
+          for (round = 0; round < 3; round++)
+            {
+              start = now ();
+              found += complete_lookup (c, w, len, out, 5);
+              t = now () - start;
+              if (round == 0 || t < times[n])
+                times[n] = t;
+            }
+          n++;
+        }
+    }
+
+  qsort (times, n, sizeof (double), cmp_double);
+  printf ("complete: %zu lookups, %.2f completions on average\n",
+          n, (double) found / 3 / n);
+  printf ("complete: worst     %8.2f ns\n", times[n - 1]);
+  printf ("complete: median    %8.2f ns\n", times[n / 2]);
+  printf ("complete: 99%%       %8.2f ns\n", times[n * 99 / 100]);
+  printf ("complete: 99.99%%    %8.2f ns\n", times[n * 9999 / 10000]);
+
+  free (times);
+  complete_free (c);
+}
+
+
+static const struct
+{
+  const char *name;
+  void (*run) ();
+} benchmarks[] = {
+  {"classify", bench_classify},
+  {"lattice", bench_lattice},
+  {"fuzzy", bench_fuzzy},
+  {"stats", bench_stats},
+  {"batch", bench_batch},
+  {"diacritics", bench_diacritics},
+  {"markup", bench_markup},
+  {"incremental", bench_incremental},
+  {"adversarial", bench_adversarial},
+  {"complete", bench_complete},
+  {"trie", bench_trie},
+  {"matcher", bench_matcher},
+  {"affix", bench_affix},
+};
+
+int
+main (int argc, char *argv[])
+{
+  size_t i;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "d:n:")) != -1)
+    switch (opt)
+      {
+      case 'd':
+        misc_dir = optarg;
+        break;
+      case 'n':
+        msgs_count = atol (optarg);
+        break;
+      default:
+        fprintf (stderr, "usage: %s [-d misc-dir] [-n messages] "
+                 "[benchmark ...]\n", argv[0]);
+        return EXIT_FAILURE;
+      }
+
+  srand (42);
+  detrans_init ();
+  load_words (&ru_words, &ru_orig, &ru_held, "ru-words.txt", true);
+  load_words (&en_words, NULL, &en_held, "en-words.txt", false);
+  make_messages (&ru_msgs, &ru_words, msgs_count);
+  make_messages (&en_msgs, &en_words, msgs_count);
+
+  for (i = 0; i < array_size (benchmarks); i++)
+    {
+      int j;
+      bool run = optind == argc;
+
+      for (j = optind; j < argc; j++)
+        run |= !strcmp (argv[j], benchmarks[i].name);
+
+      if (run)
+        benchmarks[i].run ();
+    }
+
+  strings_free (&ru_msgs);
+  strings_free (&en_msgs);
+  strings_free (&ru_words);
+  strings_free (&ru_orig);
+  strings_free (&en_words);
+  strings_free (&ru_held);
+  strings_free (&en_held);
+  detrans_free ();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,502 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+/* Differential fuzzing of detrans.  The same input is given to the
+   engine linked in (the candidate) and to the reference engine below,
+   which is the definition of the greedy de-transliteration written as
+   plainly as possible: no trie, all the rules are tried at every
+   position.  The first byte where the outputs differ is reported and
+   the program aborts, so that the fuzzers save the input.
+
+   The harness works in three ways:
+     -- with libFuzzer, build with -DDETRANS_LIBFUZZER -fsanitize=fuzzer;
+     -- with AFL, run `detrans-fuzz' without arguments, it reads stdin;
+     -- as a corpus runner, `detrans-fuzz file-or-dir ...' runs every file
+        and every prefix of it, which gives truncated utf-8 and markup for
+        free.  This is what `make fuzz' does on misc/fuzz.  */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <err.h>
+
+#include "detrans.h"
+
+struct ref_rule
+{
+  const char *tr;
+  const char *ru;
+};
+
+/* Exceptions and letters; a letter with the same key as an exception
+   replaces it.  */
+static const struct ref_rule ref_words[] = {
+#define INPUT(a, b) {a, b},
+#include "ru-special-words.def"
+#undef INPUT
+};
+
+static const struct ref_rule ref_letters[] = {
+#define INPUT(a, b) {a, b},
+#include "ru-replacement.def"
+#undef INPUT
+};
+
+/* Prefixes after which exceptions are looked up inside a word, up to
+   REF_MAX_ANCHOR bytes from its start.  */
+static const char *ref_anchors[] = {
+#define INPUT(a) a,
+#include "ru-anchors.def"
+#undef INPUT
+};
+
+#define REF_MAX_ANCHOR  64
+
+static const struct ref_rule ref_cap[] = {
+#define INPUT(a, b) {a, b},
+#include "ru-capital-letters.def"
+#undef INPUT
+};
+
+/* Capital and small latin letters of the rules.  */
+static const struct ref_rule ref_latin[] = {
+  {"Š", "š"}, {"Ž", "ž"}, {"Č", "č"}, {"Ŝ", "ŝ"}, {"Ë", "ë"}, {"È", "è"},
+  {"Û", "û"}, {"Â", "â"}, {"Ě", "ě"}
+};
+
+#define array_size(a) (sizeof (a) / sizeof ((a)[0]))
+
+
+static inline char
+ref_tolower (char c)
+{
+  return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+/* Letters, apostrophes and bytes of utf-8 make words.  */
+static inline bool
+ref_word_char (char c)
+{
+  c = ref_tolower (c);
+  return (c >= 'a' && c <= 'z') || c == '\'' || (unsigned char) c >= 0x80;
+}
+
+/* The capital latin letter with a diacritic at S, or NULL.  */
+static const struct ref_rule *
+ref_latin_capital (const char *s)
+{
+  size_t i;
+
+  for (i = 0; i < array_size (ref_latin); i++)
+    if (!strncmp (s, ref_latin[i].tr, strlen (ref_latin[i].tr)))
+      return &ref_latin[i];
+
+  return NULL;
+}
+
+static inline bool
+ref_isalnum (char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+         || (c >= '0' && c <= '9');
+}
+
+/* Length of the tag, entity or URL at S in the message starting at
+   BEGIN, or 0 if S is text.  */
+static size_t
+ref_markup (const char *begin, const char *s)
+{
+  size_t i, open = 0, close = 0;
+
+  if (*s == '<')
+    {
+      for (i = 1; s[i - 1] != '>' && s[i] != '\0'; i++)
+        ;
+      return i;
+    }
+
+  if (*s == '&')
+    {
+      for (i = 1; i <= 31 && s[i] != '\0'; i++)
+        if (s[i] == ';')
+          return i > 1 ? i + 1 : 0;
+        else if (!ref_isalnum (s[i]) && s[i] != '#')
+          return 0;
+      return 0;
+    }
+
+  if ((s > begin && ref_isalnum (s[-1]))
+      || (strncmp (s, "http://", 7) && strncmp (s, "https://", 8)
+          && strncmp (s, "www.", 4)))
+    return 0;
+
+  for (i = 0; s[i] != '\0' && !strchr (" \t\n\v\f\r<>\"", s[i]); i++)
+    {
+      open += s[i] == '(';
+      close += s[i] == ')';
+    }
+
+  /* Trailing punctuation and unbalanced parentheses are text.  */
+  for (; i > 0; i--)
+    if (s[i - 1] == ')' && close > open)
+      close--;
+    else if (!strchr (".,;:!?", s[i - 1]))
+      break;
+
+  return i;
+}
+
+/* Whether the key TR is at S within LEN bytes, in any case.  */
+static size_t
+ref_key (const char *s, size_t len, const char *tr)
+{
+  size_t j;
+
+  for (j = 0; tr[j] != '\0' && j < len && ref_tolower (s[j]) == tr[j]; j++)
+    ;
+
+  return tr[j] == '\0' ? j : 0;
+}
+
+/* The longest rule matching at S within LEN bytes, or NULL.  The
+   exceptions are tried if WORDS is set.  */
+static const struct ref_rule *
+ref_match (const char *s, size_t len, bool words, size_t *match)
+{
+  const struct ref_rule *best = NULL;
+  size_t i, j;
+
+  for (i = 0; words && i < array_size (ref_words); i++)
+    if ((j = ref_key (s, len, ref_words[i].tr)) != 0
+        && (best == NULL || j >= *match))
+      best = &ref_words[i], *match = j;
+
+  for (i = 0; i < array_size (ref_letters); i++)
+    if ((j = ref_key (s, len, ref_letters[i].tr)) != 0
+        && (best == NULL || j >= *match))
+      best = &ref_letters[i], *match = j;
+
+  return best;
+}
+
+static char *
+detrans_ref (const char *inp)
+{
+  char *tmp = (char *) malloc (strlen (inp) + 1), *t = tmp;
+  char *low = (char *) malloc (strlen (inp) + 1);
+  char *out = (char *) malloc (strlen (inp) * 10 + 1), *o = out;
+  bool *anchor = (bool *) calloc (strlen (inp) + 1, sizeof (bool));
+  const struct ref_rule *l;
+  const char *s, *word = NULL;
+
+  /* &apos; is an apostrophe, which is a letter in ISO-9.  */
+  for (s = inp; *s != '\0'; )
+    if (!strncmp (s, "&apos;", 6))
+      *t++ = '\'', s += 6;
+    else
+      *t++ = *s++;
+  *t = '\0';
+
+  /* Rules are matched in LOW, where the letters with diacritics are
+     small; the ASCII ones are left to ref_match.  */
+  strcpy (low, tmp);
+  for (s = tmp; *s != '\0'; s++)
+    if ((l = ref_latin_capital (s)) != NULL)
+      memcpy (low + (s - tmp), l->ru, strlen (l->ru));
+
+  for (s = tmp; *s != '\0'; )
+    {
+      const struct ref_rule *r;
+      size_t len = ref_markup (tmp, s), text, i;
+
+      /* Markup is copied as is.  */
+      if (len != 0)
+        {
+          memcpy (o, s, len);
+          o += len, s += len;
+          continue;
+        }
+
+      /* Rules match within the text up to the next markup.  */
+      for (text = 1; s[text] != '\0' && ref_markup (tmp, s + text) == 0; text++)
+        ;
+
+      for (; text > 0; )
+        {
+          bool words;
+
+          /* Exceptions start words, or follow the anchors at the start
+             of a word, which may follow each other.  */
+          if (s == tmp || !ref_word_char (s[-1]))
+            word = s, anchor[s - tmp] = true;
+          words = word != NULL && s - word < REF_MAX_ANCHOR
+                  && anchor[s - tmp];
+          for (i = 0; words && i < array_size (ref_anchors); i++)
+            if ((len = ref_key (s, text, ref_anchors[i])) != 0
+                && s + len - word < REF_MAX_ANCHOR)
+              anchor[s + len - tmp] = true;
+
+          if ((r = ref_match (low + (s - tmp), text, words, &len)) != NULL)
+            {
+              const char *ru = r->ru;
+
+              if ((*s >= 'A' && *s <= 'Z') || ref_latin_capital (s))
+                for (i = 0; i < array_size (ref_cap); i++)
+                  if (!strncmp (ru, ref_cap[i].tr, strlen (ref_cap[i].tr)))
+                    {
+                      o = stpcpy (o, ref_cap[i].ru);
+                      ru += strlen (ref_cap[i].tr);
+                      break;
+                    }
+
+              o = stpcpy (o, ru);
+              s += len, text -= len;
+            }
+          else
+            *o++ = *s++, text--;
+        }
+    }
+
+  *o = '\0';
+  free (anchor);
+  free (tmp);
+  free (low);
+  return out;
+}
+
+
+static void
+print_escaped (const char *name, const char *s)
+{
+  fprintf (stderr, "%s: \"", name);
+  for (; *s != '\0'; s++)
+    if (*s == '"' || *s == '\\')
+      fprintf (stderr, "\\%c", *s);
+    else if ((unsigned char) *s < 0x20 || (unsigned char) *s >= 0x7f)
+      fprintf (stderr, "\\x%02x", (unsigned char) *s);
+    else
+      fputc (*s, stderr);
+  fprintf (stderr, "\"\n");
+}
+
+/* The message S with the edits from DETRANS_EDITS applied.  */
+static char *
+apply_edits (const char *s)
+{
+  static struct detrans_edits e = DETRANS_EDITS_INIT;
+  size_t len = strlen (s), n = detrans_edits (&e, s, len), i, pos = 0;
+  char *out = (char *) malloc (len * 10 + 1), *o = out;
+
+  for (i = 0; i < n; i++)
+    {
+      if (e.edit[i].offset < pos || e.edit[i].offset + e.edit[i].len > len)
+        {
+          fprintf (stderr, "detrans-fuzz: edit %zu is out of order\n", i);
+          print_escaped ("input", s);
+          abort ();
+        }
+
+      o = mempcpy (o, s + pos, e.edit[i].offset - pos);
+      o = mempcpy (o, e.edit[i].repl, e.edit[i].repl_len);
+      pos = e.edit[i].offset + e.edit[i].len;
+    }
+
+  strcpy (o, s + pos);
+  return out;
+}
+
+/* Report the first difference between A and B, if any.  */
+static void
+compare (const char *s, const char *a_name, const char *a,
+         const char *b_name, const char *b)
+{
+  size_t i;
+
+  for (i = 0; a[i] == b[i] && b[i] != '\0'; i++)
+    ;
+
+  if (a[i] != b[i])
+    {
+      fprintf (stderr, "detrans-fuzz: outputs differ at byte %zu\n", i);
+      print_escaped ("input", s);
+      print_escaped (a_name, a);
+      print_escaped (b_name, b);
+      abort ();
+    }
+}
+
+/* Type S in MODE, first its half and then the rest, and then delete
+   a character in the middle: every update must give the same as the
+   de-transliteration of the whole message, FULL for S.  */
+static void
+check_update (char *s, enum detrans_mode mode, const char *full)
+{
+  static struct detrans_incr d = DETRANS_INCR_INIT;
+  size_t len = strlen (s);
+  char *cut, *ref;
+
+  detrans_update (&d, NULL, s, len / 2, mode);
+  compare (s, "update", detrans_update (&d, NULL, s, len, mode),
+           "candidate", full);
+
+  if (len == 0)
+    return;
+
+  cut = strdup (s);
+  memmove (cut + len / 2, cut + len / 2 + 1, len - len / 2);
+  ref = detrans (cut, len - 1);
+  compare (cut, "update", detrans_update (&d, NULL, cut, len - 1, mode),
+           "candidate", ref);
+  free (cut);
+  free (ref);
+}
+
+/* Run both engines on the string S, abort if they disagree.  The list
+   of edits must give the same result as well, and so must the updates
+   of a message typed and edited.  The fuzzy mode has no reference, but
+   its edits must agree with it, and the sanitizers watch its output
+   buffer.  */
+static void
+check (char *s)
+{
+  char *cand = detrans (s, strlen (s));
+  char *ref = detrans_ref (s);
+  char *edits = apply_edits (s);
+
+  compare (s, "candidate", cand, "reference", ref);
+  compare (s, "edits", edits, "candidate", cand);
+  check_update (s, DETRANS_GREEDY, cand);
+
+  free (cand);
+  free (edits);
+
+  detrans_set_mode (DETRANS_FUZZY);
+  cand = detrans (s, strlen (s));
+  edits = apply_edits (s);
+  compare (s, "fuzzy edits", edits, "fuzzy", cand);
+  check_update (s, DETRANS_FUZZY, cand);
+  detrans_set_mode (DETRANS_GREEDY);
+
+  free (cand);
+  free (ref);
+  free (edits);
+}
+
+static void
+fuzz_init ()
+{
+  static bool initialised = false;
+
+  if (!initialised)
+    {
+      detrans_init ();
+      detrans_set_mode (DETRANS_GREEDY);
+      initialised = true;
+    }
+}
+
+/* The inputs are bytes, detrans takes strings; everything after the
+   first zero is ignored.  */
+int
+LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+  char *s;
+
+  fuzz_init ();
+  s = strndup ((const char *) data, size);
+  check (s);
+  free (s);
+  return 0;
+}
+
+
+#ifndef DETRANS_LIBFUZZER
+static size_t runs;
+
+static void
+run_file (const char *name)
+{
+  FILE *f = fopen (name, "r");
+  char *buf = NULL;
+  size_t size = 0, len;
+
+  if (f == NULL)
+    err (EXIT_FAILURE, "cannot open '%s'", name);
+
+  if (getdelim (&buf, &size, '\0', f) == -1)
+    len = 0;
+  else
+    len = strlen (buf);
+  fclose (f);
+
+  for (; len > 0; len--, runs++)
+    LLVMFuzzerTestOneInput ((const uint8_t *) buf, len);
+
+  free (buf);
+}
+
+static void
+run_path (const char *name)
+{
+  DIR *d = opendir (name);
+  struct dirent *e;
+
+  if (d == NULL)
+    {
+      run_file (name);
+      return;
+    }
+
+  while ((e = readdir (d)) != NULL)
+    if (e->d_name[0] != '.')
+      {
+        char path[4096];
+
+        snprintf (path, sizeof (path), "%s/%s", name, e->d_name);
+        run_path (path);
+      }
+
+  closedir (d);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int i;
+
+  fuzz_init ();
+  if (argc < 2)
+    {
+      char *buf = NULL;
+      size_t size = 0;
+      ssize_t len = getdelim (&buf, &size, '\0', stdin);
+
+      if (len > 0)
+        LLVMFuzzerTestOneInput ((const uint8_t *) buf, len);
+      free (buf);
+    }
+  else
+    {
+      for (i = 1; i < argc; i++)
+        run_path (argv[i]);
+      printf ("detrans-fuzz: %zu inputs, no differences\n", runs);
+    }
+
+  detrans_free ();
+  return EXIT_SUCCESS;
+}
+#endif
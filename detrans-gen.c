@@ -0,0 +1,175 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+/* Matcher generator.  The rules of russian are known at build time, so
+   instead of walking the trie the engine can match them with code: for
+   every table this prints a function with a switch per byte of the key,
+   nested along the common prefixes, which remembers the longest key seen
+   so far, as re2c would do.  The output is ru-matcher.def, included by
+   detrans.c when built with `make MATCHER=compiled'.
+
+   The functions return the length of the longest key at S (0 if none),
+   with the letters of S in any case, and its index in the table of keys
+   printed with them; detrans.c maps the indices to its rules once the
+   trie is built.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+struct key
+{
+  const char *key;
+  size_t len;
+  size_t index;
+};
+
+static struct key ru_letters[] = {
+#define INPUT(a, b) {a, sizeof (a) - 1, 0},
+#include "ru-replacement.def"
+#undef INPUT
+};
+
+static struct key ru_words[] = {
+#define INPUT(a, b) {a, sizeof (a) - 1, 0},
+#include "ru-special-words.def"
+#undef INPUT
+};
+
+#define array_size(a) (sizeof (a) / sizeof ((a)[0]))
+
+
+/* Helper for qsort: keys in byte order, a key before the longer keys
+   it starts, and the same keys in the order of the table.  */
+static int
+cmp_keys (const void *k1, const void *k2)
+{
+  const struct key *a = (const struct key *) k1;
+  const struct key *b = (const struct key *) k2;
+  int c = memcmp (a->key, b->key, a->len < b->len ? a->len : b->len);
+
+  if (c != 0)
+    return c;
+  if (a->len != b->len)
+    return a->len < b->len ? -1 : 1;
+  return a->index < b->index ? -1 : a->index > b->index;
+}
+
+/* Print the byte C as a C constant.  */
+static void
+print_byte (unsigned char c)
+{
+  if (c == '\'' || c == '\\')
+    printf ("'\\%c'", c);
+  else if (c >= 0x20 && c < 0x7f)
+    printf ("'%c'", c);
+  else
+    printf ("0x%02x", c);
+}
+
+/* Print the code matching the sorted KEYS of length N after their
+   common prefix of length DEPTH, indented by INDENT.  Of the same keys
+   the last one in the table wins, as in the trie.  */
+static void
+print_switch (const struct key *keys, size_t n, size_t depth, int indent)
+{
+  size_t i, j, k;
+
+  /* One key left: compare the rest of it at once.  */
+  if (keys[n - 1].len == keys[0].len
+      && !memcmp (keys[0].key, keys[n - 1].key, keys[0].len))
+    {
+      printf ("%*sif (len >= %zu", indent, "", keys[0].len);
+      for (i = depth; i < keys[0].len; i++)
+        {
+          printf ("\n%*s    && ascii_lower (s[%zu]) == ", indent, "", i);
+          print_byte (keys[0].key[i]);
+        }
+      printf (")\n%*s  match = %zu, *index = %zu;\n", indent, "",
+              keys[0].len, keys[n - 1].index);
+      return;
+    }
+
+  printf ("%*sif (len > %zu)\n", indent, "", depth);
+  printf ("%*s  switch (ascii_lower (s[%zu]))\n", indent, "", depth);
+  printf ("%*s    {\n", indent, "");
+  for (i = 0; i < n; i = j)
+    {
+      unsigned char c = keys[i].key[depth];
+
+      for (j = i; j < n && (unsigned char) keys[j].key[depth] == c; j++)
+        ;
+      /* The keys ending with C come first.  */
+      for (k = i; k < j && keys[k].len == depth + 1; k++)
+        ;
+
+      printf ("%*s    case ", indent, "");
+      print_byte (c);
+      printf (":\n");
+      if (k > i)
+        printf ("%*s      match = %zu, *index = %zu;\n", indent, "",
+                depth + 1, keys[k - 1].index);
+      if (k < j)
+        print_switch (keys + k, j - k, depth + 1, indent + 6);
+      printf ("%*s      break;\n", indent, "");
+    }
+  printf ("%*s    }\n", indent, "");
+}
+
+/* Print the table NAME_keys of KEYS of length N, and the function
+   NAME_match matching them.  MACRO is NAME in capitals.  */
+static void
+print_matcher (const char *name, const char *macro, struct key *keys,
+               size_t n)
+{
+  size_t i, j;
+
+  printf ("#define %s_COUNT %zu\n\n", macro, n);
+  printf ("static const char *const %s_keys[%s_COUNT] = {\n", name, macro);
+  for (i = 0; i < n; i++)
+    {
+      keys[i].index = i;
+      printf ("  \"");
+      for (j = 0; j < keys[i].len; j++)
+        if (keys[i].key[j] == '"' || keys[i].key[j] == '\\')
+          printf ("\\%c", keys[i].key[j]);
+        else
+          putchar (keys[i].key[j]);
+      printf ("\",\n");
+    }
+  printf ("};\n\n");
+
+  qsort (keys, n, sizeof (struct key), cmp_keys);
+
+  printf ("static inline size_t\n");
+  printf ("%s_match (const char *s, size_t len, size_t *index)\n", name);
+  printf ("{\n");
+  printf ("  size_t match = 0;\n\n");
+  print_switch (keys, n, 0, 2);
+  printf ("\n  return match;\n");
+  printf ("}\n\n");
+}
+
+int
+main (void)
+{
+  printf ("/* Generated by detrans-gen from ru-replacement.def and\n"
+          "   ru-special-words.def, do not edit.  */\n\n");
+  print_matcher ("ru_letters", "RU_LETTERS", ru_letters,
+                 array_size (ru_letters));
+  print_matcher ("ru_words", "RU_WORDS", ru_words, array_size (ru_words));
+
+  return fflush (stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,650 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+/* Exception miner.  The tool reads a dictionary of russian words (one
+   word per line, like misc/ru-words.txt), transliterates every word
+   using ru-translit.def, and runs the de-transliteration engine over
+   the result using only the ISO-9 rules from ru-replacement.def.  Every
+   word that does not come back as the original gets an exception, which
+   is collapsed to the shortest prefix that fixes the word and keeps all
+   the other words of the dictionary correct.  The words are decoded by
+   DETRANS_WITH_TRIE, which matches the exceptions the way the engine
+   does: at the start of a word and after the prefixes of ru-anchors.def
+   only.  The resulting minimal set
+   of rules is printed on stdout in the format of ru-special-words.def.
+
+   All the heavy lifting is done in parallel: each worker thread owns a
+   copy of the trie, so candidate rules can be added and removed without
+   any locking.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <err.h>
+
+#include "detrans.h"
+#include "trie.h"
+
+/* Maximum number of rounds of the mining.  Normally it converges in
+   two or three rounds, as rules interact very rarely.  */
+#define MINE_ROUNDS     16
+
+struct symbol
+{
+  const char *str;
+  const char *repl;
+};
+
+/* Russian letter to translit, see ru-translit.def.  */
+static const struct symbol ru_translit[] = {
+#define INPUT(a, b) {b, a},
+#include "ru-translit.def"
+#undef INPUT
+};
+
+/* Capital russian letter to the small one.  */
+static const struct symbol ru_small[] = {
+#define INPUT(a, b) {b, a},
+#include "ru-capital-letters.def"
+#undef INPUT
+};
+
+/* The ISO-9 rules the exceptions are mined against.  */
+static const struct symbol ru_letters[] = {
+#define INPUT(a, b) {a, b},
+#include "ru-replacement.def"
+#undef INPUT
+};
+
+#define array_size(a) (sizeof (a) / sizeof ((a)[0]))
+
+
+/* A word of the dictionary.  TB[i] and RB[i] are the offsets of the
+   I-th letter in TR and RU respectively; TB[N] and RB[N] are the
+   lengths of the strings.  */
+struct word
+{
+  char *ru;
+  char *tr;
+  unsigned short *tb;
+  unsigned short *rb;
+  unsigned n;
+
+  /* Word is decoded correctly with the current set of rules.  */
+  bool ok;
+  /* No prefix could fix the word, don't try it again.  */
+  bool unresolved;
+  /* Number of letters in the prefix found for the failing word,
+     or zero if nothing was found.  */
+  unsigned cand;
+};
+
+/* A mined exception.  */
+struct rule
+{
+  char *tr;
+  struct detrans_rule ru;
+  bool removed;
+};
+
+static struct word *words = NULL;
+static size_t words_count = 0;
+
+/* All the transliterated words separated with '\n', so that we can
+   find the words containing a certain string with one memmem.  */
+static char *corpus = NULL;
+static size_t corpus_len = 0;
+static size_t *corpus_off = NULL;
+
+static struct rule *rules = NULL;
+static size_t rules_count = 0, rules_size = 32;
+
+/* Replacements of RU_LETTERS attached to the tries.  */
+static struct detrans_rule letter_rules[array_size (ru_letters)];
+
+/* Per-thread state.  */
+struct worker
+{
+  pthread_t tid;
+  struct trie *trie;
+  void (*fn) (struct worker *, size_t);
+};
+
+static struct worker *workers = NULL;
+static long workers_count = 1;
+static size_t next_item, items_count;
+static bool verbose = false;
+
+
+/* Find the russian letter in table TAB of size N at the beginning of S.  */
+static const struct symbol *
+find_letter (const struct symbol *tab, size_t n, const char *s)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    if (!strncmp (s, tab[i].str, strlen (tab[i].str)))
+      return &tab[i];
+
+  return NULL;
+}
+
+/* Fill W from a russian word RU.  Returns false if the word contains
+   something that we cannot transliterate.  */
+static bool
+make_word (struct word *w, const char *ru)
+{
+  size_t len = strlen (ru), n = 0, tlen = 0;
+  char lower[len + 1], *l = lower;
+  const char *s;
+
+  /* Lowercase the word and count the letters.  */
+  for (s = ru; *s != '\0'; )
+    {
+      const struct symbol *c = find_letter (ru_small, array_size (ru_small), s);
+      const char *x = c ? c->repl : s;
+      const struct symbol *t
+        = find_letter (ru_translit, array_size (ru_translit), x);
+
+      if (!t)
+        return false;
+
+      memcpy (l, t->str, strlen (t->str));
+      l += strlen (t->str);
+      s += strlen (t->str);
+      tlen += strlen (t->repl);
+      n++;
+    }
+  *l = '\0';
+
+  if (n == 0 || tlen >= 0xffff)
+    return false;
+
+  w->ru = strdup (lower);
+  w->tr = (char *) malloc (tlen + 1);
+  w->tb = (unsigned short *) malloc (2 * (n + 1) * sizeof (unsigned short));
+  w->rb = w->tb + n + 1;
+  w->n = n;
+  w->ok = w->unresolved = false;
+  w->cand = 0;
+
+  n = tlen = 0;
+  for (s = w->ru; *s != '\0'; n++)
+    {
+      const struct symbol *t
+        = find_letter (ru_translit, array_size (ru_translit), s);
+
+      w->tb[n] = tlen;
+      w->rb[n] = s - w->ru;
+      memcpy (w->tr + tlen, t->repl, strlen (t->repl));
+      tlen += strlen (t->repl);
+      s += strlen (t->str);
+    }
+
+  w->tb[n] = tlen;
+  w->rb[n] = s - w->ru;
+  w->tr[tlen] = '\0';
+  return true;
+}
+
+static int
+cmp_words (const void *k1, const void *k2)
+{
+  const struct word *w1 = (const struct word *) k1;
+  const struct word *w2 = (const struct word *) k2;
+  return strcmp (w1->tr, w2->tr);
+}
+
+static void
+free_word (struct word *w)
+{
+  free (w->ru);
+  free (w->tr);
+  free (w->tb);
+}
+
+/* Read the dictionary from FNAME, transliterate it, sort it and
+   remove the duplicates.  Build the corpus.  */
+static void
+load_dictionary (const char *fname)
+{
+  FILE *f = fopen (fname, "r");
+  size_t size = 1024, skipped = 0, i, j;
+  char *line = NULL;
+  size_t line_size = 0;
+  ssize_t len;
+
+  if (f == NULL)
+    err (EXIT_FAILURE, "cannot open '%s'", fname);
+
+  words = (struct word *) malloc (size * sizeof (struct word));
+  while ((len = getline (&line, &line_size, f)) != -1)
+    {
+      while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        line[--len] = '\0';
+
+      if (len == 0)
+        continue;
+
+      if (words_count == size)
+        {
+          size *= 2;
+          words = (struct word *) realloc (words, size * sizeof (struct word));
+        }
+
+      if (make_word (&words[words_count], line))
+        words_count++;
+      else
+        skipped++;
+    }
+
+  free (line);
+  fclose (f);
+
+  qsort (words, words_count, sizeof (struct word), cmp_words);
+  for (i = j = 0; i < words_count; i++)
+    if (j > 0 && !strcmp (words[j - 1].tr, words[i].tr))
+      {
+        /* Two words with the same transliteration, the rules cannot
+           make both of them right, so keep the first one.  */
+        free_word (&words[i]);
+        skipped++;
+      }
+    else
+      words[j++] = words[i];
+  words_count = j;
+
+  corpus_off = (size_t *) malloc ((words_count + 1) * sizeof (size_t));
+  for (i = 0; i < words_count; i++)
+    {
+      corpus_off[i] = corpus_len;
+      corpus_len += words[i].tb[words[i].n] + 1;
+    }
+  corpus_off[words_count] = corpus_len;
+
+  corpus = (char *) malloc (corpus_len + 1);
+  for (i = 0; i < words_count; i++)
+    {
+      memcpy (corpus + corpus_off[i], words[i].tr, words[i].tb[words[i].n]);
+      corpus[corpus_off[i + 1] - 1] = '\n';
+    }
+  corpus[corpus_len] = '\0';
+
+  if (verbose)
+    fprintf (stderr, "%zu words loaded, %zu skipped\n", words_count, skipped);
+}
+
+/* Index of the word at the offset POS of the corpus.  */
+static size_t
+corpus_word (size_t pos)
+{
+  size_t lo = 0, hi = words_count;
+
+  while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (corpus_off[mid] <= pos)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+
+/* Build a trie with the ISO-9 rules and all the rules mined so far.  */
+static struct trie *
+build_trie ()
+{
+  struct trie *trie = trie_new ();
+  size_t i;
+
+  for (i = 0; i < array_size (ru_letters); i++)
+    trie_add_word (trie, ru_letters[i].str, strlen (ru_letters[i].str),
+                   (ssize_t) &letter_rules[i]);
+
+  for (i = 0; i < rules_count; i++)
+    if (!rules[i].removed)
+      trie_add_word (trie, rules[i].tr, strlen (rules[i].tr),
+                     (ssize_t) &rules[i].ru);
+
+  return trie;
+}
+
+static bool
+word_correct (struct trie *trie, struct word *w)
+{
+  char *out = detrans_with_trie (trie, w->tr, strlen (w->tr));
+  bool ret = !strcmp (out, w->ru);
+
+  free (out);
+  return ret;
+}
+
+/* Check that all the words containing P of length LEN, which are
+   currently correct, are still correct with TRIE.  */
+static bool
+others_correct (struct trie *trie, const char *p, size_t len)
+{
+  const char *c = corpus, *end = corpus + corpus_len, *hit;
+
+  while ((hit = (const char *) memmem (c, end - c, p, len)) != NULL)
+    {
+      size_t w = corpus_word (hit - corpus);
+
+      if (words[w].ok && !word_correct (trie, &words[w]))
+        return false;
+
+      c = corpus + corpus_off[w + 1];
+    }
+
+  return true;
+}
+
+/* Try to fix W with the rule made of its prefix of K letters.  */
+static bool
+try_prefix (struct trie *trie, struct word *w, unsigned k)
+{
+  size_t len = w->tb[k];
+  struct detrans_rule ru;
+  bool ok;
+
+  /* We never override existing rules.  */
+  if (trie_search (trie, w->tr, len) != TRIE_NOT_LAST)
+    return false;
+
+  ru = (struct detrans_rule) {.repl = w->ru, .repl_len = w->rb[k],
+                              .kind = DETRANS_RULE_WORD};
+  trie_add_word (trie, w->tr, len, (ssize_t) &ru);
+
+  ok = word_correct (trie, w) && others_correct (trie, w->tr, len);
+
+  /* Trie doesn't support removing of words, but marking the node
+     as not last makes the rule invisible for the matching.  */
+  trie_add_word (trie, w->tr, len, TRIE_NOT_LAST);
+  return ok;
+}
+
+
+static void
+check_word (struct worker *self, size_t i)
+{
+  words[i].ok = word_correct (self->trie, &words[i]);
+}
+
+static void
+find_prefix (struct worker *self, size_t i)
+{
+  struct word *w = &words[i];
+  unsigned k;
+
+  w->cand = 0;
+  if (w->ok || w->unresolved)
+    return;
+
+  for (k = 1; k <= w->n; k++)
+    if (try_prefix (self->trie, w, k))
+      {
+        w->cand = k;
+        return;
+      }
+}
+
+static void *
+worker_main (void *arg)
+{
+  struct worker *self = (struct worker *) arg;
+  size_t i;
+
+  while ((i = __sync_fetch_and_add (&next_item, 1)) < items_count)
+    self->fn (self, i);
+
+  return NULL;
+}
+
+/* Run FN on every word in parallel.  */
+static void
+run_parallel (void (*fn) (struct worker *, size_t))
+{
+  long i;
+
+  next_item = 0;
+  items_count = words_count;
+
+  for (i = 0; i < workers_count; i++)
+    {
+      workers[i].fn = fn;
+      if (pthread_create (&workers[i].tid, NULL, worker_main, &workers[i]))
+        errx (EXIT_FAILURE, "cannot create a thread");
+    }
+
+  for (i = 0; i < workers_count; i++)
+    pthread_join (workers[i].tid, NULL);
+}
+
+static void
+rebuild_tries ()
+{
+  long i;
+
+  for (i = 0; i < workers_count; i++)
+    {
+      trie_free (workers[i].trie);
+      workers[i].trie = build_trie ();
+    }
+}
+
+static void
+add_rule (char *tr, const char *ru)
+{
+  if (rules == NULL)
+    rules = (struct rule *) malloc (rules_size * sizeof (struct rule));
+
+  if (rules_count == rules_size)
+    {
+      rules_size *= 2;
+      rules = (struct rule *) realloc (rules, rules_size * sizeof (struct rule));
+    }
+
+  rules[rules_count++] = (struct rule)
+                         {
+                           .tr = tr,
+                           .ru = {.repl = ru, .repl_len = strlen (ru),
+                                  .kind = DETRANS_RULE_WORD},
+                           .removed = false
+                         };
+}
+
+static int
+cmp_rules (const void *k1, const void *k2)
+{
+  const struct rule *r1 = (const struct rule *) k1;
+  const struct rule *r2 = (const struct rule *) k2;
+  return strcmp (r1->tr, r2->tr);
+}
+
+/* Turn the prefixes found in this round into rules.  Returns the
+   number of new rules.  */
+static size_t
+collect_rules ()
+{
+  size_t i, start = rules_count;
+
+  for (i = 0; i < words_count; i++)
+    {
+      struct word *w = &words[i];
+      size_t j;
+
+      if (w->ok || w->unresolved)
+        continue;
+
+      if (w->cand == 0)
+        {
+          w->unresolved = true;
+          continue;
+        }
+
+      /* Several words may ask for the same prefix.  If they disagree on
+         the replacement, the losers will find a longer one in the next
+         round.  */
+      for (j = start; j < rules_count; j++)
+        if (strlen (rules[j].tr) == w->tb[w->cand]
+            && !strncmp (rules[j].tr, w->tr, w->tb[w->cand]))
+          break;
+
+      if (j == rules_count)
+        add_rule (strndup (w->tr, w->tb[w->cand]),
+                  strndup (w->ru, w->rb[w->cand]));
+    }
+
+  return rules_count - start;
+}
+
+/* Remove the rules that are not needed any more, as longer rules
+   mined in the later rounds took over their words.  */
+static size_t
+prune_rules ()
+{
+  struct trie *trie = workers[0].trie;
+  size_t i, removed = 0;
+
+  for (i = rules_count; i-- > 0; )
+    {
+      size_t len = strlen (rules[i].tr);
+
+      trie_add_word (trie, rules[i].tr, len, TRIE_NOT_LAST);
+      if (others_correct (trie, rules[i].tr, len))
+        {
+          rules[i].removed = true;
+          removed++;
+        }
+      else
+        trie_add_word (trie, rules[i].tr, len, (ssize_t) &rules[i].ru);
+    }
+
+  return removed;
+}
+
+
+static void
+usage (const char *name)
+{
+  fprintf (stderr, "usage: %s [-v] [-j threads] <dictionary>\n", name);
+  exit (EXIT_FAILURE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t i, failed = 0, unresolved = 0;
+  int round, opt;
+
+  workers_count = sysconf (_SC_NPROCESSORS_ONLN);
+  while ((opt = getopt (argc, argv, "vj:")) != -1)
+    switch (opt)
+      {
+      case 'v':
+        verbose = true;
+        break;
+      case 'j':
+        workers_count = atol (optarg);
+        break;
+      default:
+        usage (argv[0]);
+      }
+
+  if (optind != argc - 1)
+    usage (argv[0]);
+
+  if (workers_count < 1)
+    workers_count = 1;
+
+  for (i = 0; i < array_size (ru_letters); i++)
+    letter_rules[i] = (struct detrans_rule)
+                      {
+                        .repl = ru_letters[i].repl,
+                        .repl_len = strlen (ru_letters[i].repl),
+                        .kind = DETRANS_RULE_LETTER
+                      };
+
+  detrans_init ();
+  load_dictionary (argv[optind]);
+
+  workers = (struct worker *) calloc (workers_count, sizeof (struct worker));
+  for (round = 0; round < MINE_ROUNDS; round++)
+    {
+      size_t added;
+
+      rebuild_tries ();
+      run_parallel (check_word);
+
+      for (i = failed = 0; i < words_count; i++)
+        failed += !words[i].ok && !words[i].unresolved;
+
+      if (verbose)
+        fprintf (stderr, "round %d: %zu words fail\n", round, failed);
+
+      if (failed == 0)
+        break;
+
+      run_parallel (find_prefix);
+      added = collect_rules ();
+
+      if (verbose)
+        fprintf (stderr, "round %d: %zu rules added\n", round, added);
+    }
+
+  rebuild_tries ();
+  run_parallel (check_word);
+  i = prune_rules ();
+  if (verbose)
+    fprintf (stderr, "%zu rules pruned\n", i);
+
+  for (i = 0; i < words_count; i++)
+    if (!words[i].ok)
+      {
+        unresolved++;
+        if (verbose)
+          fprintf (stderr, "unresolved: %s\t%s\n", words[i].ru, words[i].tr);
+      }
+
+  /* The tries point into RULES.  */
+  for (i = 0; i < (size_t) workers_count; i++)
+    trie_free (workers[i].trie);
+  free (workers);
+
+  qsort (rules, rules_count, sizeof (struct rule), cmp_rules);
+  printf ("/* Generated by detrans-mine from %s: %zu words, "
+          "%zu unresolved.  */\n\n", argv[optind], words_count, unresolved);
+  for (i = 0; i < rules_count; i++)
+    if (!rules[i].removed)
+      printf ("INPUT (\"%s\",\t\"%s\")\n", rules[i].tr, rules[i].ru.repl);
+
+  for (i = 0; i < rules_count; i++)
+    free (rules[i].tr), free ((char *) rules[i].ru.repl);
+  free (rules);
+
+  for (i = 0; i < words_count; i++)
+    free_word (&words[i]);
+  free (words);
+  free (corpus);
+  free (corpus_off);
+
+  detrans_free ();
+  return EXIT_SUCCESS;
+}
@@ -16,11 +16,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <ctype.h>
 #include <stdio.h>
 
 #include "detrans.h"
 #include "trie.h"
+#include "lattice.h"
+#include "fuzzy.h"
+#include "stats.h"
+#include "span.h"
+#include "rules.h"
+#include "utf8.h"
+#include "letters.h"
+#include "affix.h"
+#include "probes.h"
 
 /* A structure to static replacements.  Used to store
    correspondence between russian small and capital
@@ -37,16 +45,41 @@ struct symbol
    word/letter and russian word.  */
 static struct trie *detrans_trie = NULL;
 
+/* Keys of the russian special words only, split into stems and
+   suffixes, with the numbers of their rules in DETRANS_RULES as values.
+   Exceptions are words, so they are looked up at the starts of words
+   only; the DETRANS_FUZZY mode looks up the typos in them.  */
+static struct affix detrans_words = AFFIX_INIT;
 
-/* List of russian words, attached to the DETRANS_TRIE.  We
+/* Prefixes of ru-anchors.def, after which the exceptions are looked up
+   as at the start of a word.  */
+static struct trie *detrans_anchors = NULL;
+
+/* Anchors further than that from the start of the word are ignored.  */
+#define DETRANS_MAX_ANCHOR      64
+
+
+/* List of rules, attached to the DETRANS_TRIE.  We
    allocate it in a separate array, as trie doesn't know that
    we keep pointers as an attached info, so it wouldn't free it.
    XXX We can teach trie free-ing function of course, but
        that is a lazy variant.  */
-static char **detrans_words = NULL;
+static struct detrans_rule **detrans_rules = NULL;
 static size_t detrans_size = 32, detrans_pos = 0;
 
 
+/* How words are decoded, see DETRANS_MODE.  */
+static enum detrans_mode detrans_mode = DETRANS_GREEDY;
+
+
+/* Longer messages are passed through as they are.  */
+static size_t detrans_max_input = DETRANS_MAX_INPUT;
+
+/* Most bytes of output per byte of input with the default rules, see
+   RULES_GROWTH.  */
+static size_t detrans_growth = 1;
+
+
 /* Match small and capital russian letters.
    In order to minimize a number of words in the trie, we will do
    comparison in lowercase.  However, after a word/letter is
@@ -63,69 +96,215 @@ static const struct symbol ru_cap[] = {
 #undef INPUT
 };
 
-/* Legth of RU_CAP.  */
-static size_t ru_cap_length = sizeof (ru_cap) / sizeof (struct symbol);
+static const struct symbol uk_cap[] = {
+#define INPUT(a, b) {a, b},
+#include "uk-capital-letters.def"
+#undef INPUT
+};
+
+static const struct symbol be_cap[] = {
+#define INPUT(a, b) {a, b},
+#include "be-capital-letters.def"
+#undef INPUT
+};
+
+static const struct symbol bg_cap[] = {
+#define INPUT(a, b) {a, b},
+#include "bg-capital-letters.def"
+#undef INPUT
+};
+
+#define symbols_length(s) (sizeof (s) / sizeof (struct symbol))
 
 /* Length of one russian leetter in bytes.
-   XXX We assume that all the russian letters have the same length,
-       it is true in utf-8.  If it doesn't hold on your system,
-       please adjust the binary search on RU_CAP.  */
-static size_t ru_cap_str_length;
+   XXX We assume that all the letters have the same length,
+       it is true in utf-8 for all the languages below.  If it
+       doesn't hold on your system, please adjust the binary
+       search on the capital letters.  */
+static size_t cap_str_length;
 
 
-/* Add a word to the DETRANS table, and expand it if needed.  */
-static char *
-add_special_word (const char *word)
+/* A language with its own rules, see DETRANS_LANG.  */
+struct detrans_lang
 {
-  char *ret = NULL;
+  const char *name;
+  /* Index of the rules of the language in the leaves of DETRANS_TRIE,
+     see rules.h.  */
+  int index;
+  /* Small and capital letters, sorted by the small ones.  */
+  const struct symbol *cap;
+  size_t cap_length;
+  /* Whether the lattice model knows the language.  */
+  bool lattice;
+};
+
+enum
+{
+  LANG_RU,
+  LANG_UK,
+  LANG_BE,
+  LANG_BG,
+  LANGS
+};
+
+static const struct detrans_lang detrans_langs[LANGS] = {
+  [LANG_RU] = {"ru", LANG_RU, ru_cap, symbols_length (ru_cap), true},
+  [LANG_UK] = {"uk", LANG_UK, uk_cap, symbols_length (uk_cap), false},
+  [LANG_BE] = {"be", LANG_BE, be_cap, symbols_length (be_cap), false},
+  [LANG_BG] = {"bg", LANG_BG, bg_cap, symbols_length (bg_cap), false},
+};
+
+/* Tries given to DETRANS_WITH_TRIE have russian rules, one in a leaf.  */
+static const struct detrans_lang plain_lang
+  = {"ru", RULES_PLAIN, ru_cap, symbols_length (ru_cap), true};
+
+/* Whether LANG has exceptions, which are russian.  */
+#define lang_has_words(lang) \
+  ((lang) == &detrans_langs[LANG_RU] || (lang) == &plain_lang)
+
+/* Letter rules of every language, which are looked up inside words
+   instead of DETRANS_TRIE.  */
+static struct letters detrans_letters[LANGS];
+
+#ifdef DETRANS_COMPILED_MATCHER
+/* Matchers of the russian letters and exceptions generated by
+   detrans-gen, see ru-matcher.def, and the rules of their keys.  */
+#include "ru-matcher.def"
+static const struct detrans_rule *ru_letters_rules[RU_LETTERS_COUNT];
+static const struct detrans_rule *ru_words_rules[RU_WORDS_COUNT];
+#endif
+
+/* Leaves of DETRANS_TRIE, arrays of LANGS rules, kept to free them.  */
+static const struct detrans_rule ***detrans_leaves = NULL;
+static size_t detrans_leaves_size = 32, detrans_leaves_pos = 0;
+
+
+/* Add a rule to the DETRANS table, and expand it if needed.  The
+   languages share the replacements: if the same rule is there already,
+   it is returned.  */
+static struct detrans_rule *
+add_rule (const char *repl, enum detrans_rule_kind kind)
+{
+  struct detrans_rule *ret = NULL;
+  size_t i;
+
+  for (i = 0; i < detrans_pos; i++)
+    if (detrans_rules[i]->kind == kind && !strcmp (detrans_rules[i]->repl, repl))
+      return detrans_rules[i];
 
-  if (detrans_words == NULL)
-    detrans_words = (char **) malloc (sizeof (char *) * detrans_size);
+  if (detrans_rules == NULL)
+    detrans_rules = (struct detrans_rule **)
+                    malloc (sizeof (struct detrans_rule *) * detrans_size);
 
   if (detrans_pos == detrans_size - 1)
     {
       detrans_size *= 2;
-      detrans_words =
-	(char **) realloc (detrans_words, sizeof (char *) * detrans_size);
+      detrans_rules = (struct detrans_rule **)
+	realloc (detrans_rules, sizeof (struct detrans_rule *) * detrans_size);
     }
 
-  ret = strdup (word);
-  detrans_words[detrans_pos++] = ret;
+  ret = (struct detrans_rule *) malloc (sizeof (struct detrans_rule));
+  ret->repl = repl;
+  ret->repl_len = strlen (repl);
+  ret->kind = kind;
+  detrans_rules[detrans_pos++] = ret;
   return ret;
 }
 
+/* Number of RULE in DETRANS_RULES.  */
+static uint32_t
+rule_number (const struct detrans_rule *rule)
+{
+  uint32_t i;
 
-/* A helper function that coppies from INP to OUT until
-   either it meets STOP character, or INP is exhausted.  */
-static inline size_t
-copy_until_character (char *inp, char *out, char stop)
+  for (i = 0; detrans_rules[i] != rule; i++)
+    ;
+
+  return i;
+}
+
+/* Attach the rule KEY -> REPL of the language LANG to DETRANS_TRIE.
+   All the languages share one leaf for a key; a later rule with the
+   same key replaces the earlier one.  */
+static void
+add_key (int lang, const char *key, const char *repl,
+         enum detrans_rule_kind kind)
 {
-  size_t len = 0;
-  char *cpy = inp;
+  size_t len = strlen (key);
+  ssize_t leaf = trie_search (detrans_trie, key, len);
+  const struct detrans_rule **rules = (const struct detrans_rule **) leaf;
 
-  while (*inp != stop && *inp != '\0')
-    inp++;
+  if (leaf == TRIE_NOT_LAST)
+    {
+      if (detrans_leaves == NULL)
+        detrans_leaves = (const struct detrans_rule ***)
+                         malloc (sizeof (*detrans_leaves) * detrans_leaves_size);
+
+      if (detrans_leaves_pos == detrans_leaves_size)
+        {
+          detrans_leaves_size *= 2;
+          detrans_leaves = (const struct detrans_rule ***)
+            realloc (detrans_leaves,
+                     sizeof (*detrans_leaves) * detrans_leaves_size);
+        }
+
+      rules = (const struct detrans_rule **) calloc (LANGS, sizeof (*rules));
+      detrans_leaves[detrans_leaves_pos++] = rules;
+      trie_add_word (detrans_trie, key, len, (ssize_t) rules);
+    }
 
-  len = inp - cpy + 1;
-  memcpy (out, cpy, len);
-  return len;
+  rules[lang] = add_rule (repl, kind);
+  if (kind == DETRANS_RULE_LETTER)
+    letters_add (&detrans_letters[lang], key, rules[lang]);
 }
 
-/* Wrapper around COPY_UNTIL_CHARACTER.  */
-#define copyuntil(__in, __out, __stop)                          \
-do {                                                            \
-  size_t __len = copy_until_character (__in, __out, __stop);    \
-  __in += __len;                                                \
-  __out += __len;                                               \
-} while (0)
 
+/* Most bytes of output a byte of input can give with the rules of the
+   language LANG in TRIE, rounded up; DEPTH is the length of the keys so
+   far.  A rule with a key of K bytes gives at most K times that many
+   bytes, capital letters are as long as small ones, and everything else
+   is copied as it is, so the output of LEN bytes of input fits in LEN
+   times that many bytes.  */
+static size_t
+rules_growth (const struct trie *trie, size_t depth, int lang)
+{
+  size_t i, growth = 1;
 
-/* Build the trie and set the ru_cap_str_length.  */
+  if (trie == NULL)
+    return growth;
+
+  for (i = 0; i < trie->children_count; i++)
+    {
+      const struct child *child = &trie->children[i];
+      const struct detrans_rule *rule = leaf_rule (child->last, lang);
+      size_t len = depth + child->label_len + 1, g;
+
+      if (rule && (g = (rule->repl_len + len - 1) / len) > growth)
+        growth = g;
+
+      if ((g = rules_growth (child->next, len, lang)) > growth)
+        growth = g;
+    }
+
+  return growth;
+}
+
+
+/* Build the trie and set the cap_str_length.  Does nothing if the
+   trie is built already.  */
 void
 detrans_init ()
 {
-  /* Set global length of russian small letter.  */
-  ru_cap_str_length = strlen (ru_cap[0].str);
+  size_t g;
+  int i;
+
+  if (detrans_trie != NULL)
+    return;
+
+  DETRANS_PROBE (rules__load__start);
+
+  /* All the small letters of the tables are of the same length.  */
+  cap_str_length = strlen (ru_cap[0].str);
 
   /* Init the de-transliteration trie.  */
   detrans_trie = trie_new ();
@@ -133,14 +312,61 @@ detrans_init ()
   /* Fill the trie with data.
      1. ru-special-words.def is a list of exceptions.
      2. ru-replcament.def is a correspondence between the transliterated
-     and russian letters.  */
-#define INPUT(__a, __b) do {                                            \
-     char * __w = add_special_word (__b);                               \
-     trie_add_word (detrans_trie, __a, strlen (__a), (ssize_t)__w);     \
-   } while (0);
+     and russian letters; the other languages have only the letters.  */
+#define INPUT(__a, __b) add_key (__lang, __a, __b, __kind);
+#define __kind DETRANS_RULE_WORD
+#define __lang LANG_RU
 #include "ru-special-words.def"
+#undef __kind
+#define __kind DETRANS_RULE_LETTER
 #include "ru-replacement.def"
+#undef __lang
+#define __lang LANG_UK
+#include "uk-replacement.def"
+#undef __lang
+#define __lang LANG_BE
+#include "be-replacement.def"
+#undef __lang
+#define __lang LANG_BG
+#include "bg-replacement.def"
+#undef __lang
+#undef __kind
+#undef INPUT
+
+#define INPUT(__a, __b) \
+  affix_add (&detrans_words, __a, strlen (__a), \
+             rule_number (leaf_rule (trie_search (detrans_trie, __a, \
+                                                  strlen (__a)), LANG_RU))); \
+  if ((g = fuzzy_growth (strlen (__a), strlen (__b))) > detrans_growth) \
+    detrans_growth = g;
+#include "ru-special-words.def"
 #undef INPUT
+  affix_build (&detrans_words);
+
+  detrans_anchors = trie_new ();
+#define INPUT(__a) trie_add_word (detrans_anchors, __a, strlen (__a), 0);
+#include "ru-anchors.def"
+#undef INPUT
+
+  for (i = 0; i < LANGS; i++)
+    {
+      letters_build (&detrans_letters[i]);
+      if ((g = rules_growth (detrans_trie, 0, i)) > detrans_growth)
+        detrans_growth = g;
+    }
+
+#ifdef DETRANS_COMPILED_MATCHER
+  for (i = 0; i < RU_LETTERS_COUNT; i++)
+    ru_letters_rules[i]
+      = leaf_rule (trie_search (detrans_trie, ru_letters_keys[i],
+                                strlen (ru_letters_keys[i])), LANG_RU);
+  for (i = 0; i < RU_WORDS_COUNT; i++)
+    ru_words_rules[i]
+      = leaf_rule (trie_search (detrans_trie, ru_words_keys[i],
+                                strlen (ru_words_keys[i])), LANG_RU);
+#endif
+
+  DETRANS_PROBE2 (rules__load__done, detrans_pos, detrans_growth);
 }
 
 
@@ -151,185 +377,1137 @@ detrans_free ()
   size_t i;
 
   for (i = 0; i < detrans_pos; i++)
-    free (detrans_words[i]);
-
-  free (detrans_words);
+    free (detrans_rules[i]);
+  for (i = 0; i < detrans_leaves_pos; i++)
+    free (detrans_leaves[i]);
+  for (i = 0; i < LANGS; i++)
+    letters_free (&detrans_letters[i]);
+
+  free (detrans_rules);
+  free (detrans_leaves);
   trie_free (detrans_trie);
+  affix_free (&detrans_words);
+  trie_free (detrans_anchors);
+
+  detrans_rules = NULL;
+  detrans_trie = NULL;
+  detrans_anchors = NULL;
+  detrans_size = 32;
+  detrans_pos = 0;
+  detrans_leaves = NULL;
+  detrans_leaves_size = 32;
+  detrans_leaves_pos = 0;
+  detrans_growth = 1;
+}
+
+
+/* The language called NAME, e.g. "uk", or NULL if there are no rules
+   for it.  Callers look it up once, when a contact is flagged, and pass
+   the pointer with every message.  */
+const struct detrans_lang *
+detrans_lang (const char *name)
+{
+  int i;
+
+  for (i = 0; i < LANGS; i++)
+    if (!strcmp (name, detrans_langs[i].name))
+      return &detrans_langs[i];
+
+  return NULL;
+}
+
+const char *
+detrans_lang_name (const struct detrans_lang *lang)
+{
+  return lang ? lang->name : detrans_langs[LANG_RU].name;
+}
+
+/* Number of LANG, as sent to detransd.  */
+unsigned
+detrans_lang_id (const struct detrans_lang *lang)
+{
+  return lang ? (unsigned) lang->index : LANG_RU;
+}
+
+const struct detrans_lang *
+detrans_lang_by_id (unsigned id)
+{
+  return id < LANGS ? &detrans_langs[id] : NULL;
 }
 
-/* Helper for binary search on RU_CAP.  */
+
+/* Helper for binary search on the capital letters.  */
 static inline int
 cmp_symbol (const void *k1, const void *k2)
 {
   struct symbol *s1 = (struct symbol *) k1;
   struct symbol *s2 = (struct symbol *) k2;
-  return strncmp (s1->str, s2->str, ru_cap_str_length);
+  return strncmp (s1->str, s2->str, cap_str_length);
 }
 
-/* Search RU_CAP for a small letter W.  */
-static struct symbol *
-search_capital_letter (const char *w)
+/* Search the letters of LANG for a small letter W.  */
+static const struct symbol *
+search_capital_letter (const struct detrans_lang *lang, const char *w)
 {
-  struct symbol s, *res;
+  struct symbol s;
   s.str = w;
 
-  res = (struct symbol *) bsearch (&s, ru_cap, ru_cap_length,
-				   sizeof (struct symbol), cmp_symbol);
-  return res;
+  return (const struct symbol *) bsearch (&s, lang->cap, lang->cap_length,
+                                          sizeof (struct symbol),
+                                          cmp_symbol);
 }
 
-/* A helper structure to implement TRIE_MATCH_MAX.  */
+/* Result of TRIE_MATCH_MAX.  */
 struct trie_match_info
 {
-  struct trie *trie;
-  ssize_t last;
+  const struct detrans_rule *rule;
   size_t len;
 };
 
-/* Find a longest prefix of WORD in the trie.  Function returns
-   struct trie_match_info, where
-        .trie is a trie that follows the prefix.
-        .last is an info attached to the prefix.
-        .len is the length of the prefix.  */
+/* Bytes of WORD of length LEN in small letters, see FOLDED_BYTE.  The
+   last character folded is kept in BUF, from START to END of WORD.  */
+struct folded
+{
+  const char *word;
+  size_t len, start, end;
+  char buf[UTF8_MAX];
+};
+
+/* The byte at POS of F->WORD with all the letters small.  The keys of
+   the rules are small letters in utf-8, and both letters of a pair are
+   as long in utf-8, so the positions in the folded word are those of
+   the word itself.  ASCII is folded on the spot, and so are the bytes
+   of the characters without case.  The latin letters are decoded once,
+   when their first byte is asked for, as the bytes are asked for in
+   order.  */
+static inline unsigned char
+folded_byte (struct folded *f, size_t pos)
+{
+  unsigned char c = f->word[pos];
+
+  if (c < 0x80)
+    return ascii_lower (c);
+  else if (pos - f->start < f->end - f->start)
+    return f->buf[pos - f->start];
+  else if (!utf8_may_fold (c))
+    return c;
+
+  f->start = pos;
+  f->end = pos + utf8_lower (f->word + pos, f->len - pos, f->buf);
+  return f->buf[0];
+}
+
+/* Find a longest prefix of WORD of length LEN in the trie that has a
+   rule of the language LANG attached, with the ASCII letters of WORD in
+   any case; the exceptions count only if WORDS is set.  Returns the
+   rule in .rule, or NULL if there is none, and the length of the prefix
+   in .len.  The walk is a loop that stops at the first mismatch, so
+   neither the stack nor the bytes looked at grow beyond the longest
+   rule.  The number of trie lookups is added to PROBES.  */
 static struct trie_match_info
-trie_match_max (struct trie_match_info tl,
-		struct trie_match_info last_success, const char *word)
+trie_match_max (struct trie *trie, int lang, const char *word, size_t len,
+                bool words, uint64_t *probes)
+{
+  struct trie_match_info ret = {.rule = NULL, .len = 0};
+  size_t pos = 0;
+
+  while (trie != NULL && pos < len)
+    {
+      struct child *child;
+
+      (*probes)++;
+      child = trie_search_child (trie, ascii_lower (word[pos]));
+      if (!child
+          || (child->label_len
+              && !trie_match_label (child, &word[pos + 1], len - pos - 1)))
+        break;
+
+      pos += child->label_len + 1;
+      if (leaf_rule (child->last, lang) != NULL
+          && (words || leaf_rule (child->last, lang)->kind
+                       != DETRANS_RULE_WORD))
+        ret = (struct trie_match_info)
+              {.rule = leaf_rule (child->last, lang), .len = pos};
+      trie = child->next;
+    }
+
+  return ret;
+}
+
+/* TRIE_MATCH_MAX for the words with latin letters with diacritics,
+   which are folded as well.  */
+static struct trie_match_info
+trie_match_max_folded (struct trie *trie, int lang, const char *word,
+                       size_t len, bool words, uint64_t *probes)
+{
+  struct trie_match_info ret = {.rule = NULL, .len = 0};
+  struct folded f = {.word = word, .len = len};
+  size_t pos = 0, i;
+
+  while (trie != NULL && pos < len)
+    {
+      struct child *child;
+
+      (*probes)++;
+      child = trie_search_child (trie, folded_byte (&f, pos));
+      if (!child || len - pos - 1 < child->label_len)
+        break;
+
+      for (i = 0; i < child->label_len; i++)
+        if ((unsigned char) child->label[i] != folded_byte (&f, pos + 1 + i))
+          break;
+      if (i < child->label_len)
+        break;
+
+      pos += child->label_len + 1;
+      if (leaf_rule (child->last, lang) != NULL
+          && (words || leaf_rule (child->last, lang)->kind
+                       != DETRANS_RULE_WORD))
+        ret = (struct trie_match_info)
+              {.rule = leaf_rule (child->last, lang), .len = pos};
+      trie = child->next;
+    }
+
+  return ret;
+}
+
+
+/* Letters and apostrophes make words in translit.  */
+static inline bool
+is_translit_char (char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '\'';
+}
+
+/* Anchors at WORD of length LEN: bit K is set if a prefix from
+   ru-anchors.def is the first K bytes of WORD, in any case.  */
+static uint64_t
+anchors_at (const char *word, size_t len)
+{
+  struct trie *trie = detrans_anchors;
+  uint64_t anchors = 0;
+  size_t pos = 0;
+
+  while (trie != NULL && pos < len)
+    {
+      struct child *child = trie_search_child (trie, ascii_lower (word[pos]));
+
+      if (!child
+          || (child->label_len
+              && !trie_match_label (child, &word[pos + 1], len - pos - 1)))
+        break;
+
+      pos += child->label_len + 1;
+      if (child->last != TRIE_NOT_LAST && pos < DETRANS_MAX_ANCHOR)
+        anchors |= (uint64_t) 1 << pos;
+      trie = child->next;
+    }
+
+  return anchors;
+}
+
+/* The letter rule of LANG with the longest key at WORD of length LEN,
+   see LETTERS_MATCH.  FOLD is set if the letters of WORD may be other
+   than ASCII ones in capitals.  */
+static inline struct trie_match_info
+match_letters (const struct letters *letters, const struct detrans_lang *lang,
+               const char *word, size_t len, bool fold)
 {
-  struct child *child;
+  struct trie_match_info ret;
 
-  if (tl.trie == NULL || *word == '\0')
-    return last_success;
+#ifdef DETRANS_COMPILED_MATCHER
+  size_t index;
 
-  child = trie_search_child (tl.trie, tolower (word[0]));
+  if (lang->index == LANG_RU && !fold)
+    {
+      ret.len = ru_letters_match (word, len, &index);
+      ret.rule = ret.len ? ru_letters_rules[index] : NULL;
+      return ret;
+    }
+#else
+  (void) lang;
+  (void) fold;
+#endif
 
-  if (!child)
-    return last_success;
+  ret.len = letters_match (letters, word, len, &ret.rule);
+  return ret;
+}
 
-  if (child->last != TRIE_NOT_LAST)
-    last_success = (struct trie_match_info)
-                   {
-                     .trie = child->next,
-                     .last = child->last,
-                     .len = tl.len + 1
-                   };
+/* The russian exception with the longest key at WORD of length LEN.
+   Trie probes are counted in *PROBES.  */
+static inline struct trie_match_info
+match_words (const char *word, size_t len, bool fold, uint64_t *probes)
+{
+  struct trie_match_info ret;
+  uint32_t value;
+
+#ifdef DETRANS_COMPILED_MATCHER
+  if (!fold)
+    {
+      size_t index;
+
+      ret.len = ru_words_match (word, len, &index);
+      ret.rule = ret.len ? ru_words_rules[index] : NULL;
+      return ret;
+    }
+#else
+  (void) fold;
+#endif
 
-  return trie_match_max ((struct trie_match_info)
-			 {
-                           .trie=child->next,
-                           .last= child->last,
-                           .len = tl.len + 1
-                         },
-                         last_success,
-                         &word[1]);
+  /* The keys are ASCII, so the other letters need not be folded.  */
+  ret.len = affix_match (&detrans_words, word, len, &value, probes);
+  ret.rule = ret.len ? detrans_rules[value] : NULL;
+  return ret;
+}
+
+/* Whether S starts a word of the message starting at BEGIN.  Bytes of
+   utf-8 are taken for letters, which they may be.  */
+static inline bool
+word_start (const char *begin, const char *s)
+{
+  return s == begin || !(is_translit_char (s[-1])
+                         || (unsigned char) s[-1] >= 0x80);
+}
+
+
+/* Select the decoding mode.  */
+void
+detrans_set_mode (enum detrans_mode mode)
+{
+  detrans_mode = mode;
+}
+
+/* Pass the messages longer than LEN bytes through as they are.  */
+void
+detrans_set_max_input (size_t len)
+{
+  detrans_max_input = len;
+}
+
+/* Growth of the rules as DETRANS_INIT finds it, read from the tables
+   without building the trie.  Rules that a later one replaces are
+   counted as well, so this may be more, never less.  */
+static size_t
+tables_growth (void)
+{
+  static size_t growth;
+  size_t ret = __atomic_load_n (&growth, __ATOMIC_RELAXED), g;
+
+  if (ret != 0)
+    return ret;
+
+  ret = 1;
+#define INPUT(__a, __b) \
+  if ((g = (strlen (__b) + strlen (__a) - 1) / strlen (__a)) > ret) \
+    ret = g;
+#include "ru-replacement.def"
+#include "uk-replacement.def"
+#include "be-replacement.def"
+#include "bg-replacement.def"
+#undef INPUT
+#define INPUT(__a, __b) \
+  if ((g = fuzzy_growth (strlen (__a), strlen (__b))) > ret) \
+    ret = g;
+#include "ru-special-words.def"
+#undef INPUT
+
+  __atomic_store_n (&growth, ret, __ATOMIC_RELAXED);
+  return ret;
+}
+
+/* Most bytes DETRANS can return for LEN bytes of input with the
+   default rules, not counting the terminating zero.  The rules need
+   not be loaded, so that a client of the service can check the size
+   of a reply.  */
+size_t
+detrans_max_output (size_t len)
+{
+  return len * tables_growth ();
 }
 
 
 /* Before de-transliteration we remove HTMML apostrophe,
-   as this symbol is an essential part in ISO-9 codemap.  */
+   as this symbol is an essential part in ISO-9 codemap.
+   OUT has to have place for LEN + 1 bytes.  If EDITS is
+   not NULL, the positions of the apostrophes in OUT are
+   stored in it.  Returns the end of the string in OUT.  */
 static char *
-remove_apostrophes (const char *in)
+remove_apostrophes (const char *in, size_t len, char *out,
+                    struct detrans_edits *edits)
 {
-  char *ret = (char *) malloc (strlen (in) + 1);
-  char *retptr = ret;
+  const char *end = in + len;
+  char *retptr = out;
 
-  while (*in != '\0')
-    if (*in == '&' && !strncmp (in, "&apos;", 6))
-      *retptr++ = '\'', in += 6;
+  while (in < end)
+    if (*in == '&' && end - in >= 6 && !strncmp (in, "&apos;", 6))
+      {
+        if (edits)
+          edits->apos[edits->apos_count++] = retptr - out;
+        *retptr++ = '\'', in += 6;
+      }
     else
       *retptr++ = *in++;
 
   *retptr = '\0';
-  return ret;
+  return retptr;
 }
 
 
-/* Actual de-transliteration.  */
-char *
-detrans (char *inp)
+/* In the edit mode, DETRANS_INTO works on the text without &apos;, so
+   a position in it has to be moved by 5 bytes for every &apos; before
+   it.  Apostrophes are counted from *NEXT on, positions only grow.  */
+static inline size_t
+input_offset (const struct detrans_edits *e, size_t *next, size_t pos)
+{
+  while (*next < e->apos_count && e->apos[*next] < pos)
+    (*next)++;
+
+  return pos + 5 * *next;
+}
+
+/* Record that the bytes FROM to TO of the text were replaced by REPL of
+   length REPL_LEN.  An edit that goes right after the previous one, both
+   in the input and in the replacements, extends it.  */
+static void
+edits_add (struct detrans_edits *e, size_t *next, size_t from, size_t to,
+           const char *repl, size_t repl_len)
 {
-  char *out = malloc (strlen (inp) * 10);
+  size_t offset = input_offset (e, next, from);
+  size_t len = input_offset (e, next, to) - offset;
+  struct detrans_edit *last = e->count ? &e->edit[e->count - 1] : NULL;
+
+  if (last && last->offset + last->len == offset
+      && last->repl + last->repl_len == repl)
+    {
+      last->len += len;
+      last->repl_len += repl_len;
+      return;
+    }
+
+  if (e->count == e->size)
+    {
+      e->size = e->size ? e->size * 2 : 16;
+      e->edit = (struct detrans_edit *)
+                realloc (e->edit, e->size * sizeof (struct detrans_edit));
+    }
+
+  e->edit[e->count++] = (struct detrans_edit)
+                        {
+                          .offset = offset,
+                          .len = len,
+                          .repl = repl,
+                          .repl_len = repl_len
+                        };
+}
+
+/* Copy N bytes at IN as they are to OUT.  In the edit mode nothing is
+   copied, except the apostrophes, which were &apos; in the input.
+   Returns the new end of OUT.  */
+static inline char *
+copy_text (struct detrans_edits *e, size_t *next, const char *text,
+           const char *in, size_t n, char *out)
+{
+  size_t pos = in - text;
+
+  if (e == NULL)
+    {
+      memcpy (out, in, n);
+      return out + n;
+    }
+
+  while (*next < e->apos_count && e->apos[*next] < pos + n)
+    {
+      size_t apos = e->apos[*next];
+
+      if (apos < pos)
+        {
+          (*next)++;
+          continue;
+        }
+
+      *out = '\'';
+      edits_add (e, next, apos, apos + 1, out, 1);
+      out++;
+    }
+
+  return out;
+}
+
+
+/* Size of the output buffer for the input of length LEN, with at most
+   GROWTH bytes of output for a byte of input.  */
+#define detrans_out_size(len, growth) ((len) * (growth) + 1)
+
+/* De-transliteration of INP of length LEN using the rules of LANG
+   stored in TRIE to OUT, which has place for DETRANS_OUT_SIZE (LEN,
+   GROWTH) bytes, GROWTH being RULES_GROWTH of TRIE.  TMP has place for
+   LEN + 1 bytes.  The leaves of the trie are as described in rules.h,
+   and TRIE must not be modified while the function is running.  Words
+   are decoded according to MODE, if the lattice model or the special
+   words know LANG.
+
+   If EDITS is not NULL, only the replacements are written to OUT and
+   EDITS gets the list of changes; the text copied as it is, markup and
+   cyrillic, stays in the input and costs only the scan.  EDITS->APOS
+   must have place for LEN / 6 positions.
+
+   Every byte of the input is looked at no more times than the longest
+   rule is long, and messages longer than DETRANS_MAX_INPUT are copied as
+   they are (with no edits), so the time is linear in LEN.
+
+   Returns the length of the output.  */
+static size_t
+detrans_into (struct trie *trie, const struct detrans_lang *lang,
+              const char *inp, size_t len, char *out, char *tmp,
+              enum detrans_mode mode, struct detrans_edits *edits)
+{
+  struct detrans_stats stats = {.bytes_in = len};
+  uint64_t start = stats_now ();
+  size_t apos_next = 0;
+  const struct letters *letters
+    = trie == detrans_trie && !detrans_letters[lang->index].partial
+      ? &detrans_letters[lang->index] : NULL;
+  /* The word we are in, and the positions in it where the exceptions
+     are looked up, see ANCHORS_AT.  */
+  const char *word = tmp;
+  uint64_t anchors = 0;
+
   char *outptr = out;
 
-  char *inptr = remove_apostrophes (inp);
-  char *in = inptr;
-
-  while (*in != 0)
-    {
-      bool capital = isupper (*in);
-      struct trie_match_info x, y;
-
-      /* Couple of things with a special treatement.
-         -- HTML tags.  */
-      if (*in == '<')
-	{
-	  copyuntil (in, outptr, '>');
-	  continue;
-	}
-      /* -- Naiive attempt to save URLs.  */
-      else if (!strncmp (in, "http://", 7)
-	       || !strncmp (in, "https://", 8)
-	       || !strncmp (in, "www.", 4))
-	{
-	  copyuntil (in, outptr, ' ');
-	  continue;
-	}
-      /* -- &xxxx; encoded symbols.
-         XXX could it be that we will have '&' without
-         terminating ';'?  Normally it doesn't happen
-         but who knows...   */
-      else if (*in == '&')
-	{
-	  copyuntil (in, outptr, ';');
-	  continue;
-	}
-
-
-      /* Construct a data-structure for trie max-match.  */
-      x = (struct trie_match_info)
-          {.trie=detrans_trie, .last=TRIE_NOT_LAST, .len=0};
-
-      /* Find the longest match in the trie.  */
-      y = trie_match_max (x, x, in);
-
-      /* The word is in the trie.  */
-      if (y.last != TRIE_NOT_LAST)
-	{
-	  char *repl = (char *) y.last;
-	  in += y.len;
-	  /* Replace the first letter, if it's capital.
-	     XXX yeah, we potentially loose the case inside
-	     the word, if a special word was matched but then,
-	     why the should have mixed case in it?  It is wrong
-	     anyway, so we simply ignore it.  */
-	  if (capital)
-	    {
-	      struct symbol *s = search_capital_letter (repl);
-	      if (s)
-		{
-		  memcpy (outptr, s->repl, strlen (repl));
-		  outptr += strlen (s->repl);
-		  repl += strlen (s->str);
-		}
-	    }
-
-	  /* Copy the rest of the word in case we had
-	     a first capital, or all the word.  */
-	  memcpy (outptr, repl, strlen (repl));
-	  outptr += strlen (repl);
-	}
-      else
-	{
-	  *outptr++ = *in++;
-	}
+  const char *inptr = tmp;
+  const char *in = inptr;
+  const char *end;
+
+  DETRANS_PROBE3 (message__start, lang->name, len, mode);
+  if (len > detrans_max_input)
+    {
+      if (edits == NULL)
+        {
+          memcpy (out, inp, len);
+          out[len] = '\0';
+        }
+
+      stats.bytes_out = len;
+      stats.passthrough = 1;
+      stats_account (&stats, start);
+      DETRANS_PROBE2 (message__done, len, stats.bytes_out);
+      return len;
+    }
+
+  /* The edits need no copy of a message without &apos;.  */
+  if (edits && memmem (inp, len, "&apos;", 6) == NULL)
+    {
+      word = inptr = in = inp;
+      end = inp + len;
+    }
+  else
+    end = remove_apostrophes (inp, len, tmp, edits);
+
+  while (in < end)
+    {
+      enum span_kind kind;
+      size_t span_len = span_next (inptr, in, end, &kind);
+      const char *text_end = in + span_len;
+      bool fold;
+
+      /* Tags, entities and URLs are copied as is.  */
+      if (kind != SPAN_TEXT)
+        {
+          outptr = copy_text (edits, &apos_next, inptr, in, span_len, outptr);
+          in += span_len;
+          continue;
+        }
+
+      /* Most texts have no latin letters with diacritics; the cheap
+         ASCII folding is enough for them.  */
+      fold = utf8_has_case (in, span_len);
+
+      while (in < text_end)
+        {
+          bool capital = fold ? utf8_is_capital (in, text_end - in)
+                              : (unsigned) (*in - 'A') < 26;
+          struct trie_match_info y;
+          bool at_anchor;
+
+          /* Cyrillic text and the other bytes that start no rule are
+             copied at once, only the starts of words are noted.  The
+             exceptions and the anchors are latin, so they start at none
+             of them.  */
+          if (letters != NULL && letters_none (letters, *in)
+              && !is_translit_char (*in))
+            {
+              const char *from = in;
+
+              do
+                {
+                  if (word_start (inptr, in))
+                    word = in, anchors = 1;
+                  in++;
+                }
+              while (in < text_end && letters_none (letters, *in)
+                     && !is_translit_char (*in));
+
+              if (edits)
+                outptr = copy_text (edits, &apos_next, inptr, from,
+                                    in - from, outptr);
+              else
+                {
+                  memcpy (outptr, from, in - from);
+                  outptr += in - from;
+                }
+              continue;
+            }
+
+          /* Decode the whole word at once in the lattice mode.  */
+          if (mode == DETRANS_LATTICE && lang->lattice
+              && is_translit_char (*in)
+              && (in == inptr || !is_translit_char (in[-1])))
+            {
+              size_t len = 1, outlen;
+
+              while (in + len < text_end && is_translit_char (in[len]))
+                len++;
+
+              outlen = lattice_decode_word (trie, lang->index, in, len,
+                                            outptr, &stats);
+              if (outlen != 0)
+                {
+                  if (edits)
+                    edits_add (edits, &apos_next, in - inptr,
+                               in + len - inptr, outptr, outlen);
+                  outptr += outlen;
+                  in += len;
+                  continue;
+                }
+            }
+
+          /* Exceptions are looked up at the start of a word and at the
+             anchors only.  */
+          at_anchor = false;
+          if (lang_has_words (lang))
+            {
+              if (word_start (inptr, in))
+                word = in, anchors = 1;
+
+              if ((size_t) (in - word) < DETRANS_MAX_ANCHOR
+                  && (anchors >> (in - word) & 1))
+                {
+                  at_anchor = true;
+                  anchors |= anchors_at (in, text_end - in) << (in - word);
+                }
+            }
+
+          /* Find the longest match within the text: with the letters
+             and, at the anchors, the exceptions of the language, in our
+             tables or in the trie given by the caller.  */
+          if (letters != NULL)
+            {
+              y = match_letters (letters, lang, in, text_end - in, fold);
+              if (at_anchor)
+                {
+                  struct trie_match_info w
+                    = match_words (in, text_end - in, fold,
+                                   &stats.trie_probes);
+                  if (w.len > y.len)
+                    y = w;
+                }
+            }
+          else if (fold)
+            y = trie_match_max_folded (trie, lang->index, in, text_end - in,
+                                       at_anchor, &stats.trie_probes);
+          else
+            y = trie_match_max (trie, lang->index, in, text_end - in,
+                                at_anchor, &stats.trie_probes);
+
+          /* A word that misses the special words may have a typo in one
+             of them.  */
+          if (mode == DETRANS_FUZZY && lang == &detrans_langs[LANG_RU]
+              && (y.rule == NULL || y.rule->kind != DETRANS_RULE_WORD)
+              && is_translit_char (*in)
+              && (in == inptr || !is_translit_char (in[-1])))
+            {
+              struct fuzzy_match f;
+              size_t len = 1;
+
+              while (in + len < text_end && is_translit_char (in[len]))
+                len++;
+
+              if (fuzzy_match (&detrans_words,
+                               (const struct detrans_rule *const *)
+                               detrans_rules, in, len, detrans_growth, &f,
+                               &stats))
+                {
+                  y = (struct trie_match_info) {f.rule, f.len};
+                  stats.fuzzy_hits++;
+                }
+            }
+
+          /* The word is in the trie.  */
+          if (y.rule != NULL)
+            {
+              const struct detrans_rule *rule = y.rule;
+              const char *repl = rule->repl;
+              size_t len = rule->repl_len;
+              char *word_out = outptr;
+
+              if (rule->kind == DETRANS_RULE_WORD)
+                stats.word_hits++;
+              else
+                stats.letter_hits++;
+
+              in += y.len;
+              /* Replace the first letter, if it's capital.
+                 XXX yeah, we potentially loose the case inside
+                 the word, if a special word was matched but then,
+                 why the should have mixed case in it?  It is wrong
+                 anyway, so we simply ignore it.  */
+              if (capital)
+                {
+                  const struct symbol *s = search_capital_letter (lang, repl);
+                  if (s)
+                    {
+                      memcpy (outptr, s->repl, cap_str_length);
+                      outptr += cap_str_length;
+                      repl += cap_str_length;
+                      len -= cap_str_length;
+                    }
+                }
+
+              /* Copy the rest of the word in case we had
+                 a first capital, or all the word.  */
+              memcpy (outptr, repl, len);
+              outptr += len;
+
+              if (edits)
+                edits_add (edits, &apos_next, in - y.len - inptr, in - inptr,
+                           word_out, outptr - word_out);
+            }
+          else if (edits == NULL)
+            *outptr++ = *in++;
+          else
+            {
+              outptr = copy_text (edits, &apos_next, inptr, in, 1, outptr);
+              in++;
+            }
+        }
     }
 
   *outptr = '\0';
-  free (inptr);
 
+  stats.bytes_out = outptr - out;
+  if (edits)
+    {
+      size_t i;
+
+      stats.bytes_out = len;
+      for (i = 0; i < edits->count; i++)
+        stats.bytes_out += edits->edit[i].repl_len - edits->edit[i].len;
+    }
+  stats_account (&stats, start);
+  DETRANS_PROBE2 (message__done, len, stats.bytes_out);
+  return outptr - out;
+}
+
+
+/* The language to use when the caller gives LANG.  */
+#define lang_or_default(lang) ((lang) ? (lang) : &detrans_langs[LANG_RU])
+
+/* De-transliteration of INP of length LEN using the rules stored in
+   TRIE, which are russian and pointers to struct detrans_rule, unless
+   TRIE is the one of DETRANS_TRIE_GET.  As with our own rules, those of
+   kind DETRANS_RULE_WORD match only at the start of a word and at the
+   anchors.  The result is allocated with malloc.  */
+char *
+detrans_with_trie (struct trie *trie, const char *inp, size_t len)
+{
+  const struct detrans_lang *lang = trie == detrans_trie
+                                    ? &detrans_langs[LANG_RU] : &plain_lang;
+  size_t growth = trie == detrans_trie ? detrans_growth
+                                       : rules_growth (trie, 0, RULES_PLAIN);
+  char *out = (char *) malloc (detrans_out_size (len, growth));
+  char *tmp = (char *) malloc (len + 1);
+
+  detrans_into (trie, lang, inp, len, out, tmp, detrans_mode, NULL);
+  free (tmp);
   return out;
 }
 
 
+/* De-transliteration of INP of length LEN with the default rules into
+   the buffers of CTX, which grow when needed.  The result is valid
+   until the next call with the same CTX.  A context must not be used by
+   two threads at once, but every thread may have its own.  */
+const char *
+detrans_ctx (struct detrans_ctx *ctx, const char *inp, size_t len)
+{
+  return detrans_ctx_mode (ctx, inp, len, detrans_mode);
+}
+
+/* Same as DETRANS_CTX, but in the given MODE rather than the one set
+   by DETRANS_SET_MODE, for callers serving several clients.  */
+const char *
+detrans_ctx_mode (struct detrans_ctx *ctx, const char *inp, size_t len,
+                  enum detrans_mode mode)
+{
+  return detrans_ctx_lang (ctx, NULL, inp, len, mode);
+}
+
+/* Same as DETRANS_CTX_MODE, with the rules of LANG, or russian ones if
+   LANG is NULL.  The length of the result is left in CTX->OUT_LEN.  */
+const char *
+detrans_ctx_lang (struct detrans_ctx *ctx, const struct detrans_lang *lang,
+                  const char *inp, size_t len, enum detrans_mode mode)
+{
+  if (ctx->out_size < detrans_out_size (len, detrans_growth))
+    {
+      ctx->out_size = detrans_out_size (len, detrans_growth);
+      ctx->out = (char *) realloc (ctx->out, ctx->out_size);
+    }
+
+  if (ctx->tmp_size < len + 1)
+    {
+      ctx->tmp_size = len + 1;
+      ctx->tmp = (char *) realloc (ctx->tmp, ctx->tmp_size);
+    }
+
+  ctx->out_len = detrans_into (detrans_trie, lang_or_default (lang), inp,
+                               len, ctx->out, ctx->tmp, mode, NULL);
+  return ctx->out;
+}
+
+/* De-transliteration of N messages INPUTS of lengths LENS at once, as
+   when a bouncer replays the backlog.  All the results are written one
+   after another to the buffer of ARENA, which is grown once per batch,
+   rather than allocating the buffers for every message.  This saves
+   the allocations, not the decoding: the tables of the rules stay in
+   the cache from one message to the next either way.  LANGS are the
+   languages of the messages; if it is NULL, all of them are russian.
+   Returns the array of N results, valid until the next call with the
+   same ARENA.  */
+const char **
+detrans_batch (const char *const *inputs, const size_t *lens,
+               const struct detrans_lang *const *langs, size_t n,
+               struct detrans_arena *arena)
+{
+  size_t i, total = 0, longest = 0, pos = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      total += detrans_out_size (lens[i], detrans_growth);
+      if (lens[i] > longest)
+        longest = lens[i];
+    }
+
+  if (arena->size < total)
+    {
+      arena->size = total;
+      arena->buf = (char *) realloc (arena->buf, arena->size);
+    }
+
+  if (arena->tmp_size < longest + 1)
+    {
+      arena->tmp_size = longest + 1;
+      arena->tmp = (char *) realloc (arena->tmp, arena->tmp_size);
+    }
+
+  if (arena->out_size < n)
+    {
+      arena->out_size = n;
+      arena->out = (const char **) realloc (arena->out,
+                                            n * sizeof (const char *));
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      arena->out[i] = arena->buf + pos;
+      pos += detrans_into (detrans_trie,
+                           lang_or_default (langs ? langs[i] : NULL),
+                           inputs[i], lens[i], arena->buf + pos, arena->tmp,
+                           detrans_mode, NULL) + 1;
+    }
+
+  return arena->out;
+}
+
+void
+detrans_arena_free (struct detrans_arena *arena)
+{
+  free (arena->buf);
+  free (arena->tmp);
+  free (arena->out);
+  *arena = (struct detrans_arena) DETRANS_ARENA_INIT;
+}
+
+/* De-transliteration of INP of length LEN as a list of edits in E,
+   for the callers which patch the message in place or write it out
+   piece by piece: most of a message with markup is copied as it is.
+   Edits and replacements are valid until the next call with the same E.
+   Returns the number of edits.  */
+size_t
+detrans_edits (struct detrans_edits *e, const char *inp, size_t len)
+{
+  if (e->repl_size < detrans_out_size (len, detrans_growth))
+    {
+      e->repl_size = detrans_out_size (len, detrans_growth);
+      e->repl = (char *) realloc (e->repl, e->repl_size);
+    }
+
+  if (e->tmp_size < len + 1)
+    {
+      e->tmp_size = len + 1;
+      e->tmp = (char *) realloc (e->tmp, e->tmp_size);
+    }
+
+  if (e->apos_size < len / 6)
+    {
+      e->apos_size = len / 6;
+      e->apos = (size_t *) realloc (e->apos, e->apos_size * sizeof (size_t));
+    }
+
+  e->count = e->apos_count = 0;
+  detrans_into (detrans_trie, &detrans_langs[LANG_RU], inp, len, e->repl,
+                e->tmp, detrans_mode, e);
+  return e->count;
+}
+
+void
+detrans_edits_free (struct detrans_edits *e)
+{
+  free (e->edit);
+  free (e->repl);
+  free (e->tmp);
+  free (e->apos);
+  *e = (struct detrans_edits) DETRANS_EDITS_INIT;
+}
+
+
+/* Incremental de-transliteration.  A message is cut into chunks after
+   some of its spaces outside tags.  Nothing the engine does crosses such
+   a space: rules, entities, &apos; and URLs stop at spaces, and tags are
+   the only markup that may contain one.  So the result of a message is
+   the results of its chunks one after another, and when the message is
+   edited, only the chunks from the first change on are decoded again,
+   up to a chunk boundary in the unchanged end of the message which was a
+   boundary before the edit as well; the results after it are reused.
+
+   Whether a space ends a chunk depends on the few bytes before it, not
+   on the position, so the boundaries in the unchanged text are found
+   again right after the edit.  A chunk gets about four words, and at
+   most DETRANS_CHUNK_MAX bytes up to the next space.  */
+#define DETRANS_CHUNK_MAX       256
+
+static inline bool
+is_space (char c)
+{
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/* Whether the space at I in INP ends the chunk starting at START.  */
+static inline bool
+chunk_ends (const char *inp, size_t i, size_t start)
+{
+  unsigned h = 0;
+  size_t j;
+
+  for (j = i - start > 3 ? i - 3 : start; j < i; j++)
+    h = h * 31 + (unsigned char) inp[j];
+
+  return (h & 3) == 0 || i + 1 - start >= DETRANS_CHUNK_MAX;
+}
+
+/* Make sure that *BUF of *SIZE elements of ELEM bytes has place for
+   NEED of them.  */
+static void
+reserve (void *buf, size_t *size, size_t need, size_t elem)
+{
+  if (*size < need)
+    {
+      *size = need > 2 * *size ? need : 2 * *size;
+      *(void **) buf = realloc (*(void **) buf, *size * elem);
+    }
+}
+
+/* The chunk of D from K on starting at POS of the input, or D->COUNT + 1
+   if there is none.  */
+static size_t
+find_chunk (const struct detrans_incr *d, size_t k, size_t pos)
+{
+  size_t hi = d->count + 1;
+
+  while (k < hi)
+    {
+      size_t m = k + (hi - k) / 2;
+
+      if (d->chunk[m].in == pos)
+        return m;
+      else if (d->chunk[m].in < pos)
+        k = m + 1;
+      else
+        hi = m;
+    }
+
+  return d->count + 1;
+}
+
+/* De-transliteration of INP of length LEN, which is the message given
+   to the previous call with D edited, as it happens with corrected
+   messages and with a preview while typing.  Only the chunks around
+   the edit are decoded, so apart from comparing and copying the bytes
+   the time is proportional to the size of the edit.  A change of LANG
+   or MODE decodes the whole message.  The result is valid until the
+   next call with D.  The statistics count every chunk decoded as a
+   message of its own.  */
+const char *
+detrans_update (struct detrans_incr *d, const struct detrans_lang *lang,
+                const char *inp, size_t len, enum detrans_mode mode)
+{
+  size_t p = 0, s = 0, k = 0, j, i, start, mid = 0, fresh = 0, out_len;
+  bool split = len <= detrans_max_input, tag = false;
+
+  if (d->chunk == NULL || d->lang != lang || d->mode != mode || !split)
+    {
+      reserve (&d->chunk, &d->size, 1, sizeof (struct detrans_chunk));
+      d->chunk[0] = (struct detrans_chunk) {0, 0};
+      d->count = d->in_len = d->out_len = 0;
+      d->lang = lang;
+      d->mode = mode;
+    }
+  else
+    {
+      size_t most = len < d->in_len ? len : d->in_len;
+
+      while (p < most && inp[p] == d->in[p])
+        p++;
+      while (s < most - p && inp[len - 1 - s] == d->in[d->in_len - 1 - s])
+        s++;
+
+      /* The last chunk starting before the change.  */
+      while (k + 1 < d->count && d->chunk[k + 1].in <= p)
+        k++;
+    }
+
+  start = d->chunk[k].in;
+  reserve (&d->mid, &d->mid_size, detrans_out_size (len - start, detrans_growth),
+           1);
+  reserve (&d->tmp, &d->tmp_size, len - start + 1, 1);
+  d->converted = 0;
+
+  for (i = start; ; i++)
+    {
+      size_t q = i + 1;
+
+      if (i < len)
+        {
+          if (tag)
+            {
+              tag = inp[i] != '>';
+              continue;
+            }
+          else if (inp[i] == '<')
+            {
+              tag = true;
+              continue;
+            }
+          else if (!split || !is_space (inp[i]) || !chunk_ends (inp, i, start))
+            continue;
+        }
+      else
+        q = len;
+
+      if (q > start)
+        {
+          reserve (&d->fresh, &d->fresh_size, fresh + 1,
+                   sizeof (struct detrans_chunk));
+          d->fresh[fresh++] = (struct detrans_chunk) {start, mid};
+          mid += detrans_into (detrans_trie, lang_or_default (lang),
+                               inp + start, q - start, d->mid + mid, d->tmp,
+                               mode, NULL);
+          d->converted += q - start;
+          start = q;
+        }
+
+      /* The rest is as it was, from the same boundary on.  */
+      if (q == len)
+        {
+          j = d->count;
+          break;
+        }
+      if (q >= len - s
+          && (j = find_chunk (d, k, q - len + d->in_len)) <= d->count)
+        break;
+    }
+
+  /* Results: the chunks before K, the new ones, and the ones from J on,
+     which move together with the end of the message.  */
+  out_len = d->chunk[k].out + mid + d->out_len - d->chunk[j].out;
+  reserve (&d->out, &d->out_size, out_len + 1, 1);
+  memmove (d->out + d->chunk[k].out + mid, d->out + d->chunk[j].out,
+           d->out_len - d->chunk[j].out);
+  memcpy (d->out + d->chunk[k].out, d->mid, mid);
+  d->out[out_len] = '\0';
+
+  reserve (&d->chunk, &d->size, k + fresh + d->count - j + 1,
+           sizeof (struct detrans_chunk));
+  memmove (&d->chunk[k + fresh], &d->chunk[j],
+           (d->count - j + 1) * sizeof (struct detrans_chunk));
+  for (i = k + fresh; i <= k + fresh + d->count - j; i++)
+    {
+      d->chunk[i].in = d->chunk[i].in + len - d->in_len;
+      d->chunk[i].out = d->chunk[i].out + out_len - d->out_len;
+    }
+  for (i = 0; i < fresh; i++)
+    d->chunk[k + i] = (struct detrans_chunk)
+                      {
+                        d->fresh[i].in,
+                        d->fresh[i].out + d->chunk[k].out
+                      };
+  d->count = k + fresh + d->count - j;
+
+  reserve (&d->in, &d->in_size, len, 1);
+  memcpy (d->in, inp, len);
+  d->in_len = len;
+  d->out_len = out_len;
+  return d->out;
+}
+
+void
+detrans_incr_free (struct detrans_incr *d)
+{
+  free (d->in);
+  free (d->out);
+  free (d->mid);
+  free (d->tmp);
+  free (d->chunk);
+  free (d->fresh);
+  *d = (struct detrans_incr) DETRANS_INCR_INIT;
+}
+
+void
+detrans_ctx_free (struct detrans_ctx *ctx)
+{
+  free (ctx->out);
+  free (ctx->tmp);
+  *ctx = (struct detrans_ctx) DETRANS_CTX_INIT;
+}
+
+
+/* The trie built by DETRANS_INIT.  */
+struct trie *
+detrans_trie_get ()
+{
+  return detrans_trie;
+}
+
+
+/* Actual de-transliteration of INP of length LEN.  The result is
+   allocated with malloc.  */
+char *
+detrans (const char *inp, size_t len)
+{
+  return detrans_with_trie (detrans_trie, inp, len);
+}
+
+
 #ifdef _DETRANS_BINARY
 int
 main (int argc, char *argv[])
@@ -345,7 +1523,7 @@ main (int argc, char *argv[])
         goto out;
       }
 
-    xtrans = detrans (argv[1]);
+    xtrans = detrans (argv[1], strlen (argv[1]));
     fprintf (stdout, "xdetrans '%s' = '%s'\n", argv[1], xtrans);
     free (xtrans);
 
@@ -363,7 +1541,7 @@ main (int argc, char *argv[])
 
      while (fscanf (f, "%s\t%s", in_ru, in_tr) != EOF)
        {
-         char *out = detrans (in_tr);
+         char *out = detrans (in_tr, strlen (in_tr));
          if (strcmp (in_ru, out))
 	        fprintf (stdout, "INPUT (\"%s\",\t\"%s\")\n", in_tr, out);
          free (out);
@@ -15,8 +15,189 @@
 #ifndef __DETRANS_H__
 #define __DETRANS_H__
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Messages longer than that are passed through as they are, unless
+   set otherwise with DETRANS_SET_MAX_INPUT.  */
+#define DETRANS_MAX_INPUT       (256 * 1024)
+
+/* Version of libdetrans, see libdetrans.pc.in.  */
+#define DETRANS_VERSION         "1.2.0"
+
+struct trie;
+
+/* Kinds of rules.
+     DETRANS_RULE_WORD   exceptions from ru-special-words.def;
+     DETRANS_RULE_LETTER ISO-9 letters from ru-replacement.def.  */
+enum detrans_rule_kind
+{
+  DETRANS_RULE_WORD,
+  DETRANS_RULE_LETTER
+};
+
+/* A replacement attached to the trie passed to DETRANS_WITH_TRIE.  */
+struct detrans_rule
+{
+  const char *repl;
+  size_t repl_len;
+  enum detrans_rule_kind kind;
+};
+
+/* How the words are decoded.
+     DETRANS_GREEDY  the longest rule is applied at every position;
+     DETRANS_LATTICE every word is decoded as a whole, picking the best
+                     segmentation according to a model of russian
+                     (see lattice.c);
+     DETRANS_FUZZY   greedy, but a word that misses the special words is
+                     taken for a typo in the closest one (see fuzzy.c).  */
+enum detrans_mode
+{
+  DETRANS_GREEDY,
+  DETRANS_LATTICE,
+  DETRANS_FUZZY
+};
+
+/* Number of buckets in the latency histogram.  Bucket I counts the
+   calls that took from 2^I to 2^(I+1) nanoseconds, the last one
+   counts everything slower.  */
+#define DETRANS_LATENCY_BUCKETS 32
+
+/* Runtime statistics of the engine, see stats.c.  */
+struct detrans_stats
+{
+  uint64_t messages;
+  uint64_t bytes_in, bytes_out;
+  uint64_t trie_probes;
+  /* Applied rules by kind.  */
+  uint64_t word_hits, letter_hits;
+  /* Messages longer than the maximum input, passed through.  */
+  uint64_t passthrough;
+  /* Special words found with a typo, see DETRANS_FUZZY.  */
+  uint64_t fuzzy_hits;
+  uint64_t latency[DETRANS_LATENCY_BUCKETS];
+};
+
+/* Buffers reused by DETRANS_CTX, so that converting a lot of messages
+   doesn't allocate memory for every one of them.  */
+struct detrans_ctx
+{
+  char *out, *tmp;
+  size_t out_size, tmp_size;
+  /* Length of the last result in OUT, which may hold zeros.  */
+  size_t out_len;
+};
+
+#define DETRANS_CTX_INIT {NULL, NULL, 0, 0, 0}
+
+/* Results of DETRANS_BATCH, kept between the batches.  */
+struct detrans_arena
+{
+  char *buf, *tmp;
+  size_t size, tmp_size;
+  const char **out;
+  size_t out_size;
+};
+
+#define DETRANS_ARENA_INIT {NULL, NULL, 0, 0, NULL, 0}
+
+/* A change made by DETRANS_EDITS: LEN bytes of the input at OFFSET are
+   replaced by REPL_LEN bytes at REPL.  Edits go in the order of OFFSET
+   and do not overlap; the bytes between them stay as they are.  */
+struct detrans_edit
+{
+  size_t offset, len;
+  const char *repl;
+  size_t repl_len;
+};
+
+/* Edits of a message, and the buffers reused between the calls.  */
+struct detrans_edits
+{
+  struct detrans_edit *edit;
+  size_t count, size;
+  char *repl, *tmp;
+  size_t repl_size, tmp_size;
+  /* Positions of &apos; in the input, see detrans.c.  */
+  size_t *apos;
+  size_t apos_count, apos_size;
+};
+
+#define DETRANS_EDITS_INIT {NULL, 0, 0, NULL, NULL, 0, 0, NULL, 0, 0}
+
+/* Where a chunk of the message starts in the input and in the output,
+   see DETRANS_UPDATE.  */
+struct detrans_chunk
+{
+  size_t in, out;
+};
+
+/* The last message given to DETRANS_UPDATE, its result and its chunks,
+   CHUNK[COUNT] being the end of both.  */
+struct detrans_incr
+{
+  char *in, *out, *mid, *tmp;
+  size_t in_len, out_len;
+  size_t in_size, out_size, mid_size, tmp_size;
+  struct detrans_chunk *chunk, *fresh;
+  size_t count, size, fresh_size;
+  const struct detrans_lang *lang;
+  enum detrans_mode mode;
+  /* Bytes of the input de-transliterated by the last call.  */
+  size_t converted;
+};
+
+#define DETRANS_INCR_INIT \
+  {NULL, NULL, NULL, NULL, 0, 0, 0, 0, 0, 0, NULL, NULL, 0, 0, 0, NULL, \
+   DETRANS_GREEDY, 0}
+
+/* Languages with their own rules, see DETRANS_LANG.  */
+#define DETRANS_LANGUAGES       "ru, uk, be, bg"
+
+struct detrans_lang;
+
+/* Inputs are given with their length and need not be terminated by
+   zero; results are terminated by zero.  */
+__BEGIN_DECLS
 extern void detrans_init ();
-extern char * detrans (char *);
+extern void detrans_set_mode (enum detrans_mode);
+extern void detrans_set_max_input (size_t);
+extern size_t detrans_max_output (size_t);
+extern char * detrans (const char *, size_t);
+extern char * detrans_with_trie (struct trie *, const char *, size_t);
+extern const char * detrans_ctx (struct detrans_ctx *, const char *, size_t);
+extern const char * detrans_ctx_mode (struct detrans_ctx *, const char *,
+                                      size_t, enum detrans_mode);
+extern const char * detrans_ctx_lang (struct detrans_ctx *,
+                                      const struct detrans_lang *,
+                                      const char *, size_t, enum detrans_mode);
+extern void detrans_ctx_free (struct detrans_ctx *);
+extern const char ** detrans_batch (const char *const *, const size_t *,
+                                    const struct detrans_lang *const *,
+                                    size_t, struct detrans_arena *);
+extern void detrans_arena_free (struct detrans_arena *);
+extern size_t detrans_edits (struct detrans_edits *, const char *, size_t);
+extern void detrans_edits_free (struct detrans_edits *);
+extern const char * detrans_update (struct detrans_incr *,
+                                    const struct detrans_lang *,
+                                    const char *, size_t, enum detrans_mode);
+extern void detrans_incr_free (struct detrans_incr *);
+extern const struct detrans_lang * detrans_lang (const char *);
+extern const char * detrans_lang_name (const struct detrans_lang *);
+extern unsigned detrans_lang_id (const struct detrans_lang *);
+extern const struct detrans_lang * detrans_lang_by_id (unsigned);
+extern struct trie * detrans_trie_get ();
 extern void detrans_free ();
 
+/* Cheap check whether the text is russian translit at all, see
+   classify.c.  */
+extern int detrans_translit_score (const char *, size_t, size_t *);
+extern bool detrans_is_translit (const char *, size_t);
+
+extern void detrans_stats_get (struct detrans_stats *);
+extern void detrans_stats_reset ();
+extern char * detrans_stats_string ();
+__END_DECLS
+
 #endif  /* __DETRANS_H__  */
@@ -0,0 +1,544 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+
+/* detransd, the de-transliteration service.  It builds the rules once
+   and serves the plugins of all the processes on the host over a Unix
+   socket, see detransd.h for the protocol and client.c for the client.
+
+   The main thread polls the connections and reads the requests; the
+   requests complete after one round of polling are queued together,
+   and every worker takes up to DETRANSD_BATCH of them at once, so that
+   under load the queue lock is taken once per batch and not once per
+   message.  A connection is not polled while its request is in the
+   queue, so the replies come in order and every connection costs at
+   most one message of memory.
+
+   SIGUSR1 prints the statistics to stderr; `detransd -S' asks a
+   running service for them.  */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <errno.h>
+#include <err.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include "detrans.h"
+#include "detransd.h"
+#include "client.h"
+
+/* Most requests a worker takes from the queue at once.  */
+#define DETRANSD_BATCH          16
+
+/* A client that does not read its reply for that long is dropped.  */
+#define DETRANSD_SEND_TIMEOUT   5
+
+struct conn
+{
+  int fd;
+  /* The request is in the queue or being served.  */
+  bool busy;
+  /* The reply could not be sent.  */
+  bool failed;
+  struct detransd_header h;
+  size_t got;
+  char *msg;
+  size_t msg_size;
+  /* Next in the queue.  */
+  struct conn *next;
+};
+
+/* Connections by file descriptor, owned by the main thread except the
+   busy ones.  */
+static struct conn **conns = NULL;
+static size_t conns_size = 0;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static struct conn *queue_head = NULL, *queue_tail = NULL;
+static bool stopping = false;
+static uint64_t requests = 0, batches = 0, connections = 0;
+
+/* Workers tell the main thread which connections they are done with
+   through this pipe.  */
+static int done_pipe[2];
+
+static volatile sig_atomic_t stop_signal = 0, stats_signal = 0;
+
+
+static void
+queue_push (struct conn *c)
+{
+  c->next = NULL;
+  if (queue_tail)
+    queue_tail->next = c;
+  else
+    queue_head = c;
+  queue_tail = c;
+}
+
+static struct conn *
+queue_pop (void)
+{
+  struct conn *c = queue_head;
+
+  if ((queue_head = c->next) == NULL)
+    queue_tail = NULL;
+  return c;
+}
+
+static char *
+stats_string (void)
+{
+  char *engine = detrans_stats_string (), *ret;
+  uint64_t r, b, n;
+
+  pthread_mutex_lock (&queue_lock);
+  r = requests, b = batches, n = connections;
+  pthread_mutex_unlock (&queue_lock);
+
+  if (-1 == asprintf (&ret, "%s\nservice: %llu connections, %llu requests "
+                      "in %llu batches (%.2f per batch)\n",
+                      engine ? engine : "", (unsigned long long) n,
+                      (unsigned long long) r, (unsigned long long) b,
+                      b ? (double) r / b : 0.0))
+    ret = NULL;
+
+  free (engine);
+  return ret;
+}
+
+static bool
+send_all (int fd, const void *buf, size_t len)
+{
+  while (len > 0)
+    {
+      ssize_t n = send (fd, buf, len, MSG_NOSIGNAL);
+
+      if (n <= 0)
+        return false;
+      buf = (const char *) buf + n;
+      len -= n;
+    }
+
+  return true;
+}
+
+/* Serve the request of C with the buffers of CTX.  */
+static void
+serve (struct conn *c, struct detrans_ctx *ctx)
+{
+  uint32_t flags = ntohl (c->h.flags);
+  unsigned lang = (flags >> DETRANSD_LANG_SHIFT) & DETRANSD_LANG_MASK;
+  char *stats = NULL;
+  const char *reply;
+  size_t len;
+  struct detransd_header h;
+
+  if (flags & DETRANSD_STATS)
+    {
+      reply = stats = stats_string ();
+      len = stats ? strlen (stats) : 0;
+    }
+  else
+    {
+      reply = detrans_ctx_lang (ctx, detrans_lang_by_id (lang),
+                                c->msg, ntohl (c->h.len),
+                                (flags & DETRANSD_LATTICE) ? DETRANS_LATTICE
+                                : (flags & DETRANSD_FUZZY) ? DETRANS_FUZZY
+                                : DETRANS_GREEDY);
+      len = ctx->out_len;
+    }
+
+  if (reply == NULL)
+    reply = "";
+
+  h = (struct detransd_header) {htonl (len), htonl (flags)};
+  c->failed = !send_all (c->fd, &h, sizeof (h))
+              || !send_all (c->fd, reply, len);
+  free (stats);
+}
+
+static void *
+worker (void *arg __attribute__ ((unused)))
+{
+  struct detrans_ctx ctx = DETRANS_CTX_INIT;
+  struct conn *batch[DETRANSD_BATCH];
+  size_t i, n;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&queue_lock);
+      while (queue_head == NULL && !stopping)
+        pthread_cond_wait (&queue_cond, &queue_lock);
+
+      for (n = 0; queue_head != NULL && n < DETRANSD_BATCH; n++)
+        batch[n] = queue_pop ();
+
+      requests += n;
+      batches += n != 0;
+      pthread_mutex_unlock (&queue_lock);
+
+      if (n == 0)
+        break;
+
+      for (i = 0; i < n; i++)
+        {
+          serve (batch[i], &ctx);
+          if (write (done_pipe[1], &batch[i]->fd, sizeof (int)) == -1)
+            warn ("cannot write to the pipe");
+        }
+    }
+
+  detrans_ctx_free (&ctx);
+  return NULL;
+}
+
+
+static void
+conn_close (int fd)
+{
+  free (conns[fd]->msg);
+  free (conns[fd]);
+  conns[fd] = NULL;
+  close (fd);
+}
+
+static void
+conn_accept (int sock)
+{
+  struct timeval tv = {.tv_sec = DETRANSD_SEND_TIMEOUT};
+  int fd = accept4 (sock, NULL, NULL, SOCK_CLOEXEC);
+
+  if (fd == -1)
+    return;
+
+  setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof (tv));
+  if ((size_t) fd >= conns_size)
+    {
+      size_t size = conns_size ? conns_size : 64;
+
+      while (size <= (size_t) fd)
+        size *= 2;
+      conns = (struct conn **) realloc (conns, size * sizeof (struct conn *));
+      memset (conns + conns_size, 0,
+              (size - conns_size) * sizeof (struct conn *));
+      conns_size = size;
+    }
+
+  conns[fd] = (struct conn *) calloc (1, sizeof (struct conn));
+  conns[fd]->fd = fd;
+  pthread_mutex_lock (&queue_lock);
+  connections++;
+  pthread_mutex_unlock (&queue_lock);
+}
+
+/* Read what is available on C.  Returns true if the request is
+   complete, closes the connection on errors.  */
+static bool
+conn_read (struct conn *c)
+{
+  size_t len;
+  ssize_t n;
+
+  if (c->got < sizeof (c->h))
+    {
+      n = recv (c->fd, (char *) &c->h + c->got, sizeof (c->h) - c->got,
+                MSG_DONTWAIT);
+      if (n <= 0)
+        goto fail;
+      if ((c->got += n) < sizeof (c->h))
+        return false;
+    }
+
+  len = ntohl (c->h.len);
+  if (len > DETRANSD_MAX_MESSAGE)
+    goto fail;
+
+  if (c->msg_size < len + 1)
+    {
+      c->msg_size = len + 1;
+      c->msg = (char *) realloc (c->msg, c->msg_size);
+    }
+
+  if (c->got < sizeof (c->h) + len)
+    {
+      n = recv (c->fd, c->msg + c->got - sizeof (c->h),
+                sizeof (c->h) + len - c->got, MSG_DONTWAIT);
+      if (n <= 0)
+        goto fail;
+      if ((c->got += n) < sizeof (c->h) + len)
+        return false;
+    }
+
+  /* The engine converts all LEN bytes, zeros included, and the reply
+     is as long as its result; the terminator is only a guard.  */
+  c->msg[len] = '\0';
+  c->got = 0;
+  return true;
+
+fail:
+  if (n == -1 && (errno == EAGAIN || errno == EINTR))
+    return false;
+  conn_close (c->fd);
+  return false;
+}
+
+static void
+handle_signal (int sig)
+{
+  if (sig == SIGUSR1)
+    stats_signal = 1;
+  else
+    stop_signal = 1;
+}
+
+/* Listen on PATH, for all the users if SHARED is set, otherwise only for
+   the user running the service.  */
+static int
+listen_on (const char *path, bool shared)
+{
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  uid_t owner;
+  mode_t mask;
+  int sock;
+
+  if (strlen (path) >= sizeof (addr.sun_path))
+    errx (EXIT_FAILURE, "socket path '%s' is too long", path);
+  strcpy (addr.sun_path, path);
+
+  /* In a directory others can write to, anyone could serve the socket
+     before us and read the messages of the other users.  */
+  if (shared && (!detrans_client_dir_owner (path, &owner)
+                 || (owner != 0 && owner != geteuid ())))
+    errx (EXIT_FAILURE, "the directory of '%s' must be writable only by "
+          "root or by the service", path);
+
+  if ((sock = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+    err (EXIT_FAILURE, "cannot create a socket");
+
+  /* A socket left by a service that died is removed, a live one is
+     not.  */
+  if (connect (sock, (struct sockaddr *) &addr, sizeof (addr)) == 0)
+    errx (EXIT_FAILURE, "'%s' is served already", path);
+  unlink (path);
+
+  /* The socket is created private, so that nobody connects before the
+     mode is set.  */
+  mask = umask (077);
+  if (bind (sock, (struct sockaddr *) &addr, sizeof (addr))
+      || listen (sock, SOMAXCONN))
+    err (EXIT_FAILURE, "cannot listen on '%s'", path);
+  umask (mask);
+
+  /* The point of a shared service is to share the rules between all the
+     users.  */
+  if (shared)
+    chmod (path, 0666);
+  return sock;
+}
+
+static void
+serve_forever (int sock)
+{
+  struct pollfd *fds = NULL;
+  size_t fds_size = 0;
+
+  while (!stop_signal)
+    {
+      size_t i, n = 0, queued = 0;
+
+      if (stats_signal)
+        {
+          char *s = stats_string ();
+
+          fprintf (stderr, "%s", s ? s : "");
+          free (s);
+          stats_signal = 0;
+        }
+
+      if (fds_size < conns_size + 2)
+        {
+          fds_size = conns_size + 2;
+          fds = (struct pollfd *) realloc (fds, fds_size
+                                                * sizeof (struct pollfd));
+        }
+
+      fds[n++] = (struct pollfd) {.fd = sock, .events = POLLIN};
+      fds[n++] = (struct pollfd) {.fd = done_pipe[0], .events = POLLIN};
+      for (i = 0; i < conns_size; i++)
+        if (conns[i] && !conns[i]->busy)
+          fds[n++] = (struct pollfd) {.fd = (int) i, .events = POLLIN};
+
+      if (poll (fds, n, -1) == -1)
+        {
+          if (errno != EINTR)
+            err (EXIT_FAILURE, "poll failed");
+          continue;
+        }
+
+      if (fds[1].revents & POLLIN)
+        {
+          int done[64];
+          ssize_t len = read (done_pipe[0], done, sizeof (done));
+
+          for (i = 0; len > 0 && i < (size_t) len / sizeof (int); i++)
+            {
+              conns[done[i]]->busy = false;
+              if (conns[done[i]]->failed)
+                conn_close (done[i]);
+            }
+        }
+
+      pthread_mutex_lock (&queue_lock);
+      for (i = 2; i < n; i++)
+        if (fds[i].revents && conns[fds[i].fd]
+            && conn_read (conns[fds[i].fd]))
+          {
+            conns[fds[i].fd]->busy = true;
+            queue_push (conns[fds[i].fd]);
+            queued++;
+          }
+
+      if (queued > 1)
+        pthread_cond_broadcast (&queue_cond);
+      else if (queued == 1)
+        pthread_cond_signal (&queue_cond);
+      pthread_mutex_unlock (&queue_lock);
+
+      if (fds[0].revents & POLLIN)
+        conn_accept (sock);
+    }
+
+  free (fds);
+}
+
+
+static void
+usage (const char *name)
+{
+  fprintf (stderr, "usage: %s [-a] [-s socket] [-j threads] [-m max-input] "
+           "[-S]\n", name);
+  exit (EXIT_FAILURE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  char *path = NULL;
+  long workers_count = sysconf (_SC_NPROCESSORS_ONLN);
+  bool query_stats = false, shared = false;
+  struct sigaction sa = {.sa_handler = handle_signal};
+  pthread_t *workers;
+  int opt, sock;
+  long i;
+
+  while ((opt = getopt (argc, argv, "as:j:m:S")) != -1)
+    switch (opt)
+      {
+      case 'a':
+        shared = true;
+        break;
+      case 's':
+        free (path);
+        path = strdup (optarg);
+        break;
+      case 'j':
+        workers_count = atol (optarg);
+        break;
+      case 'm':
+        detrans_set_max_input (strtoul (optarg, NULL, 10));
+        break;
+      case 'S':
+        query_stats = true;
+        break;
+      default:
+        usage (argv[0]);
+      }
+
+  if (optind != argc)
+    usage (argv[0]);
+
+  if (path == NULL && (path = detrans_client_default_path (shared)) == NULL)
+    errx (EXIT_FAILURE, "XDG_RUNTIME_DIR is not set, give the socket "
+          "with -s");
+
+  if (query_stats)
+    {
+      struct detrans_client c = DETRANS_CLIENT_INIT;
+      char *s;
+
+      detrans_client_set_path (&c, path);
+      if ((s = detrans_client_stats (&c)) == NULL)
+        errx (EXIT_FAILURE, "'%s' does not answer", path);
+
+      printf ("%s", s);
+      free (s);
+      free (path);
+      detrans_client_free (&c);
+      return EXIT_SUCCESS;
+    }
+
+  if (workers_count < 1)
+    workers_count = 1;
+
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGTERM, &sa, NULL);
+  sigaction (SIGUSR1, &sa, NULL);
+  signal (SIGPIPE, SIG_IGN);
+
+  if (pipe2 (done_pipe, O_CLOEXEC))
+    err (EXIT_FAILURE, "cannot create a pipe");
+
+  detrans_init ();
+  sock = listen_on (path, shared);
+
+  workers = (pthread_t *) calloc (workers_count, sizeof (pthread_t));
+  for (i = 0; i < workers_count; i++)
+    pthread_create (&workers[i], NULL, worker, NULL);
+
+  serve_forever (sock);
+
+  pthread_mutex_lock (&queue_lock);
+  stopping = true;
+  pthread_cond_broadcast (&queue_cond);
+  pthread_mutex_unlock (&queue_lock);
+
+  for (i = 0; i < workers_count; i++)
+    pthread_join (workers[i], NULL);
+  free (workers);
+
+  for (i = 0; (size_t) i < conns_size; i++)
+    if (conns[i])
+      conn_close (i);
+  free (conns);
+
+  close (sock);
+  unlink (path);
+  free (path);
+  detrans_free ();
+  return EXIT_SUCCESS;
+}
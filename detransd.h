@@ -0,0 +1,53 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+
+#ifndef __DETRANSD_H__
+#define __DETRANSD_H__
+
+#include <stdint.h>
+
+/* Protocol of detransd, the de-transliteration service.  A request is a
+   header followed by LEN bytes of the message, without the terminating
+   zero; the reply is a header with the same flags followed by LEN bytes
+   of the result.  Fields of the header are in network byte order.  A
+   client may send the next request after it has read the reply.  */
+struct detransd_header
+{
+  uint32_t len;
+  uint32_t flags;
+};
+
+/* Request flags.  */
+#define DETRANSD_LATTICE        1       /* Decode in the lattice mode.  */
+#define DETRANSD_STATS          2       /* Reply with the statistics of the
+                                           service, the message is ignored.  */
+#define DETRANSD_FUZZY          4       /* Decode in the fuzzy mode.  */
+
+/* Bits 8-15 of the flags are the language, see DETRANS_LANG_ID; zero is
+   russian, so that old clients keep working.  */
+#define DETRANSD_LANG_SHIFT     8
+#define DETRANSD_LANG_MASK      0xff
+
+/* Longer requests are refused by closing the connection.  */
+#define DETRANSD_MAX_MESSAGE    (1 << 20)
+
+/* The socket, unless given with -s: DETRANSD_SOCKET_NAME in
+   $XDG_RUNTIME_DIR, which only the user can enter, or DETRANSD_SHARED
+   for a service shared by all the users (-a), in a directory which only
+   root, or the user running the service, can write to.  */
+#define DETRANSD_SOCKET_NAME    "detransd.socket"
+#define DETRANSD_SHARED         "/run/detransd/detransd.socket"
+
+#endif  /* __DETRANSD_H__  */
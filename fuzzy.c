@@ -0,0 +1,287 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+/* Typo-tolerant lookup of the exceptions.  A word that misses all the
+   exceptions is looked up in the dictionary of ru-special-words.def
+   (see affix.c) for a key at most FUZZY_MAX_DIST edits away from a
+   prefix of the word.  The Levenshtein automaton of the word is run in
+   lockstep with the walk down the stems, and from every stem down the
+   suffixes it takes: every byte of a key computes one row of the
+   distances between the key so far and the prefixes of the word, and a
+   subtrie is skipped as soon as all the distances in the row exceed
+   FUZZY_MAX_DIST.  Only the cells within
+   FUZZY_MAX_DIST of the diagonal can be that close, so a row costs
+   2 * FUZZY_MAX_DIST + 1 cells whatever the length of the word is.
+
+   As spell checkers do, we take the first letter to be right, which
+   leaves one subtrie of the root of the stems to search.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "detrans.h"
+#include "affix.h"
+#include "fuzzy.h"
+
+/* Distances larger than FUZZY_MAX_DIST are all the same.  */
+#define FAR             (FUZZY_MAX_DIST + 1)
+
+/* ROW[I] is the distance between the key so far and the first I bytes
+   of the word, or FAR.  Cells next to the band around the diagonal are
+   FAR as well, so that the next row can read them.  */
+typedef unsigned char row_t[FUZZY_MAX_WORD + 2];
+
+struct search
+{
+  const struct affix *dict;
+  /* Rules of the values of DICT.  */
+  const struct detrans_rule *const *rules;
+  /* The word in small letters.  */
+  char word[FUZZY_MAX_WORD];
+  size_t len;
+  /* See DETRANS_MAX_OUTPUT, a match must not give more.  */
+  size_t growth;
+  size_t steps;
+  bool cut;
+  struct fuzzy_match best;
+  /* Length of the key of BEST.  */
+  size_t best_key;
+};
+
+
+static inline size_t
+min (size_t a, size_t b)
+{
+  return a < b ? a : b;
+}
+
+/* Largest distance for a key of LEN bytes.  */
+static inline size_t
+key_dist (size_t len)
+{
+  size_t max = len >= FUZZY_MIN_KEY2 ? 2 : len >= FUZZY_MIN_KEY1 ? 1 : 0;
+
+  return min (max, FUZZY_MAX_DIST);
+}
+
+/* Compute NEXT from PREV, the row for the key of DEPTH - 1 bytes, after
+   the byte C.  Returns false if all the distances are FAR.  */
+static inline bool
+step (const struct search *s, const unsigned char *prev, unsigned char *next,
+      size_t depth, char c)
+{
+  size_t lo = depth > FUZZY_MAX_DIST ? depth - FUZZY_MAX_DIST : 0;
+  size_t hi = min (depth + FUZZY_MAX_DIST, s->len), i;
+  bool alive = false;
+
+  if (lo > s->len)
+    return false;
+
+  for (i = lo; i <= hi; i++)
+    {
+      size_t d = depth;
+
+      if (i > 0)
+        {
+          d = min (prev[i - 1] + (s->word[i - 1] != c), prev[i] + 1);
+          if (i > lo)
+            d = min (d, next[i - 1] + 1);
+        }
+
+      next[i] = min (d, FAR);
+      alive |= next[i] != FAR;
+    }
+
+  if (lo > 0)
+    next[lo - 1] = FAR;
+  if (hi < s->len)
+    next[hi + 1] = FAR;
+
+  return alive;
+}
+
+/* The key of DEPTH bytes ending here has RULE attached, and ROW is its
+   row.  Keep the closest prefix of the word, if it is close enough for
+   a key of this length.  */
+static void
+accept (struct search *s, const struct detrans_rule *rule,
+        const unsigned char *row, size_t depth)
+{
+  size_t max = key_dist (depth), i;
+  size_t lo = depth > max ? depth - max : 1;
+  size_t hi = min (depth + max, s->len);
+
+  if (rule->kind != DETRANS_RULE_WORD)
+    return;
+
+  for (i = lo; i <= hi; i++)
+    {
+      size_t skew = i > depth ? i - depth : depth - i;
+      size_t best_skew = s->best.len > s->best_key
+                         ? s->best.len - s->best_key
+                         : s->best_key - s->best.len;
+
+      if (row[i] > max || rule->repl_len > s->growth * i)
+        continue;
+
+      /* The closest, then the longest key; with the same key, the whole
+         word, then the fewest bytes inserted or deleted.  */
+      if (s->best.rule == NULL || row[i] < s->best.dist
+          || (row[i] == s->best.dist
+              && (depth > s->best_key
+                  || (depth == s->best_key
+                      && (i == s->len
+                          || (s->best.len != s->len
+                              && skew < best_skew))))))
+        {
+          s->best = (struct fuzzy_match) {rule, i, row[i]};
+          s->best_key = depth;
+        }
+    }
+}
+
+static void search_children (struct search *, const struct affix_node *,
+                             const unsigned char *, size_t,
+                             const struct affix_stem *, size_t);
+
+/* Walk the edge to the node N from the node of DEPTH with ROW.  N is a
+   stem, or a suffix of STEM if it is not NULL; the suffixes under N
+   have the numbers up to HI.  */
+static void
+search_node (struct search *s, const struct affix_node *n,
+             const unsigned char *row, size_t depth,
+             const struct affix_stem *stem, size_t hi)
+{
+  row_t rows[2];
+  const unsigned char *prev = row;
+  uint32_t value;
+  size_t i;
+
+  for (i = 0; i < n->label_len; i++)
+    {
+      unsigned char *next = rows[i & 1];
+
+      if (s->steps++ == FUZZY_BUDGET)
+        {
+          s->cut = true;
+          return;
+        }
+
+      if (!step (s, prev, next, ++depth, s->dict->text[n->label + i]))
+        return;
+      prev = next;
+    }
+
+  if (stem == NULL)
+    {
+      /* Keys made of the stem ending here, then the longer stems.  */
+      if (n->final)
+        search_node (s, &s->dict->nodes[s->dict->suffix_root], prev, depth,
+                     &s->dict->stems[n->value], s->dict->suffixes_count);
+      search_children (s, n, prev, depth, NULL, 0);
+      return;
+    }
+
+  if (n->final && affix_value (s->dict, stem, n->value, &value))
+    accept (s, s->rules[value], prev, depth);
+
+  search_children (s, n, prev, depth, stem, hi);
+}
+
+/* Search all the children of N, the node of DEPTH with ROW, see
+   SEARCH_NODE.  The depth of the recursion is at most FUZZY_MAX_WORD +
+   FUZZY_MAX_DIST, as rows get FAR after that.  The suffixes STEM does
+   not take are skipped.  */
+static void
+search_children (struct search *s, const struct affix_node *n,
+                 const unsigned char *row, size_t depth,
+                 const struct affix_stem *stem, size_t hi)
+{
+  const struct affix_node *child = &s->dict->nodes[n->children];
+  unsigned i;
+
+  for (i = 0; i < n->children_count && !s->cut; i++)
+    {
+      size_t child_hi = child[i].last ? hi : child[i + 1].value;
+
+      if (stem != NULL)
+        {
+          const struct affix_class *cls = &s->dict->classes[stem->cls];
+          const uint32_t *suffixes = &s->dict->class_suffixes[cls->start];
+          size_t k = affix_lower_bound (suffixes, cls->count, child[i].value);
+
+          if (k == cls->count || suffixes[k] >= child_hi)
+            continue;
+        }
+
+      search_node (s, &child[i], row, depth, stem, child_hi);
+    }
+}
+
+/* Most bytes of output per byte of the prefix a match of a key of
+   KEY_LEN bytes with a replacement of REPL_LEN bytes can give, rounded
+   up.  The prefix may be shorter than the key by the distance allowed,
+   so this is more than the growth of the rule itself.  */
+size_t
+fuzzy_growth (size_t key_len, size_t repl_len)
+{
+  size_t shortest = key_len > key_dist (key_len)
+                    ? key_len - key_dist (key_len) : 1;
+
+  return (repl_len + shortest - 1) / shortest;
+}
+
+/* Find the exception in DICT, with the values giving the rules in
+   RULES, closest to a prefix of WORD of length LEN.  A match must give
+   at most GROWTH bytes per byte of the prefix.  Returns false if there
+   is none within the distances above, or if the search ran out of its
+   budget; automaton steps are counted as trie probes in STATS.  */
+bool
+fuzzy_match (const struct affix *dict, const struct detrans_rule *const *rules,
+             const char *word, size_t len, size_t growth,
+             struct fuzzy_match *match, struct detrans_stats *stats)
+{
+  struct search s = {.dict = dict, .rules = rules, .len = len,
+                     .growth = growth};
+  const struct affix_node *root = dict->nodes;
+  row_t row;
+  size_t i;
+
+  /* Shorter words are too far from all the keys allowing a typo.  */
+  if (len < FUZZY_MIN_KEY1 - 1 || len > FUZZY_MAX_WORD)
+    return false;
+
+  for (i = 0; i < len; i++)
+    s.word[i] = word[i] >= 'A' && word[i] <= 'Z' ? word[i] - 'A' + 'a'
+                                                 : word[i];
+
+  for (i = 0; i <= len; i++)
+    row[i] = min (i, FAR);
+
+  stats->trie_probes++;
+  if (dict->first[(unsigned char) s.word[0]] != 0)
+    search_node (&s, &dict->nodes[root->children
+                                  + dict->first[(unsigned char) s.word[0]]
+                                  - 1],
+                 row, 0, NULL, 0);
+
+  stats->trie_probes += s.steps;
+  if (s.cut || s.best.rule == NULL)
+    return false;
+
+  *match = s.best;
+  return true;
+}
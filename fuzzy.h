@@ -0,0 +1,57 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+#ifndef __FUZZY_H__
+#define __FUZZY_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Words longer than that (in bytes) are not looked up.  */
+#define FUZZY_MAX_WORD          32
+
+/* Largest edit distance between a word and an exception.  */
+#define FUZZY_MAX_DIST          2
+
+/* Exceptions with keys of at least that many bytes may be one edit
+   away from the word, and of FUZZY_MIN_KEY2 two; shorter keys are too
+   close to other words.  */
+#define FUZZY_MIN_KEY1          8
+#define FUZZY_MIN_KEY2          16
+
+/* Steps of the automaton per word; the search gives up after that
+   many, which bounds the work per word.  */
+#define FUZZY_BUDGET            256
+
+struct affix;
+struct detrans_rule;
+struct detrans_stats;
+
+/* An exception found by FUZZY_MATCH: RULE replaces the first LEN bytes
+   of the word, which are DIST edits away from its key.  */
+struct fuzzy_match
+{
+  const struct detrans_rule *rule;
+  size_t len;
+  unsigned dist;
+};
+
+__BEGIN_DECLS
+bool fuzzy_match (const struct affix *, const struct detrans_rule *const *,
+                  const char *, size_t, size_t, struct fuzzy_match *,
+                  struct detrans_stats *);
+size_t fuzzy_growth (size_t, size_t);
+__END_DECLS
+
+#endif  /* __FUZZY_H__  */
@@ -0,0 +1,315 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+/* Lattice decoder.  Instead of committing to the longest rule at every
+   position, we collect all the rules that match at every position of
+   a word, which gives a lattice of possible segmentations, and pick the
+   best path through it with Viterbi search.  Paths are scored with a
+   trigram model of russian letters (see misc/gen-ru-ngram.py), so that
+   `shodit'' becomes `сходить' and not `шодить' without any special
+   rule.
+
+   The work per word is bounded by LATTICE_MAX_WORD * LATTICE_MAX_EDGES
+   * LATTICE_BEAM transitions.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include "detrans.h"
+#include "trie.h"
+#include "rules.h"
+#include "lattice.h"
+
+/* Boundary, 'а'..'я' and 'ё'.  */
+#define NGRAM_SYMBOLS   34
+
+/* Bonus for every character covered by an exception.  Exceptions are
+   known to be right, so they have to win over the model.  */
+#define LATTICE_WORD_BONUS      8
+
+/* Penalty for a character no rule knows about.  */
+#define LATTICE_UNKNOWN_PENALTY 40
+
+struct symbol
+{
+  const char *str;
+  const char *repl;
+};
+
+/* Small and capital russian letters.  */
+static const struct symbol ru_cap[] = {
+#define INPUT(a, b) {a, b},
+#include "ru-capital-letters.def"
+#undef INPUT
+};
+
+static const signed char ru_ngram[NGRAM_SYMBOLS * NGRAM_SYMBOLS
+                                  * NGRAM_SYMBOLS] = {
+#include "ru-ngram.def"
+};
+
+#define ngram(a, b, c) ru_ngram[((a) * NGRAM_SYMBOLS + (b)) * NGRAM_SYMBOLS + (c)]
+
+struct edge
+{
+  size_t len;
+  /* Rule, or NULL if the character is copied as is.  */
+  const struct detrans_rule *rule;
+};
+
+struct hyp
+{
+  int score;
+  /* Two last symbols produced.  */
+  unsigned char a, b;
+  /* Where did we come from.  */
+  unsigned char prev_pos, prev_hyp;
+  const struct detrans_rule *rule;
+};
+
+
+/* Model symbol of the utf-8 character at S, and its length in LEN.  */
+static inline unsigned
+ngram_symbol (const unsigned char *s, size_t *len)
+{
+  if (s[0] == 0xd0 && s[1] >= 0xb0 && s[1] <= 0xbf)
+    {
+      *len = 2;
+      return s[1] - 0xb0 + 1;
+    }
+  else if (s[0] == 0xd1 && s[1] >= 0x80 && s[1] <= 0x8f)
+    {
+      *len = 2;
+      return s[1] - 0x80 + 17;
+    }
+  else if (s[0] == 0xd1 && s[1] == 0x91)
+    {
+      *len = 2;
+      return 33;
+    }
+
+  *len = 1;
+  return 0;
+}
+
+/* Score of applying the rule of edge E after symbols *A and *B;
+   updates the symbols.  */
+static inline int
+edge_score (const struct edge *e, unsigned char *a, unsigned char *b)
+{
+  const unsigned char *s, *end;
+  int score = 0;
+
+  if (e->rule == NULL)
+    {
+      *a = *b = 0;
+      return -LATTICE_UNKNOWN_PENALTY;
+    }
+
+  if (e->rule->kind == DETRANS_RULE_WORD)
+    score += LATTICE_WORD_BONUS * e->len;
+
+  s = (const unsigned char *) e->rule->repl;
+  end = s + e->rule->repl_len;
+  while (s < end)
+    {
+      size_t len;
+      unsigned c = ngram_symbol (s, &len);
+
+      s += len;
+      if (c == 0)
+        continue;
+
+      score += ngram (*a, *b, c);
+      *a = *b;
+      *b = c;
+    }
+
+  return score;
+}
+
+/* Collect all the rules of LANG matching at the beginning of WORD of
+   length LEN.  Returns the number of edges.  */
+static size_t
+collect_edges (struct trie *trie, int lang, const char *word, size_t len,
+               struct edge *edges, struct detrans_stats *stats)
+{
+  size_t i, n = 0;
+
+  for (i = 0; i < len && trie != NULL && n < LATTICE_MAX_EDGES; )
+    {
+      struct child *child;
+      unsigned char c = word[i];
+
+      if (c >= 'A' && c <= 'Z')
+        c += 'a' - 'A';
+
+      stats->trie_probes++;
+      child = trie_search_child (trie, c);
+      if (!child
+          || (child->label_len
+              && !trie_match_label (child, &word[i + 1], len - i - 1)))
+        break;
+
+      i += child->label_len + 1;
+      if (leaf_rule (child->last, lang) != NULL)
+        edges[n++] = (struct edge)
+                     {
+                       .len = i,
+                       .rule = leaf_rule (child->last, lang)
+                     };
+      trie = child->next;
+    }
+
+  if (n == 0)
+    edges[n++] = (struct edge) {.len = 1, .rule = NULL};
+
+  return n;
+}
+
+/* Add hypothesis H to the list HYPS of length *COUNT.  We keep only the
+   best hypothesis for every pair of last symbols, and only LATTICE_BEAM
+   best hypotheses overall.  */
+static inline void
+add_hyp (struct hyp *hyps, size_t *count, struct hyp h)
+{
+  size_t i, worst = 0;
+
+  for (i = 0; i < *count; i++)
+    {
+      if (hyps[i].a == h.a && hyps[i].b == h.b)
+        {
+          if (h.score > hyps[i].score)
+            hyps[i] = h;
+          return;
+        }
+
+      if (hyps[i].score < hyps[worst].score)
+        worst = i;
+    }
+
+  if (*count < LATTICE_BEAM)
+    hyps[(*count)++] = h;
+  else if (h.score > hyps[worst].score)
+    hyps[worst] = h;
+}
+
+/* Copy the replacement of RULE to OUT, with the capital first letter
+   if CAPITAL is set.  Returns the position after the copy.  */
+static inline char *
+copy_rule (char *out, const struct detrans_rule *rule, bool capital)
+{
+  size_t i, skip = 0;
+
+  if (capital)
+    for (i = 0; i < sizeof (ru_cap) / sizeof (ru_cap[0]); i++)
+      if (!strncmp (rule->repl, ru_cap[i].str, strlen (ru_cap[i].str)))
+        {
+          skip = strlen (ru_cap[i].str);
+          memcpy (out, ru_cap[i].repl, strlen (ru_cap[i].repl));
+          out += strlen (ru_cap[i].repl);
+          break;
+        }
+
+  memcpy (out, rule->repl + skip, rule->repl_len - skip);
+  return out + rule->repl_len - skip;
+}
+
+/* Decode WORD of length LEN (at most LATTICE_MAX_WORD), made of
+   translit letters, using the rules of LANG from TRIE.  The result is written
+   to OUT without the terminating zero; a rule starting with a capital
+   letter gives a capital letter, as in the greedy mode.  Trie probes and
+   the rules applied are counted in STATS.  Returns the number of bytes
+   written.  */
+size_t
+lattice_decode_word (struct trie *trie, int lang, const char *word,
+                     size_t len, char *out, struct detrans_stats *stats)
+{
+  struct hyp hyps[LATTICE_MAX_WORD + 1][LATTICE_BEAM];
+  size_t counts[LATTICE_MAX_WORD + 1];
+  struct hyp *path[LATTICE_MAX_WORD];
+  size_t i, k, n, best;
+  char *outptr = out;
+
+  if (len == 0 || len > LATTICE_MAX_WORD)
+    return 0;
+
+  memset (counts, 0, sizeof (counts));
+  hyps[0][0] = (struct hyp) {.score = 0, .a = 0, .b = 0};
+  counts[0] = 1;
+
+  for (i = 0; i < len; i++)
+    {
+      struct edge edges[LATTICE_MAX_EDGES];
+      size_t e, edges_count;
+
+      if (counts[i] == 0)
+        continue;
+
+      edges_count = collect_edges (trie, lang, &word[i], len - i, edges,
+                                   stats);
+      for (k = 0; k < counts[i]; k++)
+        for (e = 0; e < edges_count; e++)
+          {
+            struct hyp h = hyps[i][k];
+
+            h.score += edge_score (&edges[e], &h.a, &h.b);
+            h.prev_pos = i;
+            h.prev_hyp = k;
+            h.rule = edges[e].rule;
+            add_hyp (hyps[i + edges[e].len], &counts[i + edges[e].len], h);
+          }
+    }
+
+  /* Passthrough edges make sure the end is always reachable.  */
+  for (k = best = 0; k < counts[len]; k++)
+    if (hyps[len][k].score + ngram (hyps[len][k].a, hyps[len][k].b, 0)
+        > hyps[len][best].score + ngram (hyps[len][best].a,
+                                         hyps[len][best].b, 0))
+      best = k;
+
+  /* Backtrack.  */
+  for (n = 0, i = len, k = best; i > 0; )
+    {
+      struct hyp *h = &hyps[i][k];
+
+      path[n++] = h;
+      i = h->prev_pos;
+      k = h->prev_hyp;
+    }
+
+  for (; n > 0; n--)
+    {
+      struct hyp *h = path[n - 1];
+
+      if (h->rule)
+        {
+          if (h->rule->kind == DETRANS_RULE_WORD)
+            stats->word_hits++;
+          else
+            stats->letter_hits++;
+
+          outptr = copy_rule (outptr, h->rule,
+                              word[h->prev_pos] >= 'A'
+                              && word[h->prev_pos] <= 'Z');
+        }
+      else
+        *outptr++ = word[h->prev_pos];
+    }
+
+  return outptr - out;
+}
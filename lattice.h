@@ -0,0 +1,36 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+#ifndef __LATTICE_H__
+#define __LATTICE_H__
+
+/* Words longer than that (in bytes) are decoded greedily, which
+   bounds the work per word.  */
+#define LATTICE_MAX_WORD        64
+
+/* Number of hypotheses kept at each position of the word.  */
+#define LATTICE_BEAM            8
+
+/* Maximum number of rules starting at one position.  */
+#define LATTICE_MAX_EDGES       16
+
+struct trie;
+struct detrans_stats;
+
+__BEGIN_DECLS
+size_t lattice_decode_word (struct trie *, int, const char *, size_t,
+                            char *, struct detrans_stats *);
+__END_DECLS
+
+#endif  /* __LATTICE_H__  */
@@ -0,0 +1,103 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+/* Letter rules looked up without a trie.  The keys of the letters are
+   at most a few bytes long, and most of them are one byte, so a table
+   indexed by the first byte and a short list of the longer keys give
+   the rule in one or two comparisons.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "letters.h"
+
+/* Add the rule KEY -> RULE to L; a later rule with the same key
+   replaces the earlier one.  L must be built with LETTERS_BUILD after
+   the last rule.  Returns false if the key is too long.  */
+bool
+letters_add (struct letters *l, const char *key, const struct detrans_rule *rule)
+{
+  size_t len = strlen (key), i;
+
+  if (len == 0 || len > LETTERS_MAX_KEY)
+    {
+      l->partial = true;
+      return false;
+    }
+
+  if (len == 1)
+    {
+      l->one[(unsigned char) key[0]] = rule;
+      return true;
+    }
+
+  for (i = 0; i < l->count; i++)
+    if (l->keys[i].len == len && !memcmp (l->keys[i].key, key, len))
+      {
+        l->keys[i].rule = rule;
+        return true;
+      }
+
+  if (l->count == l->size)
+    {
+      l->size = l->size ? l->size * 2 : 16;
+      l->keys = (struct letters_key *)
+                realloc (l->keys, l->size * sizeof (struct letters_key));
+    }
+
+  memset (&l->keys[l->count], 0, sizeof (struct letters_key));
+  memcpy (l->keys[l->count].key, key, len);
+  l->keys[l->count].len = len;
+  l->keys[l->count].rule = rule;
+  l->count++;
+  return true;
+}
+
+/* Helper for qsort: by the first byte, and the longest keys first.  */
+static int
+cmp_keys (const void *k1, const void *k2)
+{
+  const struct letters_key *a = (const struct letters_key *) k1;
+  const struct letters_key *b = (const struct letters_key *) k2;
+
+  if (a->key[0] != b->key[0])
+    return (unsigned char) a->key[0] - (unsigned char) b->key[0];
+
+  return b->len - a->len;
+}
+
+/* Sort the longer keys of L and index them by the first byte.  */
+void
+letters_build (struct letters *l)
+{
+  size_t i;
+  unsigned c;
+
+  qsort (l->keys, l->count, sizeof (struct letters_key), cmp_keys);
+
+  for (c = 0, i = 0; c <= 256; c++)
+    {
+      while (i < l->count && (unsigned char) l->keys[i].key[0] < c)
+        i++;
+      l->first[c] = i;
+    }
+}
+
+void
+letters_free (struct letters *l)
+{
+  free (l->keys);
+  memset (l, 0, sizeof (struct letters));
+}
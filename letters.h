@@ -0,0 +1,109 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+#ifndef __LETTERS_H__
+#define __LETTERS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "utf8.h"
+
+/* Longest key of a letter rule, in bytes.  */
+#define LETTERS_MAX_KEY         4
+
+struct detrans_rule;
+
+struct letters_key
+{
+  char key[LETTERS_MAX_KEY];
+  unsigned char len;
+  const struct detrans_rule *rule;
+};
+
+/* Letter rules of a language, looked up directly by the first byte of
+   the key.  Keys of one byte are in ONE; the longer keys starting with
+   the byte C are KEYS[FIRST[C]] to KEYS[FIRST[C + 1]], the longest
+   first.  PARTIAL is set if some key was too long to be added.  */
+struct letters
+{
+  const struct detrans_rule *one[256];
+  unsigned short first[257];
+  struct letters_key *keys;
+  size_t count, size;
+  bool partial;
+};
+
+__BEGIN_DECLS
+bool letters_add (struct letters *, const char *, const struct detrans_rule *);
+void letters_build (struct letters *);
+void letters_free (struct letters *);
+__END_DECLS
+
+/* Whether no letter rule starts with the byte C, in any case.  */
+static inline bool
+letters_none (const struct letters *l, unsigned char c)
+{
+  if (c < 0x80)
+    c = ascii_lower (c);
+
+  return !utf8_may_fold (c) && l->first[c] == l->first[c + 1]
+         && l->one[c] == NULL;
+}
+
+/* The letter rule with the longest key at the beginning of S of length
+   LEN, with the letters of S in any case, in *RULE.  Returns the length
+   of the key, or 0 and NULL if there is none.  */
+static inline size_t
+letters_match (const struct letters *l, const char *s, size_t len,
+               const struct detrans_rule **rule)
+{
+  char buf[LETTERS_MAX_KEY + UTF8_MAX];
+  size_t i, n;
+  unsigned c = (unsigned char) s[0];
+
+  /* Most bytes start no longer key: the other letters and the bytes of
+     cyrillic text are looked up right away.  */
+  if (c < 0x80)
+    c = ascii_lower (c);
+  if (!utf8_may_fold (c) && l->first[c] == l->first[c + 1])
+    {
+      *rule = l->one[c];
+      return *rule != NULL;
+    }
+
+  /* The longer keys are compared with the small letters in BUF.  */
+  for (n = 0; n < len && n < LETTERS_MAX_KEY; )
+    if ((unsigned char) s[n] < 0x80)
+      {
+        buf[n] = ascii_lower (s[n]);
+        n++;
+      }
+    else
+      n += utf8_lower (s + n, len - n, buf + n);
+
+  c = (unsigned char) buf[0];
+  for (i = l->first[c]; i < l->first[c + 1]; i++)
+    if (l->keys[i].len <= n && !memcmp (l->keys[i].key, buf, l->keys[i].len))
+      {
+        *rule = l->keys[i].rule;
+        return l->keys[i].len;
+      }
+
+  *rule = l->one[c];
+  return *rule != NULL;
+}
+
+#endif  /* __LETTERS_H__  */
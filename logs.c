@@ -0,0 +1,202 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+/* De-transliteration of the existing purple logs.  This knows nothing
+   about purple, the plugin finds the files and runs LOGS_RUN on a
+   worker thread.  Both html and plain text loggers write a message per
+   line:
+
+     <font color="#A82F2F"><font size="2">(12:34:56)</font> <b>buddy:</b></font> text<br/>
+     (12:34:56) buddy: text
+
+   so a line is converted when the name after the timestamp is one of
+   the names of the buddy.  In plain text logs, multi-line messages go
+   on without a timestamp; such lines belong to the previous message.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "detrans.h"
+#include "logs.h"
+
+#define atomic_add(field, value) \
+  __atomic_fetch_add (&(field), (value), __ATOMIC_RELAXED)
+
+/* Skip html tags and spaces.  */
+static const char *
+skip_tags (const char *s)
+{
+  for (;;)
+    if (*s == ' ')
+      s++;
+    else if (*s == '<' && strchr (s, '>'))
+      s = strchr (s, '>') + 1;
+    else
+      return s;
+}
+
+/* Find the text of the message in LINE.  Returns NULL if LINE has no
+   timestamp, otherwise sets *FROM_BUDDY to whether the message is from
+   one of NAMES.  */
+static const char *
+message_text (const char *line, char **names, bool *from_buddy)
+{
+  const char *s = skip_tags (line);
+  size_t i;
+
+  if (*s != '(' || (s = strchr (s, ')')) == NULL)
+    return NULL;
+
+  *from_buddy = false;
+  s = skip_tags (s + 1);
+  for (i = 0; names[i] != NULL; i++)
+    {
+      size_t len = strlen (names[i]);
+
+      if (!strncmp (s, names[i], len) && s[len] == ':')
+        {
+          *from_buddy = true;
+          return skip_tags (s + len + 1);
+        }
+    }
+
+  return s;
+}
+
+/* Write TEXT of length LEN to OUT with the edits made by detrans.  The
+   unchanged pieces go straight from TEXT, nothing is copied.  */
+static void
+write_detrans (FILE *out, struct detrans_edits *edits, const char *text,
+               size_t len)
+{
+  size_t i, n = detrans_edits (edits, text, len), pos = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      fwrite (text + pos, 1, edits->edit[i].offset - pos, out);
+      fwrite (edits->edit[i].repl, 1, edits->edit[i].repl_len, out);
+      pos = edits->edit[i].offset + edits->edit[i].len;
+    }
+
+  fwrite (text + pos, 1, len - pos, out);
+}
+
+/* Convert the log in PATH with EDITS.  Returns false on error.  */
+static bool
+convert_file (struct logs_job *job, struct detrans_edits *edits,
+              const char *path)
+{
+  char *tmp, *line = NULL;
+  size_t line_size = 0;
+  bool in_message = false, ok = true;
+  ssize_t len;
+  FILE *in, *out;
+
+  if ((in = fopen (path, "r")) == NULL)
+    return false;
+
+  tmp = (char *) malloc (strlen (path) + sizeof (LOGS_SUFFIX));
+  sprintf (tmp, "%s%s", path, job->in_place ? ".tmp" : LOGS_SUFFIX);
+  if ((out = fopen (tmp, "w")) == NULL)
+    {
+      free (tmp);
+      fclose (in);
+      return false;
+    }
+
+  while (!__atomic_load_n (&job->cancel, __ATOMIC_RELAXED)
+         && (len = getline (&line, &line_size, in)) != -1)
+    {
+      const char *text = message_text (line, job->names, &in_message);
+
+      /* Continuation of a multi-line message.  */
+      if (text == NULL)
+        text = in_message ? line : NULL;
+
+      if (in_message && text != NULL && *text != '\0'
+          && (!job->classify
+              || detrans_is_translit (text, line + len - text)))
+        {
+          fwrite (line, 1, text - line, out);
+          write_detrans (out, edits, text, line + len - text);
+          atomic_add (job->lines_converted, 1);
+        }
+      else
+        fwrite (line, 1, len, out);
+
+      atomic_add (job->bytes_done, len);
+    }
+
+  ok = !ferror (in) && !ferror (out);
+  ok &= fclose (out) == 0;
+  fclose (in);
+  free (line);
+
+  if (ok && job->in_place && !__atomic_load_n (&job->cancel, __ATOMIC_RELAXED))
+    ok = rename (tmp, path) == 0;
+  else if (!ok || job->in_place)
+    remove (tmp);
+
+  free (tmp);
+  return ok;
+}
+
+/* Convert all the logs of JOB.  The same edit list is used for all the
+   messages, so memory is allocated only when a message is longer than
+   all the previous ones.  */
+void
+logs_run (struct logs_job *job)
+{
+  struct detrans_edits edits = DETRANS_EDITS_INIT;
+  size_t i;
+
+  for (i = 0; i < job->count; i++)
+    {
+      struct stat st;
+
+      if (stat (job->paths[i], &st) == 0)
+        atomic_add (job->bytes_total, st.st_size);
+    }
+
+  for (i = 0; i < job->count; i++)
+    {
+      if (__atomic_load_n (&job->cancel, __ATOMIC_RELAXED))
+        break;
+
+      if (!convert_file (job, &edits, job->paths[i]))
+        atomic_add (job->errors, 1);
+      atomic_add (job->files_done, 1);
+    }
+
+  detrans_edits_free (&edits);
+  __atomic_store_n (&job->done, true, __ATOMIC_RELEASE);
+}
+
+void
+logs_job_free (struct logs_job *job)
+{
+  size_t i;
+
+  for (i = 0; i < job->count; i++)
+    free (job->paths[i]);
+  for (i = 0; job->names && job->names[i]; i++)
+    free (job->names[i]);
+
+  free (job->paths);
+  free (job->names);
+  free (job);
+}
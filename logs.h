@@ -0,0 +1,54 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+#ifndef __LOGS_H__
+#define __LOGS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Converted copies of the logs are written next to them, with this
+   suffix added.  */
+#define LOGS_SUFFIX             ".detrans"
+
+/* A conversion of the log files of one buddy, see logs.c.  */
+struct logs_job
+{
+  /* Set by the caller.  */
+  char **paths;
+  size_t count;
+  /* Names the buddy appears under in the logs, NULL-terminated.  */
+  char **names;
+  /* Rewrite the logs instead of writing the copies.  */
+  bool in_place;
+  /* Skip the messages that don't look like translit.  */
+  bool classify;
+
+  /* Progress, updated by LOGS_RUN and readable from other threads with
+     __atomic_load_n.  */
+  size_t files_done, errors;
+  uint64_t lines_converted, bytes_done, bytes_total;
+  bool done;
+
+  /* Set to stop LOGS_RUN as soon as possible.  */
+  bool cancel;
+};
+
+__BEGIN_DECLS
+void logs_run (struct logs_job *);
+void logs_job_free (struct logs_job *);
+__END_DECLS
+
+#endif  /* __LOGS_H__  */
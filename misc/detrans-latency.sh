@@ -0,0 +1,87 @@
+#!/bin/sh
+# Latency distributions from the static probes of detrans (see probes.h)
+# with bpftrace.  OBJECT is the file with the probes: translit.so for
+# pidgin, weechat-detrans.so, detransd, or a program linked with
+# libdetrans; PID limits the tracing to one process running it.  Ctrl-C
+# prints the histograms, in microseconds: per plugin for the whole
+# handling of a message, and per language for detrans itself.
+#
+#   sudo misc/detrans-latency.sh OBJECT [PID]
+
+if [ $# -lt 1 ]; then
+  echo "usage: $0 object [pid]" >&2
+  exit 1
+fi
+
+obj=$1
+pid=${2:+-p $2}
+probes=$(bpftrace -l "usdt:$obj:detrans:*")
+
+if [ -z "$probes" ]; then
+  echo "$0: no detrans probes in $obj, was it built with sys/sdt.h?" >&2
+  exit 1
+fi
+
+# The plugin probes are not in detransd.
+has ()
+{
+  echo "$probes" | grep -q ":$1\$"
+}
+
+{
+  if has plugin__message__start; then
+    cat <<END
+usdt:$obj:detrans:plugin__message__start
+{
+  @plugin_start[tid] = nsecs;
+}
+
+usdt:$obj:detrans:plugin__message__done
+/@plugin_start[tid]/
+{
+  @plugin_us[str(arg0)] = hist((nsecs - @plugin_start[tid]) / 1000);
+  delete(@plugin_start[tid]);
+}
+
+usdt:$obj:detrans:plugin__user__lookup
+{
+  @lookups[str(arg0), arg2 ? "flagged" : "other"] = count();
+}
+
+END
+  fi
+
+  cat <<END
+usdt:$obj:detrans:message__start
+{
+  @start[tid] = nsecs;
+  @lang[tid] = str(arg0);
+  @bytes = hist(arg1);
+}
+
+usdt:$obj:detrans:message__done
+/@start[tid]/
+{
+  @detrans_us[@lang[tid]] = hist((nsecs - @start[tid]) / 1000);
+  delete(@start[tid]);
+  delete(@lang[tid]);
+}
+
+usdt:$obj:detrans:rules__load__start
+{
+  @load_start[tid] = nsecs;
+}
+
+usdt:$obj:detrans:rules__load__done
+/@load_start[tid]/
+{
+  printf("rules loaded: %d rules in %d us\n", arg0,
+         (nsecs - @load_start[tid]) / 1000);
+  delete(@load_start[tid]);
+}
+
+END
+} > "${TMPDIR:-/tmp}/detrans-latency.$$.bt"
+
+trap 'rm -f "${TMPDIR:-/tmp}/detrans-latency.$$.bt"' EXIT
+bpftrace $pid "${TMPDIR:-/tmp}/detrans-latency.$$.bt"
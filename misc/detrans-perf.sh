@@ -0,0 +1,68 @@
+#!/bin/sh
+# Latency distributions from the static probes of detrans (see probes.h)
+# with perf, where bpftrace is not available.  Records the probes of
+# OBJECT (as in detrans-latency.sh) in all the processes for SECONDS,
+# then prints the histograms of the time between the start and the end
+# of every message, in microseconds, for detrans and for the plugin.
+#
+#   sudo misc/detrans-perf.sh OBJECT [SECONDS]
+
+if [ $# -lt 1 ]; then
+  echo "usage: $0 object [seconds]" >&2
+  exit 1
+fi
+
+obj=$1
+seconds=${2:-30}
+data=${TMPDIR:-/tmp}/detrans-perf.$$.data
+
+perf buildid-cache --add "$obj" || exit 1
+events=
+for p in message__start message__done \
+         plugin__message__start plugin__message__done; do
+  if perf probe -q -x "$obj" -a "%sdt_detrans:$p" 2>/dev/null; then
+    events="$events -e sdt_detrans:$p"
+  fi
+done
+
+if [ -z "$events" ]; then
+  echo "$0: no detrans probes in $obj, was it built with sys/sdt.h?" >&2
+  exit 1
+fi
+
+trap 'perf probe -q -d "sdt_detrans:*"; rm -f "$data"' EXIT
+perf record -q -a -o "$data" $events -- sleep "$seconds"
+
+# Pair the starts and the ends on the same thread and count the
+# latencies in power of two buckets.
+perf script -i "$data" -F tid,time,event | awk '
+  {
+    tid = $1; time = $2; event = $3;
+    sub (/:$/, "", time);
+    sub (/:$/, "", event);
+    sub (/^sdt_detrans:/, "", event);
+    what = event;
+    sub (/__(start|done)$/, "", what);
+
+    if (event ~ /__start$/)
+      start[tid, what] = time;
+    else if ((tid, what) in start)
+      {
+        us = (time - start[tid, what]) * 1000000;
+        for (b = 1; b <= us; b *= 2)
+          ;
+        hist[what, b]++;
+        if (b > max[what])
+          max[what] = b;
+        delete start[tid, what];
+      }
+  }
+
+  END {
+    for (what in max)
+      {
+        printf ("%s, us:\n", what);
+        for (b = 1; b <= max[what]; b *= 2)
+          printf ("  < %8d  %d\n", b, hist[what, b]);
+      }
+  }'
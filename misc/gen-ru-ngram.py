@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Generate ru-ngram.def -- a table of quantized conditional log-
+# probabilities of russian letters given two previous letters.
+#
+#   misc/gen-ru-ngram.py > ru-ngram.def
+#
+# The model is trained on misc/ru-words.txt.  Symbols are the word
+# boundary, 'а'..'я' and 'ё'.
+
+import math
+import os
+
+here = os.path.dirname (os.path.abspath (__file__))
+
+ALPHABET = "_" + "".join (chr (c) for c in range (ord ('а'), ord ('я') + 1)) + "ё"
+N = len (ALPHABET)
+
+# Weights of the trigram, bigram and unigram estimates.
+L3, L2, L1 = 0.7, 0.25, 0.05
+
+# Quantization: one unit is a quarter of nat.
+SCALE = 4
+
+def sym (c):
+        i = ALPHABET.find (c)
+        return i if i > 0 else 0
+
+c3 = [0] * (N * N * N)
+c2 = [0] * (N * N)
+c1 = [0] * N
+for w in open (os.path.join (here, "ru-words.txt"), encoding='utf-8'):
+        w = w.strip ().lower ()
+        if not w:
+                continue
+        s = [0, 0] + [sym (c) for c in w] + [0]
+        for i in range (2, len (s)):
+                c3[(s[i-2] * N + s[i-1]) * N + s[i]] += 1
+                c2[s[i-1] * N + s[i]] += 1
+                c1[s[i]] += 1
+
+h2 = [0] * (N * N)
+h1 = [0] * N
+for i in range (N * N * N):
+        h2[i // N] += c3[i]
+for i in range (N * N):
+        h1[i // N] += c2[i]
+total = sum (c1)
+
+print ("""/* Generated by misc/gen-ru-ngram.py, do not edit.
+
+   Log-probabilities of a russian letter given two previous ones,
+   quantized to quarters of nat.  Symbols are boundary, 'а'..'я' and
+   'ё'; rows are indexed by the two previous symbols.  */
+""")
+
+for a in range (N):
+        for b in range (N):
+                row = []
+                for c in range (N):
+                        i = (a * N + b) * N + c
+                        p3 = c3[i] / h2[a * N + b] if h2[a * N + b] else 0
+                        p2 = c2[b * N + c] / h1[b] if h1[b] else 0
+                        p1 = (c1[c] + 1) / (total + N)
+                        q = int (round (math.log (L3 * p3 + L2 * p2 + L1 * p1)
+                                        * SCALE))
+                        row.append (str (max (-127, q)))
+                print ("/* %s%s */ %s," % (ALPHABET[a], ALPHABET[b],
+                                           ", ".join (row)))
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Generate translit-model.def -- a table of quantized log-likelihood
+# ratios of character trigrams in russian translit against english.
+#
+#   misc/gen-translit-model.py > translit-model.def
+#
+# The russian side is misc/ru-words.txt transliterated with
+# ru-translit.def and once more with the first variants from
+# ru-replacement.def (people do write "x" for "х"), the english
+# side is misc/en-words.txt.  Symbols
+# are 'a'..'z' and the apostrophe; everything else is a word boundary.
+#
+# Every HOLDOUT-th word of both lists is left out of the model, so that
+# `detrans-bench classify' measures the accuracy on words it has not
+# seen.
+
+import math
+import os
+import re
+import sys
+
+here = os.path.dirname (os.path.abspath (__file__))
+top = os.path.dirname (here)
+
+ALPHABET = "_abcdefghijklmnopqrstuvwxyz'"
+N = len (ALPHABET)
+
+# Weights of the trigram, bigram and unigram estimates.
+L3, L2, L1 = 0.6, 0.3, 0.1
+
+# Quantization: one unit is a quarter of nat.
+SCALE = 4
+
+# Words left out of the model, as HOLDOUT in detrans-bench.c.
+HOLDOUT = 10
+
+def sym (c):
+        i = ALPHABET.find (c)
+        return i if i > 0 else 0
+
+def translit_table (fname):
+        tab = {}
+        for l in open (os.path.join (top, fname), encoding='utf-8'):
+                m = re.match (r'INPUT \("(.*?)", "(.*?)"\)', l)
+                if m and m.group (2) not in tab:
+                        tab[m.group (2)] = m.group (1)
+        return tab
+
+def training_words (fname):
+        words = (w.strip ().lower ()
+                 for w in open (os.path.join (here, fname), encoding='utf-8'))
+        for i, w in enumerate (w for w in words if w):
+                if i % HOLDOUT != HOLDOUT - 1:
+                        yield w
+
+def ru_words ():
+        tabs = [translit_table ("ru-translit.def"),
+                translit_table ("ru-replacement.def")]
+        for w in training_words ("ru-words.txt"):
+                for tab in tabs:
+                        if w and all (c in tab for c in w):
+                                yield "".join (tab[c] for c in w)
+
+def en_words ():
+        return training_words ("en-words.txt")
+
+def model (words):
+        c3 = [0] * (N * N * N)
+        c2 = [0] * (N * N)
+        c1 = [0] * N
+        for w in words:
+                s = [0, 0] + [sym (c) for c in w] + [0]
+                for i in range (2, len (s)):
+                        c3[(s[i-2] * N + s[i-1]) * N + s[i]] += 1
+                        c2[s[i-1] * N + s[i]] += 1
+                        c1[s[i]] += 1
+        h2 = [0] * (N * N)
+        h1 = [0] * N
+        for i in range (N * N * N):
+                h2[i // N] += c3[i]
+        for i in range (N * N):
+                h1[i // N] += c2[i]
+        total = sum (c1)
+        p = [0.0] * (N * N * N)
+        for a in range (N):
+                for b in range (N):
+                        for c in range (N):
+                                i = (a * N + b) * N + c
+                                p3 = c3[i] / h2[a * N + b] if h2[a * N + b] else 0
+                                p2 = c2[b * N + c] / h1[b] if h1[b] else 0
+                                p1 = (c1[c] + 1) / (total + N)
+                                p[i] = math.log (L3 * p3 + L2 * p2 + L1 * p1)
+        return p
+
+ru = model (ru_words ())
+en = model (en_words ())
+
+print ("""/* Generated by misc/gen-translit-model.py, do not edit.
+
+   Log-likelihood ratios of russian translit against english for
+   character trigrams, quantized to quarters of nat.  Symbols are
+   boundary, 'a'..'z' and the apostrophe; rows are indexed by the
+   first two symbols of the trigram.  */
+""")
+
+for a in range (N):
+        for b in range (N):
+                row = []
+                for c in range (N):
+                        i = (a * N + b) * N + c
+                        q = int (round ((ru[i] - en[i]) * SCALE))
+                        row.append (str (max (-127, min (127, q))))
+                print ("/* %s%s */ %s," % (ALPHABET[a], ALPHABET[b],
+                                           ", ".join (row)))
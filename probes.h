@@ -0,0 +1,49 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+#ifndef __PROBES_H__
+#define __PROBES_H__
+
+/* Static probes (USDT) of the provider `detrans', for bpftrace, perf or
+   systemtap to attach to, see misc/detrans-latency.sh.  A probe is a
+   nop in the code and a note in the binary, but its arguments are still
+   evaluated into registers while no tracer is attached, so pass values
+   the code has computed anyway (never a strlen just for the probe).
+   Without sys/sdt.h (or with `make SDT=no') the probes are not compiled
+   in, and their arguments are not evaluated.
+
+   detrans:
+     message__start (lang, len, mode)        detrans_into begins
+     message__done (len, out_len)            and ends
+     rules__load__start ()                   detrans_init begins
+     rules__load__done (rules, growth)       and ends
+     plugin__message__start (plugin, len)    a plugin gets a message
+     plugin__message__done (plugin, out_len) and gives it back
+     plugin__user__lookup (plugin, user, found)
+
+   Strings are passed as pointers, PLUGIN is "pidgin" or "weechat".  */
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define DETRANS_PROBE(name)  DTRACE_PROBE (detrans, name)
+#define DETRANS_PROBE2(name, a, b)  DTRACE_PROBE2 (detrans, name, a, b)
+#define DETRANS_PROBE3(name, a, b, c)  DTRACE_PROBE3 (detrans, name, a, b, c)
+#else
+#define DETRANS_PROBE(name)  do { } while (0)
+#define DETRANS_PROBE2(name, a, b)  do { } while (0)
+#define DETRANS_PROBE3(name, a, b, c)  do { } while (0)
+#endif
+
+#endif  /* __PROBES_H__  */
@@ -0,0 +1,43 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+
+#ifndef __RULES_H__
+#define __RULES_H__
+
+#include <sys/types.h>
+
+#include "detrans.h"
+#include "trie.h"
+
+/* Rules attached to the leaves of a trie.  The default trie keeps the
+   rules of all the languages for a key in one leaf, an array indexed by
+   the number of the language, so that the languages share the nodes
+   for the common prefixes.  The tries given to DETRANS_WITH_TRIE have
+   one rule in a leaf, which is RULES_PLAIN.  */
+#define RULES_PLAIN     (-1)
+
+/* The rule of the language LANG at the leaf LAST, or NULL.  */
+static inline const struct detrans_rule *
+leaf_rule (ssize_t last, int lang)
+{
+  if (last == TRIE_NOT_LAST)
+    return NULL;
+
+  return lang == RULES_PLAIN
+         ? (const struct detrans_rule *) last
+         : ((const struct detrans_rule *const *) last)[lang];
+}
+
+#endif  /* __RULES_H__  */
@@ -0,0 +1,203 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+
+/* Splitting of a message into spans of text, html tags, entities and
+   URLs, so that the matcher runs only over the text and the rest is
+   copied in one go.
+
+     tag      `<' up to and including `>', or up to the end;
+     entity   `&', up to SPAN_MAX_ENTITY - 2 letters, digits or `#', `;';
+              a lone `&' is text;
+     URL      `http://', `https://' or `www.' at the beginning of a word,
+              up to a space, `<', `>' or `"'; trailing punctuation and a
+              `)' without a matching `(' are not a part of it, so that
+              `(see www.ya.ru).' or a URL at the end of a line doesn't
+              swallow the text after it.
+
+   The text is scanned for the bytes that may start something else
+   (`<', `&', and `:' or `.' that may end the beginning of a URL) 16
+   bytes at a time with SSE2; they are rare in chat messages, so most of
+   the text is skipped without looking at every byte.  */
+
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "span.h"
+
+static inline bool
+is_special (char c)
+{
+  return c == '<' || c == '&' || c == ':' || c == '.';
+}
+
+/* Index of the first special byte in S of length LEN, or LEN.  */
+static inline size_t
+scan_special (const char *s, size_t len)
+{
+  size_t i = 0;
+
+#ifdef __SSE2__
+  for (; i + 16 <= len; i += 16)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (s + i));
+      __m128i m = _mm_or_si128
+                    (_mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('<')),
+                                   _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('&'))),
+                     _mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 (':')),
+                                   _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('.'))));
+      unsigned mask = _mm_movemask_epi8 (m);
+
+      if (mask)
+        return i + __builtin_ctz (mask);
+    }
+#endif
+
+  for (; i < len; i++)
+    if (is_special (s[i]))
+      break;
+
+  return i;
+}
+
+static inline bool
+has_prefix (const char *s, const char *end, const char *prefix, size_t len)
+{
+  return (size_t) (end - s) >= len && !memcmp (s, prefix, len);
+}
+
+/* Length of the entity at S, or 0.  */
+static inline size_t
+entity_length (const char *s, const char *end)
+{
+  size_t i;
+
+  for (i = 1; i < SPAN_MAX_ENTITY && s + i < end; i++)
+    if (s[i] == ';')
+      return i > 1 ? i + 1 : 0;
+    else if (!isalnum ((unsigned char) s[i]) && s[i] != '#')
+      return 0;
+
+  return 0;
+}
+
+/* Whether a URL starts at S, which is in the message starting at
+   BEGIN.  */
+static inline bool
+url_starts (const char *begin, const char *s, const char *end)
+{
+  if (s > begin && isalnum ((unsigned char) s[-1]))
+    return false;
+
+  return has_prefix (s, end, "http://", 7) || has_prefix (s, end, "https://", 8)
+         || has_prefix (s, end, "www.", 4);
+}
+
+static inline size_t
+url_length (const char *s, const char *end)
+{
+  const char *p = s;
+  size_t open = 0, close = 0;
+
+  while (p < end && !isspace ((unsigned char) *p)
+         && *p != '<' && *p != '>' && *p != '"')
+    {
+      open += *p == '(';
+      close += *p == ')';
+      p++;
+    }
+
+  while (p > s && (memchr (".,;:!?", p[-1], 6)
+                   || (p[-1] == ')' && close > open)))
+    close -= *--p == ')';
+
+  return p - s;
+}
+
+/* Beginning of a URL or an entity ending text at S, where the special
+   byte at S is; NULL if there is none.  */
+static inline const char *
+text_stop (const char *begin, const char *s, const char *end)
+{
+  switch (*s)
+    {
+    case '<':
+      return s;
+    case '&':
+      return entity_length (s, end) ? s : NULL;
+    case ':':
+      if (s - 5 >= begin && url_starts (begin, s - 5, end))
+        return s - 5;
+      if (s - 4 >= begin && url_starts (begin, s - 4, end))
+        return s - 4;
+      return NULL;
+    case '.':
+      if (s - 3 >= begin && url_starts (begin, s - 3, end))
+        return s - 3;
+      return NULL;
+    default:
+      return NULL;
+    }
+}
+
+/* Find the span starting at S in the message from BEGIN to END, set
+   *KIND to its kind and return its length.  */
+size_t
+span_next (const char *begin, const char *s, const char *end,
+           enum span_kind *kind)
+{
+  const char *p, *stop;
+  size_t len;
+
+  if (*s == '<')
+    {
+      *kind = SPAN_TAG;
+      p = (const char *) memchr (s, '>', end - s);
+      return p ? (size_t) (p - s + 1) : (size_t) (end - s);
+    }
+
+  if (*s == '&' && (len = entity_length (s, end)) != 0)
+    {
+      *kind = SPAN_ENTITY;
+      return len;
+    }
+
+  if (url_starts (begin, s, end) && (len = url_length (s, end)) != 0)
+    {
+      *kind = SPAN_URL;
+      return len;
+    }
+
+  /* Text, up to the beginning of the next span of another kind.  The
+     first byte is text, whatever it is.  */
+  *kind = SPAN_TEXT;
+  for (p = s + 1; p < end; p++)
+    {
+      p += scan_special (p, end - p);
+      if (p == end)
+        break;
+
+      /* A URL starting before S is not a URL: S is not the beginning
+         of a word then.  */
+      if ((stop = text_stop (begin, p, end)) != NULL && stop > s)
+        return stop - s;
+    }
+
+  return end - s;
+}
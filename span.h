@@ -0,0 +1,38 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+
+#ifndef __SPAN_H__
+#define __SPAN_H__
+
+#include <stddef.h>
+
+/* Kinds of the pieces of a message, see span.c.  Only text is
+   de-transliterated, the rest is copied as is.  */
+enum span_kind
+{
+  SPAN_TEXT,
+  SPAN_TAG,
+  SPAN_ENTITY,
+  SPAN_URL
+};
+
+/* Longest entity we recognise, `&' and `;' included.  */
+#define SPAN_MAX_ENTITY         32
+
+__BEGIN_DECLS
+size_t span_next (const char *, const char *, const char *, enum span_kind *);
+__END_DECLS
+
+#endif  /* __SPAN_H__  */
@@ -0,0 +1,164 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+/* Runtime statistics of the engine.  The counters are updated with
+   relaxed atomic additions, once per call, so they are cheap enough
+   to be always on, and the engine may be used from several threads.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "detrans.h"
+#include "stats.h"
+
+static struct detrans_stats detrans_stats;
+
+#define stats_add(field, value) \
+  __atomic_fetch_add (&(field), (value), __ATOMIC_RELAXED)
+
+#define stats_load(field) \
+  __atomic_load_n (&(field), __ATOMIC_RELAXED)
+
+
+/* Monotonic time in nanoseconds.  */
+uint64_t
+stats_now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Add the counters of one call S, which started at START, to the global
+   statistics.  */
+void
+stats_account (const struct detrans_stats *s, uint64_t start)
+{
+  uint64_t ns = stats_now () - start;
+  unsigned bucket = ns ? 63 - __builtin_clzll (ns) : 0;
+
+  if (bucket >= DETRANS_LATENCY_BUCKETS)
+    bucket = DETRANS_LATENCY_BUCKETS - 1;
+
+  stats_add (detrans_stats.messages, 1);
+  stats_add (detrans_stats.bytes_in, s->bytes_in);
+  stats_add (detrans_stats.bytes_out, s->bytes_out);
+  stats_add (detrans_stats.trie_probes, s->trie_probes);
+  stats_add (detrans_stats.word_hits, s->word_hits);
+  stats_add (detrans_stats.letter_hits, s->letter_hits);
+  stats_add (detrans_stats.passthrough, s->passthrough);
+  stats_add (detrans_stats.fuzzy_hits, s->fuzzy_hits);
+  stats_add (detrans_stats.latency[bucket], 1);
+}
+
+
+/* Copy the current statistics to S.  */
+void
+detrans_stats_get (struct detrans_stats *s)
+{
+  size_t i;
+
+  s->messages = stats_load (detrans_stats.messages);
+  s->bytes_in = stats_load (detrans_stats.bytes_in);
+  s->bytes_out = stats_load (detrans_stats.bytes_out);
+  s->trie_probes = stats_load (detrans_stats.trie_probes);
+  s->word_hits = stats_load (detrans_stats.word_hits);
+  s->letter_hits = stats_load (detrans_stats.letter_hits);
+  s->passthrough = stats_load (detrans_stats.passthrough);
+  s->fuzzy_hits = stats_load (detrans_stats.fuzzy_hits);
+  for (i = 0; i < DETRANS_LATENCY_BUCKETS; i++)
+    s->latency[i] = stats_load (detrans_stats.latency[i]);
+}
+
+void
+detrans_stats_reset ()
+{
+  size_t i;
+
+  __atomic_store_n (&detrans_stats.messages, 0, __ATOMIC_RELAXED);
+  __atomic_store_n (&detrans_stats.bytes_in, 0, __ATOMIC_RELAXED);
+  __atomic_store_n (&detrans_stats.bytes_out, 0, __ATOMIC_RELAXED);
+  __atomic_store_n (&detrans_stats.trie_probes, 0, __ATOMIC_RELAXED);
+  __atomic_store_n (&detrans_stats.word_hits, 0, __ATOMIC_RELAXED);
+  __atomic_store_n (&detrans_stats.letter_hits, 0, __ATOMIC_RELAXED);
+  __atomic_store_n (&detrans_stats.passthrough, 0, __ATOMIC_RELAXED);
+  __atomic_store_n (&detrans_stats.fuzzy_hits, 0, __ATOMIC_RELAXED);
+  for (i = 0; i < DETRANS_LATENCY_BUCKETS; i++)
+    __atomic_store_n (&detrans_stats.latency[i], 0, __ATOMIC_RELAXED);
+}
+
+
+/* Print NS nanoseconds to BUF in a human-friendly unit.  */
+static void
+format_time (char *buf, size_t size, uint64_t ns)
+{
+  if (ns < 1000)
+    snprintf (buf, size, "%lluns", (unsigned long long) ns);
+  else if (ns < 1000000)
+    snprintf (buf, size, "%lluus", (unsigned long long) ns / 1000);
+  else if (ns < 1000000000)
+    snprintf (buf, size, "%llums", (unsigned long long) ns / 1000000);
+  else
+    snprintf (buf, size, "%llus", (unsigned long long) ns / 1000000000);
+}
+
+/* Human-readable report of the statistics.  The string is allocated
+   with malloc.  */
+char *
+detrans_stats_string ()
+{
+  struct detrans_stats s;
+  char *ret = NULL;
+  size_t size = 0, i;
+  FILE *f;
+
+  detrans_stats_get (&s);
+  if ((f = open_memstream (&ret, &size)) == NULL)
+    return NULL;
+
+  fprintf (f, "messages: %llu\n", (unsigned long long) s.messages);
+  fprintf (f, "bytes: %llu in, %llu out\n",
+           (unsigned long long) s.bytes_in, (unsigned long long) s.bytes_out);
+  fprintf (f, "trie probes: %llu (%.2f per byte)\n",
+           (unsigned long long) s.trie_probes,
+           s.bytes_in ? (double) s.trie_probes / s.bytes_in : 0.0);
+  fprintf (f, "rule hits: %llu special words, %llu letters\n",
+           (unsigned long long) s.word_hits,
+           (unsigned long long) s.letter_hits);
+  if (s.fuzzy_hits != 0)
+    fprintf (f, "special words with typos: %llu\n",
+             (unsigned long long) s.fuzzy_hits);
+  if (s.passthrough != 0)
+    fprintf (f, "too long, passed through: %llu\n",
+             (unsigned long long) s.passthrough);
+  fprintf (f, "latency:");
+
+  for (i = 0; i < DETRANS_LATENCY_BUCKETS; i++)
+    if (s.latency[i] != 0)
+      {
+        char lo[16], hi[16];
+
+        format_time (lo, sizeof (lo), i ? 1ULL << i : 0);
+        format_time (hi, sizeof (hi), 1ULL << (i + 1));
+        fprintf (f, "\n  %6s - %-6s %llu", lo, hi,
+                 (unsigned long long) s.latency[i]);
+      }
+
+  fclose (f);
+  return ret;
+}
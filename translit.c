@@ -23,6 +23,7 @@
 #define PLUGIN_STATIC_NAME       "TRANS"
 #define PLUGIN_AUTHOR            "Artem Shinkarov <artyom.shinkaroff@gmail.com>"
 #define PREFS_PREFIX             "/plugins/core/" PLUGIN_ID
+#define OPTIONS_PREFIX           "/plugins/core/" PLUGIN_ID "-options"
 
 #include <util.h>
 #include <string.h>
@@ -31,6 +32,7 @@
 #include <debug.h>
 #include <request.h>
 #include <cmds.h>
+#include <log.h>
 #include <err.h>
 
 #include "pidgin.h"
@@ -39,8 +41,13 @@
 #include "gtkprefs.h"
 #include "gtkutils.h"
 #include "gtkconvwin.h"
+#include <gdk/gdkkeysyms.h>
 
 #include "detrans.h"
+#include "complete.h"
+#include "logs.h"
+#include "client.h"
+#include "probes.h"
 
 #define __unused __attribute__ ((unused))
 
@@ -50,6 +57,33 @@ PurplePlugin *plugin_handle = NULL;
 /* Russian pseudo-keyboard.  */
 static int rus_loaded = 0;
 
+/* Connection to detransd, if the service option is set; otherwise the
+   rules are loaded in pidgin on the first message.  */
+static struct detrans_client client = DETRANS_CLIENT_INIT;
+
+/* Languages of the marked buddies by their names, resolved once when
+   the plugin is loaded and when /detrans marks a buddy.  */
+static GHashTable *buddy_langs = NULL;
+
+/* Dictionary to complete words while typing with /rus, or NULL.  */
+static struct complete *completion = NULL;
+
+/* Data attached to the text buffer of a conversation: the label with
+   the suggestions and the rest of the best suggestion.  */
+#define SUGGESTIONS_KEY          PLUGIN_ID "-suggestions"
+#define COMPLETION_KEY           PLUGIN_ID "-completion"
+
+/* Conversion of the logs of a buddy, see logs_cb.  Only one runs at a
+   time; the progress is reported every LOGS_INTERVAL milliseconds to
+   the conversation with the buddy, if there is one.  */
+#define LOGS_INTERVAL            2000
+
+static struct logs_job *logs_job = NULL;
+static GThread *logs_thread = NULL;
+static guint logs_timer = 0;
+static PurpleAccount *logs_account = NULL;
+static char *logs_buddy = NULL;
+
 static void
 error_notify (PurpleConversation * conv, gchar * message)
 {
@@ -61,6 +95,36 @@ error_notify (PurpleConversation * conv, gchar * message)
     }
 }
 
+/* Decoding mode set in the options; the lattice wins over the fuzzy
+   mode.  */
+static enum detrans_mode
+options_mode (void)
+{
+  if (purple_prefs_get_bool (OPTIONS_PREFIX "/lattice"))
+    return DETRANS_LATTICE;
+  if (purple_prefs_get_bool (OPTIONS_PREFIX "/fuzzy"))
+    return DETRANS_FUZZY;
+  return DETRANS_GREEDY;
+}
+
+/* The integer option NAME, 0 if it is negative.  */
+static unsigned
+options_count (const char *name)
+{
+  char *key;
+  int value = 0;
+
+  if (-1 == asprintf (&key, "%s%s", OPTIONS_PREFIX, name))
+    warnx ("asprintf failed");
+  else
+    {
+      value = purple_prefs_get_int (key);
+      free (key);
+    }
+
+  return value > 0 ? value : 0;
+}
+
 /* De-transliteration callback
      If a person is in the de-transliteration list then each message
      from the person is going to be de-transliterated.  */
@@ -71,29 +135,47 @@ reading_msg (PurpleAccount * account, char **sender,
 {
 
   char *txt;
-  char *key;
+  const struct detrans_lang *lang;
 
   PurpleBuddy *buddy;
   buddy = purple_find_buddy (account, *sender);
   const char *name = purple_buddy_get_name (buddy);
 
+  size_t len = message && *message ? strlen (*message) : 0;
+  size_t out_len = len;
+
+  DETRANS_PROBE2 (plugin__message__start, "pidgin", len);
   if (message && *message)
     {
-      if (-1 == asprintf (&key, "%s/%s", PREFS_PREFIX, name))
-        warnx ("asprintf failed");
-
-      purple_debug_misc (PLUGIN_ID, "trying to find = %s\n", key);
-
-      if (purple_prefs_get_string (key) != NULL)
+      purple_debug_misc (PLUGIN_ID, "trying to find = %s\n", name);
+      lang = name ? g_hash_table_lookup (buddy_langs, name) : NULL;
+      DETRANS_PROBE3 (plugin__user__lookup, "pidgin", name, lang != NULL);
+      if (lang == NULL)
+        ;
+      /* Marked users write in english as well, leave it alone.  */
+      else if (purple_prefs_get_bool (OPTIONS_PREFIX "/classify")
+               && !detrans_is_translit (*message, len))
+        purple_debug_misc (PLUGIN_ID, "not a translit message, skipping\n");
+      else
         {
           purple_debug_misc (PLUGIN_ID, "message = %s\n", *message);
-          txt = detrans (*message);
-          free (*message);
-          *message = txt;
+          const char *res = detrans_client (&client, lang, *message, len,
+                                            options_mode ());
+
+          out_len = strlen (res);
+          txt = malloc (out_len + 1);
+          if (txt)
+            {
+              memcpy (txt, res, out_len + 1);
+              free (*message);
+              *message = txt;
+            }
+          else
+            out_len = len;
         }
-      free (key);
     }
 
+  DETRANS_PROBE2 (plugin__message__done, "pidgin", out_len);
   return FALSE;
 }
 
@@ -108,14 +190,19 @@ detrans_cb (PurpleConversation * conv,
   PurpleBuddy *buddy;
   PurpleAccount *account;
   const char *name;
+  const char *lang = args[1] ? args[1] : "ru";
   char *key;
 
   account = purple_conversation_get_account (conv);
-  buddy = purple_find_buddy (account, args[0]);
-  if (buddy == NULL)
+  buddy = args[0] ? purple_find_buddy (account, args[0]) : NULL;
+  if (buddy == NULL || detrans_lang (lang) == NULL)
     {
       char *t;
-      if (-1 == asprintf (&t, "Cannot find buddy '%s'!", args[0]))
+      if (buddy == NULL
+          ? -1 == asprintf (&t, "Cannot find buddy '%s'!",
+                            args[0] ? args[0] : "")
+          : -1 == asprintf (&t, "No rules for language '%s', known are %s.",
+                            lang, DETRANS_LANGUAGES))
         warnx ("asprintf failed");
 
       error_notify (conv, t);
@@ -132,7 +219,11 @@ detrans_cb (PurpleConversation * conv,
       purple_debug_misc (PLUGIN_ID, "trying to add = %s\n", key);
       
       if (purple_prefs_get_string (key) == NULL)
-        purple_prefs_add_string (key, "1");
+        purple_prefs_add_string (key, lang);
+      else
+        purple_prefs_set_string (key, lang);
+      g_hash_table_replace (buddy_langs, g_strdup (name),
+                            (gpointer) detrans_lang (lang));
 
       free (key);
     }
@@ -173,6 +264,7 @@ nodetrans_cb (PurpleConversation * conv,
       
       if (purple_prefs_get_string (key) != NULL)
         purple_prefs_remove (key);
+      g_hash_table_remove (buddy_langs, name);
 
       free (key);
     }
@@ -181,6 +273,199 @@ nodetrans_cb (PurpleConversation * conv,
 }
 
 
+PurpleCmdRet
+stats_cb (PurpleConversation * conv,
+          const gchar * cmd __unused, gchar ** args __unused,
+          gchar ** error __unused, void *data __unused)
+{
+  char *stats = detrans_client_stats (&client);
+  char *cache = cache_stats_string (&client.cache);
+
+  if (stats == NULL)
+    stats = detrans_stats_string ();
+
+  if (stats)
+    {
+      gchar *html = g_markup_escape_text (stats, -1);
+      char *t;
+
+      if (-1 == asprintf (&t, "<pre>%s\n%s</pre>", html, cache ? cache : ""))
+        warnx ("asprintf failed");
+      else
+        {
+          purple_conv_im_write (PURPLE_CONV_IM (conv), NULL, t,
+                                PURPLE_MESSAGE_SYSTEM | PURPLE_MESSAGE_NO_LOG,
+                                time (NULL));
+          free (t);
+        }
+
+      g_free (html);
+      free (stats);
+    }
+
+  free (cache);
+  return PURPLE_CMD_RET_OK;
+}
+
+
+static gpointer
+logs_worker (gpointer data)
+{
+  logs_run ((struct logs_job *) data);
+  return NULL;
+}
+
+/* Wait for the conversion of the logs and forget about it.  */
+static void
+logs_finish (void)
+{
+  if (logs_timer)
+    g_source_remove (logs_timer);
+  g_thread_join (logs_thread);
+  logs_job_free (logs_job);
+  free (logs_buddy);
+
+  logs_job = NULL;
+  logs_thread = NULL;
+  logs_timer = 0;
+  logs_buddy = NULL;
+}
+
+static gboolean
+logs_progress (gpointer data __unused)
+{
+  static size_t files_reported = 0;
+  PurpleConversation *conv;
+  bool done = __atomic_load_n (&logs_job->done, __ATOMIC_ACQUIRE);
+  size_t files = __atomic_load_n (&logs_job->files_done, __ATOMIC_RELAXED);
+  size_t errors = __atomic_load_n (&logs_job->errors, __ATOMIC_RELAXED);
+  uint64_t lines = __atomic_load_n (&logs_job->lines_converted,
+                                    __ATOMIC_RELAXED);
+  uint64_t bytes = __atomic_load_n (&logs_job->bytes_done, __ATOMIC_RELAXED);
+  uint64_t total = __atomic_load_n (&logs_job->bytes_total, __ATOMIC_RELAXED);
+  char *t;
+
+  if (-1 == asprintf (&t, "%s %zu of %zu logs of %s (%u%%), %llu "
+                      "messages de-transliterated, %zu errors.",
+                      done ? "Converted" : "Converting", files,
+                      logs_job->count, logs_buddy,
+                      total ? (unsigned) (bytes * 100 / total) : 100,
+                      (unsigned long long) lines, errors))
+    warnx ("asprintf failed");
+  else
+    {
+      purple_debug_info (PLUGIN_ID, "%s\n", t);
+      conv = purple_find_conversation_with_account (PURPLE_CONV_TYPE_IM,
+                                                    logs_buddy, logs_account);
+      if (conv && (done || files != files_reported))
+        purple_conv_im_write (PURPLE_CONV_IM (conv), NULL, t,
+                              PURPLE_MESSAGE_SYSTEM | PURPLE_MESSAGE_NO_LOG,
+                              time (NULL));
+      files_reported = done ? 0 : files;
+      free (t);
+    }
+
+  if (done)
+    {
+      /* Returning FALSE removes the timer.  */
+      logs_timer = 0;
+      logs_finish ();
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Add PATH to the logs of JOB, if the path is one of a log file we
+   know how to convert.  */
+static void
+logs_add_path (struct logs_job *job, const char *path)
+{
+  const char *ext = path ? strrchr (path, '.') : NULL;
+
+  if (ext && (!strcmp (ext, ".html") || !strcmp (ext, ".txt")))
+    {
+      job->paths = (char **) realloc (job->paths, (job->count + 1)
+                                                  * sizeof (char *));
+      job->paths[job->count++] = strdup (path);
+    }
+}
+
+PurpleCmdRet
+logs_cb (PurpleConversation * conv,
+         const gchar * cmd __unused, gchar ** args,
+         gchar ** error __unused, void *data __unused)
+{
+  PurpleAccount *account = purple_conversation_get_account (conv);
+  PurpleBuddy *buddy = purple_find_buddy (account, args[0]);
+  const char *name, *alias;
+  GList *logs, *l;
+  char *t;
+
+  if (logs_job)
+    {
+      error_notify (conv, "Logs of another buddy are being converted!");
+      return PURPLE_CMD_RET_OK;
+    }
+
+  if (buddy == NULL)
+    {
+      if (-1 == asprintf (&t, "Cannot find buddy '%s'!", args[0]))
+        warnx ("asprintf failed");
+
+      error_notify (conv, t);
+      free (t);
+      return PURPLE_CMD_RET_OK;
+    }
+
+  name = purple_buddy_get_name (buddy);
+  alias = purple_buddy_get_alias (buddy);
+
+  logs_job = (struct logs_job *) calloc (1, sizeof (struct logs_job));
+  logs_job->names = (char **) calloc (3, sizeof (char *));
+  logs_job->names[0] = strdup (name);
+  if (alias && strcmp (alias, name))
+    logs_job->names[1] = strdup (alias);
+  logs_job->in_place = purple_prefs_get_bool (OPTIONS_PREFIX "/logs-in-place");
+  logs_job->classify = purple_prefs_get_bool (OPTIONS_PREFIX "/classify");
+
+  /* The newest log is the one purple writes to while the conversation
+     is open, don't replace it under its feet.  Logs come newest
+     first.  */
+  logs = purple_log_get_logs (PURPLE_LOG_IM, name, account);
+  for (l = logs; l != NULL; l = l->next)
+    {
+      PurpleLog *log = (PurpleLog *) l->data;
+
+      if (l != logs || !logs_job->in_place
+          || !purple_find_conversation_with_account (PURPLE_CONV_TYPE_IM,
+                                                     name, account))
+        logs_add_path (logs_job, log->logger_data
+                       ? ((PurpleLogCommonLoggerData *) log->logger_data)->path
+                       : NULL);
+      purple_log_free (log);
+    }
+  g_list_free (logs);
+
+  if (logs_job->count == 0)
+    {
+      error_notify (conv, "No logs to convert.");
+      logs_job_free (logs_job);
+      logs_job = NULL;
+      return PURPLE_CMD_RET_OK;
+    }
+
+  logs_account = account;
+  logs_buddy = strdup (name);
+  detrans_init ();
+  detrans_set_mode (options_mode ());
+  logs_thread = g_thread_new (PLUGIN_ID "-logs", logs_worker, logs_job);
+  logs_timer = g_timeout_add (LOGS_INTERVAL, logs_progress, NULL);
+
+  return PURPLE_CMD_RET_OK;
+}
+
+
 PurpleCmdRet
 rus_cb (PurpleConversation * conv __unused,
         const gchar * cmd __unused, gchar ** args __unused,
@@ -206,6 +491,95 @@ norus_cb (PurpleConversation * conv __unused,
 }
 
 
+/* Show the completions of the word before ITER.  */
+static void
+update_suggestions (GtkTextBuffer * buffer, GtkTextIter * iter)
+{
+  GtkWidget *label = g_object_get_data (G_OBJECT (buffer), SUGGESTIONS_KEY);
+  const char *words[COMPLETE_TOP];
+  size_t n = 0, i, k;
+  gchar *word = NULL;
+
+  if (label == NULL)
+    return;
+
+  if (rus_loaded && completion)
+    {
+      GtkTextIter start = *iter;
+
+      /* The word is made of letters, russian letters are not ascii.
+         Only the word is copied, whatever the length of the message.  */
+      for (i = 0; i < COMPLETE_MAX_PREFIX
+                  && gtk_text_iter_backward_char (&start); i++)
+        {
+          gunichar c = gtk_text_iter_get_char (&start);
+
+          if (c < 0x80 && !isalpha ((int) c))
+            {
+              gtk_text_iter_forward_char (&start);
+              break;
+            }
+        }
+      word = gtk_text_buffer_get_text (buffer, &start, iter, FALSE);
+
+      k = purple_prefs_get_int (OPTIONS_PREFIX "/completions");
+      n = complete_lookup (completion, word, strlen (word), words,
+                           k < COMPLETE_TOP ? k : COMPLETE_TOP);
+    }
+
+  if (n == 0)
+    {
+      g_object_set_data_full (G_OBJECT (buffer), COMPLETION_KEY, NULL, NULL);
+      gtk_widget_hide (label);
+    }
+  else
+    {
+      GString *suggestions = g_string_new ("Tab: ");
+
+      for (i = 0; i < n; i++)
+        g_string_append_printf (suggestions, "%s%s", i ? "  " : "",
+                                words[i]);
+
+      /* Case doesn't change the length of the letters, so the rest of
+         the word is right after the prefix.  */
+      g_object_set_data_full (G_OBJECT (buffer), COMPLETION_KEY,
+                              g_strdup (words[0] + strlen (word)), g_free);
+      gtk_label_set_text (GTK_LABEL (label), suggestions->str);
+      gtk_widget_show (label);
+      g_string_free (suggestions, TRUE);
+    }
+
+  g_free (word);
+}
+
+/* Tab inserts the best completion.  */
+static gboolean
+key_press (GtkWidget * widget __unused, GdkEventKey * event,
+           GtkTextBuffer * buffer)
+{
+  const gchar *rest;
+  GtkTextIter iter;
+
+  if (event->keyval != GDK_Tab
+      || !(rest = g_object_get_data (G_OBJECT (buffer), COMPLETION_KEY))
+      || *rest == '\0')
+    return FALSE;
+
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter,
+                                    gtk_text_buffer_get_insert (buffer));
+  gtk_text_buffer_insert (buffer, &iter, rest, strlen (rest));
+  update_suggestions (buffer, &iter);
+  return TRUE;
+}
+
+static void
+delete_range (GtkTextBuffer * buffer, GtkTextIter * start,
+              GtkTextIter * end __unused)
+{
+  update_suggestions (buffer, start);
+}
+
+
 /* Guard from recursion in keymap.def  */
 static gchar *inserted_symbol = NULL;
 
@@ -237,6 +611,7 @@ insert_text (GtkTextBuffer * buffer, GtkTextIter * iter,
 #include "keymap-ru.def"
 #undef INPUT
         default:
+           update_suggestions (buffer, iter);
            return;
         }
 
@@ -246,6 +621,7 @@ insert_text (GtkTextBuffer * buffer, GtkTextIter * iter,
       inserted_symbol = repl;
       gtk_text_buffer_backspace (buffer, iter, FALSE, TRUE);
       gtk_text_buffer_insert (buffer, iter, repl, strlen (repl));
+      update_suggestions (buffer, iter);
     }
 }
 
@@ -265,6 +641,20 @@ plugin_attach_conv (PurpleConversation * conv)
   g_signal_connect_after (G_OBJECT (buffer), "insert-text",
                           G_CALLBACK (insert_text), NULL);
 
+  if (completion)
+    {
+      GtkWidget *label = gtk_label_new ("");
+
+      gtk_misc_set_alignment (GTK_MISC (label), 0, 0.5);
+      gtk_box_pack_start (GTK_BOX (gtkconv->lower_hbox), label,
+                          FALSE, FALSE, 0);
+      g_object_set_data (G_OBJECT (buffer), SUGGESTIONS_KEY, label);
+
+      g_signal_connect_after (G_OBJECT (buffer), "delete-range",
+                              G_CALLBACK (delete_range), NULL);
+      g_signal_connect (G_OBJECT (view), "key-press-event",
+                        G_CALLBACK (key_press), buffer);
+    }
 }
 
 
@@ -274,6 +664,7 @@ plugin_remove_attached (PidginConversation * gtkconv)
 {
   GtkTextView *view;
   GtkTextBuffer *buffer;
+  GtkWidget *label;
 
   view = GTK_TEXT_VIEW (gtkconv->entry);
   buffer = gtk_text_view_get_buffer (view);
@@ -281,28 +672,60 @@ plugin_remove_attached (PidginConversation * gtkconv)
   g_signal_handlers_disconnect_matched (G_OBJECT (buffer),
                                         G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
                                         G_CALLBACK (insert_text), NULL);
+  g_signal_handlers_disconnect_matched (G_OBJECT (buffer),
+                                        G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
+                                        G_CALLBACK (delete_range), NULL);
+  g_signal_handlers_disconnect_matched (G_OBJECT (view),
+                                        G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
+                                        G_CALLBACK (key_press), NULL);
+
+  label = g_object_get_data (G_OBJECT (buffer), SUGGESTIONS_KEY);
+  if (label)
+    {
+      gtk_widget_destroy (label);
+      g_object_set_data (G_OBJECT (buffer), SUGGESTIONS_KEY, NULL);
+      g_object_set_data_full (G_OBJECT (buffer), COMPLETION_KEY, NULL, NULL);
+    }
 }
 
 
 #define DETRANS_DESC \
-        "/detrans <user-id>  marks a user and saves it in config "\
-        "with de-transliteration flag, which assumes that user is "\
-        "writing in russian translit (see http://en.wikipedia.org"\
-        "/wiki/Translit) for more details.\n\n"\
+        "/detrans <user-id> [language]  marks a user and saves it"\
+        " in config with de-transliteration flag, which assumes t"\
+        "hat user is writing in translit (see http://en.wikipedia"\
+        ".org/wiki/Translit) for more details.  The language is o"\
+        "ne of " DETRANS_LANGUAGES ", russian by default.\n\n"\
         "All the messages from the marked user are going to be tr"\
-        "anslated into russian utf-8 letters.  In order to swithc"\
-        " this feauture off use /nodetrans <user-id>.\n\n"
+        "anslated into cyrillic utf-8 letters.  In order to swith"\
+        "c this feauture off use /nodetrans <user-id>.\n\n"
 
 #define NODETRANS_DESC \
         "/nodetrans <user-id>  removes de-transliteration flag fr"\
         "om the given user.  If you don't know what is de-transli"\
         "teration flag, please run /help detrans.\n\n"
 
+#define STATS_DESC \
+        "/detrans-stats shows how many messages were de-translite"\
+        "rated, how much work it took and how long it took.  With "\
+        "the service option set, the numbers are of detransd.  The"\
+        " last line is about the results of the recent messages ke"\
+        "pt for their copies (cache-size and cache-ttl options).\n\n"
+
+#define LOGS_DESC \
+        "/detrans-logs <user-id>  de-transliterates the messages o"\
+        "f the user in the existing logs, in the background.  Conv"\
+        "erted copies are written next to the logs with the suffix"\
+        " " LOGS_SUFFIX ", unless the logs-in-place option is set."\
+        "\n\n"
+
 #define RUS_DESC \
         "/rus switches russian keyboard layout for all the conver"\
         "sations.  It is useful in case you are not allowed to ad"\
         "d layouts on the system, but you want to type in russian"\
         ".\n\n"\
+        "If a dictionary is set in the plugin options, completions "\
+        "of the current word are shown next to the input, Tab inse"\
+        "rts the first one.\n\n"\
         "In order to turn this feature off, run /norus\n\n"\
 
 #define NORUS_DESC \
@@ -314,7 +737,36 @@ plugin_load (PurplePlugin * plugin)
 {
   void *convs_handle;
 
-  detrans_init ();
+  const char *dict;
+  GList *names, *l;
+
+  /* The prefs keep the language of every marked buddy; "1", as set by
+     the older versions, is russian.  */
+  buddy_langs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                       NULL);
+  names = purple_prefs_get_children_names (PREFS_PREFIX);
+  for (l = names; l != NULL; l = l->next)
+    {
+      const char *key = (const char *) l->data;
+      const char *value = purple_prefs_get_string (key);
+      const struct detrans_lang *lang = value ? detrans_lang (value) : NULL;
+
+      if (value != NULL)
+        g_hash_table_replace (buddy_langs,
+                              g_strdup (key + strlen (PREFS_PREFIX "/")),
+                              (gpointer) (lang ? lang : detrans_lang ("ru")));
+      g_free (l->data);
+    }
+  g_list_free (names);
+
+  detrans_client_set_path (&client,
+                           purple_prefs_get_string (OPTIONS_PREFIX "/service"));
+  detrans_client_set_cache (&client, options_count ("/cache-size"),
+                            options_count ("/cache-ttl"));
+
+  dict = purple_prefs_get_string (OPTIONS_PREFIX "/dictionary");
+  if (dict && *dict && (completion = complete_load (dict)) == NULL)
+    purple_debug_warning (PLUGIN_ID, "cannot load dictionary '%s'\n", dict);
   
   convs_handle = purple_conversations_get_handle ();
 
@@ -332,9 +784,10 @@ plugin_load (PurplePlugin * plugin)
 
   purple_cmd_register 
     ("detrans",                 /*command name */
-     "w",                       /*args */
+     "ww",                      /*args */
      0,                         /*priority */
-     PURPLE_CMD_FLAG_IM,        /*flags */
+     PURPLE_CMD_FLAG_IM         /*flags, the language is optional */
+     | PURPLE_CMD_FLAG_ALLOW_WRONG_ARGS,
      NULL,                      /*prpl id not needed */
      detrans_cb,                /*callback function */
      DETRANS_DESC,              /*help string */
@@ -352,6 +805,28 @@ plugin_load (PurplePlugin * plugin)
      NULL                       /* user defined data not needed */
     );
 
+  purple_cmd_register 
+    ("detrans-stats",           /*command name */
+     "",                        /*args */
+     0,                         /*priority */
+     PURPLE_CMD_FLAG_IM,        /*flags */
+     NULL,                      /*prpl id not needed */
+     stats_cb,                  /*callback function */
+     STATS_DESC,                /*help string */
+     NULL                       /* user defined data not needed */
+    );
+
+  purple_cmd_register 
+    ("detrans-logs",            /*command name */
+     "w",                       /*args */
+     0,                         /*priority */
+     PURPLE_CMD_FLAG_IM,        /*flags */
+     NULL,                      /*prpl id not needed */
+     logs_cb,                   /*callback function */
+     LOGS_DESC,                 /*help string */
+     NULL                       /* user defined data not needed */
+    );
+
   purple_cmd_register 
     ("rus",                     /*command name */
      "",                        /*args */
@@ -385,6 +860,13 @@ plugin_unload (PurplePlugin * plugin __unused)
 {
   GList *convs;
 
+  if (logs_job)
+    {
+      __atomic_store_n (&logs_job->cancel, true, __ATOMIC_RELAXED);
+      logs_finish ();
+    }
+
+  detrans_client_free (&client);
   detrans_free ();
   for (convs = purple_get_conversations (); convs != NULL;
        convs = convs->next)
@@ -394,6 +876,10 @@ plugin_unload (PurplePlugin * plugin __unused)
         plugin_remove_attached (PIDGIN_CONVERSATION (conv));
     }
 
+  complete_free (completion);
+  completion = NULL;
+  g_hash_table_destroy (buddy_langs);
+  buddy_langs = NULL;
   return TRUE;
 }
 
@@ -445,6 +931,16 @@ init_plugin (PurplePlugin * plugin __unused)
     "\n\n/norus switches off russian keyboard layout";
 
   purple_prefs_add_none (PREFS_PREFIX);
+  purple_prefs_add_none (OPTIONS_PREFIX);
+  purple_prefs_add_bool (OPTIONS_PREFIX "/classify", TRUE);
+  purple_prefs_add_bool (OPTIONS_PREFIX "/lattice", FALSE);
+  purple_prefs_add_bool (OPTIONS_PREFIX "/fuzzy", FALSE);
+  purple_prefs_add_string (OPTIONS_PREFIX "/dictionary", "");
+  purple_prefs_add_int (OPTIONS_PREFIX "/completions", 5);
+  purple_prefs_add_bool (OPTIONS_PREFIX "/logs-in-place", FALSE);
+  purple_prefs_add_string (OPTIONS_PREFIX "/service", "");
+  purple_prefs_add_int (OPTIONS_PREFIX "/cache-size", CLIENT_CACHE_SIZE);
+  purple_prefs_add_int (OPTIONS_PREFIX "/cache-ttl", CLIENT_CACHE_TTL);
 }
 
 PURPLE_INIT_PLUGIN (PLUGIN_STATIC_NAME, init_plugin, info)
@@ -17,6 +17,10 @@
 #include <assert.h>
 #include <unistd.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "trie.h"
 
 /* Allocate a new empty trie.  */
@@ -24,16 +28,16 @@ struct trie *
 trie_new ()
 {
   struct trie *  trie = (struct trie *) malloc (sizeof (struct trie));
-  trie->children_size = TRIE_CHILDREN;
+  trie->children_size = 1;
   trie->children_count = 0;
-  trie->children = (struct child *)
-		   malloc (TRIE_CHILDREN * sizeof (struct child));
-  memset (trie->children, 0, TRIE_CHILDREN * sizeof (struct child));
+  trie->kind = TRIE_NODE_ONE;
+  trie->children = &trie->one;
+  memset (&trie->one, 0, sizeof (struct child));
   return trie;
 }
 
 
-/* Helper for bsearch and qsort.  */
+/* Helper for qsort.  */
 static inline int
 cmp_children (const void *  k1, const void *  k2)
 {
@@ -43,77 +47,203 @@ cmp_children (const void *  k1, const void *  k2)
 }
 
 
-/* Search for a symbol in a children of a certain trie.  Uses binary search
-   as the children are kept sorted.  */
+/* Search for a symbol in a children of a certain trie.  This is
+   the inner loop of the matching, so every kind of node has its
+   own way of doing it, see enum trie_node_kind.  */
 struct child *
 trie_search_child (struct trie * trie, int symb)
 {
-  struct child s;
+  unsigned char c = symb;
 
-  if (trie->children_count == 0)
-    return NULL;
+  switch (trie->kind)
+    {
+    case TRIE_NODE_ONE:
+      if (trie->children_count == 0 || (unsigned char) trie->one.symb != c)
+	return NULL;
+      return &trie->one;
+
+    case TRIE_NODE_SMALL:
+      {
+#ifdef __SSE2__
+	__m128i keys = _mm_loadu_si128 ((const __m128i *) trie->keys);
+	unsigned mask = _mm_movemask_epi8
+			  (_mm_cmpeq_epi8 (keys, _mm_set1_epi8 (c)));
+
+	mask &= (1u << trie->children_count) - 1;
+	return mask ? &trie->children[__builtin_ctz (mask)] : NULL;
+#else
+	unsigned int i;
+
+	for (i = 0; i < trie->children_count; i++)
+	  if (trie->keys[i] == c)
+	    return &trie->children[i];
+	return NULL;
+#endif
+      }
+
+    case TRIE_NODE_WIDE:
+      return trie->index[c] ? &trie->children[trie->index[c] - 1] : NULL;
+    }
+
+  return NULL;
+}
+
+
+/* Pick the layout of TRIE after its children have changed.  */
+static void
+trie_set_kind (struct trie *  trie)
+{
+  unsigned int i;
+
+  if (trie->kind == TRIE_NODE_WIDE)
+    free (trie->index);
+
+  if (trie->children_count <= 1)
+    trie->kind = TRIE_NODE_ONE;
+  else if (trie->children_count <= TRIE_SMALL)
+    {
+      trie->kind = TRIE_NODE_SMALL;
+      memset (trie->keys, 0, TRIE_SMALL);
+      for (i = 0; i < trie->children_count; i++)
+	trie->keys[i] = trie->children[i].symb;
+    }
+  else
+    {
+      trie->kind = TRIE_NODE_WIDE;
+      trie->index = (unsigned short *) calloc (256, sizeof (unsigned short));
+      for (i = 0; i < trie->children_count; i++)
+	trie->index[(unsigned char) trie->children[i].symb] = i + 1;
+    }
+}
+
+/* Add a child with symbol SYMB, the rest of the edge LABEL of length
+   LABEL_LEN (copied), and LAST and NEXT to TRIE.  The symbol must not
+   be there yet.  Returns the new child.  */
+static struct child *
+trie_add_child (struct trie *  trie, int symb, const char *  label,
+		size_t label_len, ssize_t last, struct trie *  next)
+{
+  struct child *  child;
+
+  if (trie->children == &trie->one && trie->children_count == 1)
+    {
+      /* The only child moves out of the node.  */
+      trie->children_size = TRIE_CHILDREN;
+      trie->children = (struct child *)
+		       malloc (TRIE_CHILDREN * sizeof (struct child));
+      trie->children[0] = trie->one;
+    }
+  else if (trie->children_count >= trie->children_size)
+    {
+      trie->children_size *= 2;
+      trie->children = (struct child *)
+		       realloc (trie->children,
+				trie->children_size
+				* sizeof (struct child));
+    }
+
+  child = &trie->children[trie->children_count++];
+  child->symb = symb;
+  child->label_len = label_len;
+  child->label = NULL;
+  if (label_len > 0)
+    {
+      child->label = (char *) malloc (label_len);
+      memcpy (child->label, label, label_len);
+    }
+  child->last = last;
+  child->next = next;
+
+  /* XXX This qsort may not perform ideally, as actually we are always
+     just shifting a number of elements a the end of the array one
+     element to the left.  Possibly qsort, can figure it out and work
+     in O (N) time.  Otherwise better alternative is needed.  */
+  qsort (trie->children, trie->children_count,
+	 sizeof (struct child), cmp_children);
+  trie_set_kind (trie);
+
+  return trie_search_child (trie, symb);
+}
+
+/* Cut the edge of CHILD after K bytes of its label, putting a new node
+   there.  Nothing changes for the words in the trie.  */
+static void
+trie_split_edge (struct child *  child, size_t k)
+{
+  struct trie *  node = trie_new ();
+
+  trie_add_child (node, child->label[k], &child->label[k + 1],
+		  child->label_len - k - 1, child->last, child->next);
 
-  s.symb = symb;
-  return  (struct child *)bsearch (&s, trie->children, trie->children_count,
-			   sizeof (struct child), cmp_children);
+  child->label_len = k;
+  if (k == 0)
+    {
+      free (child->label);
+      child->label = NULL;
+    }
+  child->last = TRIE_NOT_LAST;
+  child->next = node;
 }
 
-/* Add a word to the trie.  */
+
+/* Add a word to the trie.  A chain of nodes with one child and without
+   a word ending in them is kept as a single edge, the bytes after the
+   first one are in the LABEL of the child.  */
 void
 trie_add_word (struct trie * trie, const char * word, size_t length, ssize_t info)
 {
   struct child *  child;
-  struct trie *  nxt = NULL;
+  size_t k = 0;
 
-  assert (trie != NULL);
+  assert (trie != NULL && length > 0);
 
   child = trie_search_child (trie, word[0]);
 
-  if (child)
+  if (!child)
     {
-      if (length == 1)
-	child->last = info;
-      if (length > 1 && child->next == NULL)
-	child->next = trie_new ();
-
-      nxt = child->next;
+      trie_add_child (trie, word[0], &word[1], length - 1, info, NULL);
+      return;
     }
+
+  while (k < child->label_len && k < length - 1
+	 && child->label[k] == word[k + 1])
+    k++;
+
+  if (k < child->label_len)
+    trie_split_edge (child, k);
+
+  if (length - 1 == k)
+    child->last = info;
   else
     {
-      if (trie->children_count >= trie->children_size)
-	{
-	  trie->children_size *= 2;
-	  trie->children = (struct child *)
-			   realloc (trie->children,
-				    trie->children_size
-				    * sizeof (struct child));
-	}
-
-      trie->children[trie->children_count].symb = word[0];
-      if (length > 1)
-	{
-	  trie->children[trie->children_count].next = trie_new ();
-	  trie->children[trie->children_count].last = TRIE_NOT_LAST;
-	}
-      else
-	{
-	  trie->children[trie->children_count].next = NULL;
-	  trie->children[trie->children_count].last = info;
-	}
-
-      nxt = trie->children[trie->children_count].next;
-      trie->children_count++;
-
-      /* XXX This qsort may not perform ideally, as actually we are always
-	 just shifting a number of elements a the end of the array one
-	 element to the left.  Possibly qsort, can figure it out and work
-	 in O (N) time.  Otherwise better alternative is needed.  */
-      qsort (trie->children, trie->children_count,
-	     sizeof (struct child), cmp_children);
+      if (child->next == NULL)
+	child->next = trie_new ();
+      trie_add_word (child->next, &word[k + 1], length - k - 1, info);
     }
+}
+
+
+/* Check whether the label of CHILD is at the beginning of WORD of
+   length LEN, ignoring the case of latin letters in WORD.  */
+int
+trie_match_label (const struct child *  child, const char *  word,
+		  size_t len)
+{
+  size_t i;
 
-  if (length > 1)
-    trie_add_word (nxt, &word[1], length - 1, info);
+  if (len < child->label_len)
+    return 0;
+
+  if (child->label_len == 0 || !memcmp (child->label, word, child->label_len))
+    return 1;
+
+  for (i = 0; i < child->label_len; i++)
+    if (child->label[i] != word[i]
+	&& !(word[i] >= 'A' && word[i] <= 'Z'
+	     && child->label[i] == word[i] - 'A' + 'a'))
+      return 0;
+
+  return 1;
 }
 
 
@@ -135,7 +265,8 @@ _trie_print (struct trie *  t, int level)
   for (i = 0; i < t->children_count; i++)
     {
       tab (level);
-      printf ("%c %s\n", (char) t->children[i].symb,
+      printf ("%c%.*s %s\n", (char) t->children[i].symb,
+	      (int) t->children[i].label_len, t->children[i].label,
 	      t->children[i].last != TRIE_NOT_LAST ? "[last]" : "");
       _trie_print (t->children[i].next, level+1);
     }
@@ -158,10 +289,15 @@ trie_free (struct trie *  trie)
     return;
 
   for (i = 0; i < trie->children_count; i++)
-    trie_free (trie->children[i].next);
+    {
+      trie_free (trie->children[i].next);
+      free (trie->children[i].label);
+    }
 
-  if (trie->children)
+  if (trie->children != &trie->one)
     free (trie->children);
+  if (trie->kind == TRIE_NODE_WIDE)
+    free (trie->index);
   free (trie);
 }
 
@@ -177,46 +313,56 @@ trie_search (struct trie *  trie, const char *  word, size_t length)
 
   child = trie_search_child (trie, word[0]);
 
-  if (!child)
+  if (!child || length - 1 < child->label_len
+      || (child->label_len
+	  && memcmp (child->label, &word[1], child->label_len)))
     return TRIE_NOT_LAST;
 
-  if (length == 1)
+  if (length - 1 == child->label_len)
     return child->last;
   else
-    return trie_search (child->next, &word[1], length - 1);
+    return trie_search (child->next, &word[child->label_len + 1],
+			length - child->label_len - 1);
 }
 
-/* Searches if a given word can be found in the database and if a trie follows
-   it.  Returns trie, which follows a given prefix, and sets LAST to true if
-   the word itself can be found inside the trie.  */
-struct trie *
+/* Searches if a given prefix can be found in the database.  Returns the
+   child whose edge the prefix ends on, or NULL if there is none, and
+   sets OFFSET to the number of bytes of its label the prefix covers.
+   When the whole label is covered, the prefix itself is a word if LAST
+   of the child is set, and NEXT of the child follows it; otherwise the
+   prefix ends in the middle of the edge.  The trie is not changed, so
+   it can be searched by several threads at once.  */
+struct child *
 trie_check_prefix (struct trie *  trie, const char *  word, size_t length,
-		   ssize_t *  last)
+		   size_t *  offset)
 {
   struct child *  child;
+  size_t k = 0;
 
   assert (length > 0);
   if (trie == NULL)
-    {
-      *last = TRIE_NOT_LAST;
-      return NULL;
-    }
+    return NULL;
 
   child = trie_search_child (trie, word[0]);
 
   if (!child)
-    {
-      *last = TRIE_NOT_LAST;
-      return NULL;
-    }
+    return NULL;
+
+  while (k < child->label_len && k < length - 1
+	 && child->label[k] == word[k + 1])
+    k++;
+
+  if (k < child->label_len && k < length - 1)
+    return NULL;
 
-  if (length == 1)
+  if (length - 1 == k)
     {
-      *last = child->last;
-      return child->next;
+      *offset = k;
+      return child;
     }
   else
-    return trie_check_prefix (child->next, &word[1], length - 1, last);
+    return trie_check_prefix (child->next, &word[k + 1], length - k - 1,
+			      offset);
 }
 
 
@@ -253,12 +399,17 @@ main (int argc, char *argv[])
 	      strlen (argv[1])) != TRIE_NOT_LAST ? "yes" : "no");
   else if (check_prefix_search)
     {
-      struct trie *  res;
-      ssize_t last;
-      res = trie_check_prefix (t, argv[1], strlen (argv[1]), &last);
+      struct child *  res;
+      size_t offset = 0;
+      res = trie_check_prefix (t, argv[1], strlen (argv[1]), &offset);
       printf ("checking prefix for '%s' in database last: %s, follows:\n",
-	      argv[1], last != TRIE_NOT_LAST ? "yes" : "no");
-      trie_print (res);
+	      argv[1], res && offset == res->label_len
+		       && res->last != TRIE_NOT_LAST ? "yes" : "no");
+      if (res && offset == res->label_len)
+	trie_print (res->next);
+      else if (res)
+	printf ("'%.*s' of the edge\n", (int) (res->label_len - offset),
+		res->label + offset);
     }
 
   trie_free (t);
@@ -14,13 +14,19 @@
 #ifndef __TRIE_H__
 #define __TRIE_H__
 
-/* Deafult number of the number of children in trie node.
-   It is a good idea to pick the value being power of two
-   as when the number of children has to be increase the
-   number will be ultiplied by 2, and further operarions
-   could be optimized to shifts rather than multiplications.  */
+/* Deafult number of the number of children in trie node,
+   when the node has more than one.  It is a good idea to pick
+   the value being power of two as when the number of children
+   has to be increase the number will be ultiplied by 2, and
+   further operarions could be optimized to shifts rather than
+   multiplications.  */
 #define TRIE_CHILDREN	      4
 
+/* Nodes with up to that many children keep their symbols in
+   a small array, which is scanned in one go with SIMD.  Nodes
+   with more children use a table indexed by the symbol.  */
+#define TRIE_SMALL	      16
+
 
 /* Each child in the trie has to now if he could possibly
    end the word.  The field LAST keeps this information, and
@@ -37,20 +43,48 @@
    of the alphabet.
 
    The benefit of the structure is that with the same complexity one can
-   get all the possible endings of a certain prefix.  */
+   get all the possible endings of a certain prefix.
+
+   Chains of nodes with a single child are collapsed into one edge, so
+   long words cost a node per branching rather than a node per byte.
+   Whoever walks the trie by hand has to check the LABEL of every child
+   found, e.g. with TRIE_MATCH_LABEL.  */
 struct trie;
 struct child
 {
   int symb;
+  /* Bytes of the edge after SYMB, see TRIE_ADD_WORD.  */
+  unsigned int label_len;
+  char *  label;
   ssize_t last;
   struct trie *  next;
 };
 
+/* Layout of the node, chosen by TRIE_ADD_WORD after every
+   insertion, depending on the number of children.
+     TRIE_NODE_ONE   the only child is stored inside the node;
+     TRIE_NODE_SMALL symbols of the children are in KEYS;
+     TRIE_NODE_WIDE  INDEX[symbol] is the child number plus one.  */
+enum trie_node_kind
+{
+  TRIE_NODE_ONE,
+  TRIE_NODE_SMALL,
+  TRIE_NODE_WIDE
+};
+
+/* Symbols are bytes, so -1 and 255 are the same symbol.  */
 struct trie
 {
   unsigned int children_size;
   unsigned int children_count;
   struct child *  children;
+  enum trie_node_kind kind;
+  union
+  {
+    struct child one;
+    unsigned char keys[TRIE_SMALL];
+    unsigned short *  index;
+  };
 };
 
 __BEGIN_DECLS
@@ -60,7 +94,8 @@ void trie_add_word (struct trie *, const char *, size_t, ssize_t);
 void trie_print (struct trie *);
 void trie_free (struct trie *);
 ssize_t trie_search (struct trie *, const char *, size_t);
-struct trie * trie_check_prefix (struct trie *, const char *, size_t, ssize_t *);
+struct child * trie_check_prefix (struct trie *, const char *, size_t, size_t *);
+int trie_match_label (const struct child *, const char *, size_t);
 __END_DECLS
 
 #endif  /* __TRIE_H__  */
@@ -0,0 +1,155 @@
+/* Copyright (c) 2010-2020, Artem Shinkarov <artyom.shinkaroff@gmail.com>
+
+   Permission to use, copy, modify, and/or distribute this software for any
+   purpose with or without fee is hereby granted, provided that the above
+   copyright notice and this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+   WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+   MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+   ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+   WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+   ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.  */
+
+#ifndef __UTF8_H__
+#define __UTF8_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Place for a character in utf-8.  */
+#define UTF8_MAX        4
+
+/* Latin letters with diacritics which have a small letter.  Capital
+   and small letters alternate in the ranges with STEP 2, the capital
+   being the first one.  Every letter here is two bytes long in utf-8,
+   and so is its small letter.  */
+struct utf8_fold_range
+{
+  unsigned first, last;
+  int delta;
+  unsigned step;
+};
+
+static const struct utf8_fold_range utf8_fold_ranges[] = {
+  {0xc0, 0xd6, 0x20, 1},
+  {0xd8, 0xde, 0x20, 1},
+  {0x100, 0x12f, 1, 2},
+  {0x132, 0x137, 1, 2},
+  {0x139, 0x148, 1, 2},
+  {0x14a, 0x177, 1, 2},
+  {0x178, 0x178, 0xff - 0x178, 1},
+  {0x179, 0x17e, 1, 2},
+  {0x1cd, 0x1dc, 1, 2},
+};
+
+/* First bytes of the letters in UTF8_FOLD_RANGES.  Other characters,
+   cyrillic ones among them, are the same in both cases.  */
+#define UTF8_FOLD_LEAD_FIRST    0xc3
+#define UTF8_FOLD_LEAD_LAST     0xc7
+
+/* Whether the character starting with the byte C may be capital, if C
+   is not ASCII.  */
+static inline bool
+utf8_may_fold (unsigned char c)
+{
+  return c >= UTF8_FOLD_LEAD_FIRST && c <= UTF8_FOLD_LEAD_LAST;
+}
+
+/* Whether S of length LEN has characters which may be capital, other
+   than ASCII.  */
+static inline bool
+utf8_has_case (const char *s, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    if (utf8_may_fold (s[i]))
+      return true;
+
+  return false;
+}
+
+/* Lower case of the ASCII character C.  */
+static inline unsigned char
+ascii_lower (unsigned char c)
+{
+  return c + ((unsigned) (c - 'A') < 26 ? 'a' - 'A' : 0);
+}
+
+/* The code point of the two-byte utf-8 sequence at S of length LEN,
+   or 0 if there is none.  Longer sequences have no case as far as the
+   engine is concerned.  */
+static inline unsigned
+utf8_decode2 (const unsigned char *s, size_t len)
+{
+  if (len < 2 || s[0] < 0xc2 || s[0] > 0xdf || (s[1] & 0xc0) != 0x80)
+    return 0;
+
+  return ((s[0] & 0x1f) << 6) | (s[1] & 0x3f);
+}
+
+/* Small letter of the code point CP, which is not ASCII.  */
+static inline unsigned
+utf8_fold (unsigned cp)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof (utf8_fold_ranges) / sizeof (utf8_fold_ranges[0]);
+       i++)
+    if (cp >= utf8_fold_ranges[i].first && cp <= utf8_fold_ranges[i].last
+        && (cp - utf8_fold_ranges[i].first) % utf8_fold_ranges[i].step == 0)
+      return cp + utf8_fold_ranges[i].delta;
+    else if (cp < utf8_fold_ranges[i].first)
+      break;
+
+  return cp;
+}
+
+/* Write the small letter of the character at S of length LEN to OUT,
+   which has place for UTF8_MAX bytes.  Returns the length of the
+   character, the same for both letters, or 1 for the bytes which are
+   not a character: those are copied as they are.  */
+static inline size_t
+utf8_lower (const char *s, size_t len, char *out)
+{
+  const unsigned char *u = (const unsigned char *) s;
+  unsigned cp;
+
+  if (u[0] < 0x80)
+    {
+      out[0] = ascii_lower (u[0]);
+      return 1;
+    }
+
+  if (!utf8_may_fold (u[0]) || (cp = utf8_decode2 (u, len)) == 0)
+    {
+      out[0] = s[0];
+      return 1;
+    }
+
+  cp = utf8_fold (cp);
+  out[0] = 0xc0 | (cp >> 6);
+  out[1] = 0x80 | (cp & 0x3f);
+  return 2;
+}
+
+/* Whether the character at S of length LEN is a capital letter.  */
+static inline bool
+utf8_is_capital (const char *s, size_t len)
+{
+  const unsigned char *u = (const unsigned char *) s;
+  unsigned cp;
+
+  if (u[0] < 0x80)
+    return (unsigned) (u[0] - 'A') < 26;
+
+  if (!utf8_may_fold (u[0]))
+    return false;
+
+  cp = utf8_decode2 (u, len);
+  return cp != 0 && utf8_fold (cp) != cp;
+}
+
+#endif  /* __UTF8_H__  */
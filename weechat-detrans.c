@@ -18,6 +18,8 @@
 #include <weechat-plugin.h>
 
 #include "detrans.h"
+#include "client.h"
+#include "probes.h"
 
 
 #define PLUGIN_NAME "detrans"
@@ -30,22 +32,146 @@ WEECHAT_PLUGIN_LICENSE ("ISC");
 
 struct t_weechat_plugin *  weechat_plugin = NULL;
 struct t_hook *  detrans_hook = NULL;
+struct t_hook *  detrans_batch_hook = NULL;
 
 static char **  detrans_users = NULL;
 size_t detrans_users_len = 0;
 
+/* Languages of DETRANS_USERS, from "user:uk" entries; NULL is russian.  */
+static const struct detrans_lang **  detrans_users_langs = NULL;
 
+/* Skip messages that don't look like translit.  */
+static int detrans_classify = 1;
+
+static enum detrans_mode detrans_mode = DETRANS_GREEDY;
+
+/* Connection to detransd, see plugins.var.detrans.service.  */
+static struct detrans_client detrans_client_conn = DETRANS_CLIENT_INIT;
+
+/* Results of the last batch, see detrans_batch_cb.  */
+static struct detrans_arena detrans_arena = DETRANS_ARENA_INIT;
+
+/* Set once weechat gives us a batch of messages.  */
+static int detrans_batches_seen = 0;
+
+
+/* Whether USER is one of DETRANS_USERS; sets *LANG to the language of
+   the user.  */
 static inline int
-user_in_detrans_users (const char *  user)
+user_in_detrans_users (const char *  user, const struct detrans_lang **  lang)
 {
   for (size_t i = 0; i < detrans_users_len; i++)
     if (!strncmp (user, detrans_users[i], strlen (detrans_users[i])))
-      return 1;
+      {
+	*lang = detrans_users_langs[i];
+	DETRANS_PROBE3 (plugin__user__lookup, "weechat", user, 1);
+	return 1;
+      }
 
+  DETRANS_PROBE3 (plugin__user__lookup, "weechat", user, 0);
   return 0;
 }
 
 
+/* Find the sender and the text of the raw PRIVMSG line MESSAGE, which
+   may start with IRCv3 tags (bouncers add `time=' to the replayed
+   messages).  Sets *BATCHED if the message is a part of a batch.
+   Returns NULL if MESSAGE doesn't look like a PRIVMSG.  */
+static const char *
+privmsg_text (const char *  message, const char **  sender, int *  batched)
+{
+  const char *  s = message;
+
+  *batched = 0;
+  if (*s == '@')
+    {
+      const char *  end = strchr (s, ' ');
+
+      if (!end)
+	return NULL;
+
+      for (const char *  t = s + 1; t < end; t++)
+	if ((t == s + 1 || t[-1] == ';') && !strncmp (t, "batch=", 6))
+	  *batched = 1;
+
+      for (s = end; *s == ' '; s++)
+	;
+    }
+
+  const char *  prefix_end = strchr (s, ' ');
+  const char *  bang = strchr (s, '!');
+
+  if (*s != ':' || !prefix_end || !bang || bang > prefix_end)
+    return NULL;
+
+  *sender = bang + 1;
+
+  const char *  text = strstr (prefix_end, " :");
+
+  return text ? text + 2 : NULL;
+}
+
+/* Whether the message TEXT of length LEN from SENDER has to be
+   de-transliterated, and with the rules of which *LANG.  */
+static inline int
+wants_detrans (const char *  sender, const char *  text, size_t len,
+	       const struct detrans_lang **  lang)
+{
+  return user_in_detrans_users (sender, lang)
+	 && (!detrans_classify || detrans_is_translit (text, len));
+}
+
+/* The PRIVMSG line MESSAGE with the text de-transliterated if it has to
+   be, in a new string.  */
+static char *
+detrans_privmsg (const char *  message)
+{
+  const char *  sender;
+  int batched;
+  const char *  msg_body = privmsg_text (message, &sender, &batched);
+
+  if (!msg_body)
+    {
+      weechat_printf (NULL, _("%s%s: cannot parse the message [%s]"),
+		      weechat_prefix ("error"), PLUGIN_NAME, message);
+      return strdup (message);
+    }
+
+  size_t len = strlen (msg_body);
+  const struct detrans_lang *  lang;
+
+  DETRANS_PROBE2 (plugin__message__start, "weechat", len);
+
+  /* Batches come whole to detrans_batch_cb, once we know that they
+     do.  */
+  if ((batched && detrans_batches_seen)
+      || !wants_detrans (sender, msg_body, len, &lang))
+    {
+      DETRANS_PROBE2 (plugin__message__done, "weechat", len);
+      return strdup (message);
+    }
+
+  const char *  detransed_msg
+    = detrans_client (&detrans_client_conn, lang, msg_body, len,
+		      detrans_mode);
+  char *  new_msg;
+  int new_len = asprintf (&new_msg, _("%.*s%s"),
+			  (int) (msg_body - message), message,
+			  detransed_msg);
+
+  if (-1 == new_len)
+    {
+      weechat_printf (NULL, _("%s%s: asprintf failed"),
+		      weechat_prefix ("error"), PLUGIN_NAME);
+      DETRANS_PROBE2 (plugin__message__done, "weechat", len);
+      return strdup (message);
+    }
+
+  DETRANS_PROBE2 (plugin__message__done, "weechat",
+		  new_len - (msg_body - message));
+  return new_msg;
+}
+
 char *
 detrans_cb (const void *  pointer, void *  data, const char *  modifier,
 	    const char *  modifier_data, const char *  message)
@@ -58,46 +184,105 @@ detrans_cb (const void *  pointer, void *  data, const char *  modifier,
   if (!message)
     return NULL;
 
-  char *  sender = strchr (message, '!');
-  if (!sender)
-    {
-      weechat_printf (NULL, _("%s%s: cannot find '!' in the message [%s]"),
-		      weechat_prefix ("error"), PLUGIN_NAME, message);
-      return strdup (message);
-    }
+  return detrans_privmsg (message);
+}
 
-  sender += 1;
+/* A bouncer replaying the backlog sends it as an IRCv3 batch, which
+   weechat gives to the "irc_batch" modifier as one string of messages
+   separated by newlines.  All the messages to convert are given to
+   DETRANS_BATCH at once, instead of going through DETRANS_CB one by
+   one.  */
+char *
+detrans_batch_cb (const void *  pointer, void *  data, const char *  modifier,
+		  const char *  modifier_data, const char *  messages)
+{
+  (void) pointer;
+  (void) data;
+  (void) modifier;
+  (void) modifier_data;
+
+  if (!messages)
+    return NULL;
+
+  /* Messages of the batches that already went through DETRANS_CB are
+     not changed by a second conversion.  */
+  detrans_batches_seen = 1;
 
-  if (user_in_detrans_users (sender))
+  char *  lines = strdup (messages);
+  size_t count = 1, n = 0;
+
+  for (const char *  s = lines; *s; s++)
+    count += *s == '\n';
+
+  /* Lines of the batch, and the texts and the line numbers of the
+     messages to convert.  */
+  char **  line = malloc (count * sizeof (char *));
+  const char **  texts = malloc (count * sizeof (char *));
+  size_t *  lens = malloc (count * sizeof (size_t));
+  const struct detrans_lang **  langs = malloc (count * sizeof (*langs));
+  size_t *  which = malloc (count * sizeof (size_t));
+  char *  next = lines;
+
+  for (size_t i = 0; i < count; i++)
     {
-      char *  msg_body = strchr (message + 1, ':');
-      if (!msg_body)
+      const char *  sender;
+      int batched;
+
+      line[i] = next;
+      if ((next = strchr (line[i], '\n')) != NULL)
+	*next++ = '\0';
+
+      const char *  text = privmsg_text (line[i], &sender, &batched);
+      size_t len = text ? strlen (text) : 0;
+
+      if (text && wants_detrans (sender, text, len, &langs[n]))
 	{
-	  weechat_printf (NULL,
-			  _("%s%s: cannot find second ':' in the message [%s]"),
-			  weechat_prefix ("error"), PLUGIN_NAME, message);
-	  return strdup (message);
+	  texts[n] = text;
+	  lens[n] = len;
+	  which[n++] = i;
 	}
+    }
+
+  /* The service converts one message at a time anyway.  */
+  const char **  out = NULL;
 
-      msg_body += 1;
+  if (n && !detrans_client_conn.path)
+    {
+      detrans_init ();
+      out = detrans_batch (texts, lens, langs, n, &detrans_arena);
+    }
 
-      char *  detransed_msg = detrans (msg_body);
-      char *  new_msg;
+  char *  ret = NULL;
+  size_t size = 0, k = 0;
+  FILE *  f = open_memstream (&ret, &size);
 
-      if (-1 == asprintf (&new_msg, _("%.*s%s"), msg_body - message, message,
-		          detransed_msg))
+  for (size_t i = 0; f && i < count; i++)
+    {
+      if (i)
+	fputc ('\n', f);
+
+      if (k < n && which[k] == i)
 	{
-	  weechat_printf (NULL, _("%s%s: asprintf failed"),
-			  weechat_prefix ("error"), PLUGIN_NAME);
-	  return strdup (message);
+	  fwrite (line[i], 1, texts[k] - line[i], f);
+	  fputs (out ? out[k]
+		     : detrans_client (&detrans_client_conn, langs[k], texts[k],
+				       lens[k], detrans_mode), f);
+	  k++;
 	}
-
-      free (detransed_msg);
-      return new_msg;
+      else
+	fputs (line[i], f);
     }
 
-  return strdup (message);
+  if (f)
+    fclose (f);
 
+  free (which);
+  free (langs);
+  free (lens);
+  free (texts);
+  free (line);
+  free (lines);
+  return ret ? ret : strdup (messages);
 }
 
 void
@@ -107,24 +292,49 @@ free_detrans_users ()
     free (detrans_users[i]);
 
   free (detrans_users);
+  free (detrans_users_langs);
   detrans_users = NULL;
+  detrans_users_langs = NULL;
   detrans_users_len = 0;
 }
 
+/* Add the entry USER, "name" or "name:lang", to DETRANS_USERS.  */
+static void
+add_detrans_user (char *  user)
+{
+  char *  colon = strchr (user, ':');
+  const struct detrans_lang *  lang = NULL;
+
+  if (colon)
+    {
+      *colon = '\0';
+      if (!(lang = detrans_lang (colon + 1)))
+	weechat_printf (NULL, _("%s%s: no rules for language '%s' of %s, "
+				"known are %s"),
+			weechat_prefix ("error"), PLUGIN_NAME, colon + 1,
+			user, DETRANS_LANGUAGES);
+    }
+
+  detrans_users_langs[detrans_users_len] = lang;
+  detrans_users[detrans_users_len++] = user;
+}
+
 void
 load_detrans_users (const char *users)
 {
-  detrans_users_len = 1;
+  size_t count = 1;
+
   for (size_t i = 0; i < strlen (users); i++)
     if (users[i] == ',')
-      detrans_users_len++;
+      count++;
 
-  detrans_users = malloc (sizeof (char *) * detrans_users_len);
+  detrans_users = malloc (sizeof (char *) * count);
+  detrans_users_langs = malloc (sizeof (*detrans_users_langs) * count);
+  detrans_users_len = 0;
 
   const char *  end = users + strlen (users);
   const char *  start = users;
   const char *  comma;
-  size_t l = 0;
 
   while ((comma = strchr (start, ',')) != NULL)
     {
@@ -133,7 +343,7 @@ load_detrans_users (const char *users)
 
       t = strncpy (t, start, len);
       t[len] = '\0';
-      detrans_users[l++] = t;
+      add_detrans_user (t);
 
       start = comma + 1;
       while (start < end && (*start == ' ' || *start == '\t'))
@@ -141,8 +351,7 @@ load_detrans_users (const char *users)
     }
 
   if (start < end)
-    detrans_users[l] = strdup (start);
-
+    add_detrans_user (strdup (start));
 }
 
 
@@ -163,6 +372,171 @@ detrans_users_config_cb (const void *  pointer, void *  data,
   return WEECHAT_RC_OK;
 }
 
+int
+detrans_classify_config_cb (const void *  pointer, void *  data,
+                            const char *  option, const char *  value)
+{
+  (void) pointer;
+  (void) data;
+  (void) option;
+
+  detrans_classify = value == NULL || weechat_config_string_to_boolean (value);
+
+  return WEECHAT_RC_OK;
+}
+
+int
+detrans_mode_config_cb (const void *  pointer, void *  data,
+                        const char *  option, const char *  value)
+{
+  (void) pointer;
+  (void) data;
+  (void) option;
+
+  if (value != NULL && !strcmp (value, "lattice"))
+    detrans_mode = DETRANS_LATTICE;
+  else if (value != NULL && !strcmp (value, "fuzzy"))
+    detrans_mode = DETRANS_FUZZY;
+  else
+    detrans_mode = DETRANS_GREEDY;
+
+  /* For DETRANS_BATCH.  */
+  detrans_set_mode (detrans_mode);
+
+  return WEECHAT_RC_OK;
+}
+
+int
+detrans_service_config_cb (const void *  pointer, void *  data,
+                           const char *  option, const char *  value)
+{
+  (void) pointer;
+  (void) data;
+  (void) option;
+
+  detrans_client_set_path (&detrans_client_conn, value);
+
+  return WEECHAT_RC_OK;
+}
+
+/* Number of the results kept, and for how many seconds, from
+   plugins.var.detrans.cache_size and cache_ttl.  */
+static void
+detrans_cache_config (void)
+{
+  struct t_config_option *  size
+    = weechat_config_get ("plugins.var.detrans.cache_size");
+  struct t_config_option *  ttl
+    = weechat_config_get ("plugins.var.detrans.cache_ttl");
+  long size_value = size ? atol (weechat_config_string (size))
+                         : CLIENT_CACHE_SIZE;
+  long ttl_value = ttl ? atol (weechat_config_string (ttl))
+                       : CLIENT_CACHE_TTL;
+
+  detrans_client_set_cache (&detrans_client_conn,
+			    size_value > 0 ? size_value : 0,
+			    ttl_value > 0 ? ttl_value : 0);
+}
+
+int
+detrans_cache_config_cb (const void *  pointer, void *  data,
+                         const char *  option, const char *  value)
+{
+  (void) pointer;
+  (void) data;
+  (void) option;
+  (void) value;
+
+  detrans_cache_config ();
+
+  return WEECHAT_RC_OK;
+}
+
+char *
+detrans_stats_info_cb (const void *  pointer, void *  data,
+                       const char *  info_name, const char *  arguments)
+{
+  (void) pointer;
+  (void) data;
+  (void) info_name;
+  (void) arguments;
+
+  char *  stats = detrans_client_stats (&detrans_client_conn);
+  char *  cache = cache_stats_string (&detrans_client_conn.cache);
+  char *  ret;
+
+  if (!stats)
+    stats = detrans_stats_string ();
+
+  if (!stats || !cache
+      || -1 == asprintf (&ret, "%s\n%s", stats, cache))
+    ret = stats ? strdup (stats) : NULL;
+
+  free (stats);
+  free (cache);
+  return ret;
+}
+
+/* Counters are 64-bit, so they are passed as strings.  */
+static void
+infolist_add_counter (struct t_infolist_item *  item, const char *  name,
+                      uint64_t value)
+{
+  char buf[32];
+
+  snprintf (buf, sizeof (buf), "%llu", (unsigned long long) value);
+  weechat_infolist_new_var_string (item, name, buf);
+}
+
+struct t_infolist *
+detrans_stats_infolist_cb (const void *  pointer, void *  data,
+                           const char *  infolist_name, void *  obj_pointer,
+                           const char *  arguments)
+{
+  (void) pointer;
+  (void) data;
+  (void) infolist_name;
+  (void) obj_pointer;
+  (void) arguments;
+
+  struct detrans_stats s;
+  struct t_infolist *  infolist = weechat_infolist_new ();
+  struct t_infolist_item *  item;
+
+  if (!infolist)
+    return NULL;
+
+  if (!(item = weechat_infolist_new_item (infolist)))
+    {
+      weechat_infolist_free (infolist);
+      return NULL;
+    }
+
+  detrans_stats_get (&s);
+  infolist_add_counter (item, "messages", s.messages);
+  infolist_add_counter (item, "bytes_in", s.bytes_in);
+  infolist_add_counter (item, "bytes_out", s.bytes_out);
+  infolist_add_counter (item, "trie_probes", s.trie_probes);
+  infolist_add_counter (item, "cache_lookups",
+                        detrans_client_conn.cache.lookups);
+  infolist_add_counter (item, "cache_hits", detrans_client_conn.cache.hits);
+  infolist_add_counter (item, "cache_bytes",
+                        cache_bytes (&detrans_client_conn.cache));
+  infolist_add_counter (item, "word_hits", s.word_hits);
+  infolist_add_counter (item, "letter_hits", s.letter_hits);
+  infolist_add_counter (item, "fuzzy_hits", s.fuzzy_hits);
+
+  for (size_t i = 0; i < DETRANS_LATENCY_BUCKETS; i++)
+    {
+      char name[32];
+
+      snprintf (name, sizeof (name), "latency_%zu", i);
+      infolist_add_counter (item, name, s.latency[i]);
+    }
+
+  return infolist;
+}
+
 int
 weechat_plugin_init (struct t_weechat_plugin *  plugin, int argc, char *  argv[])
 {
@@ -171,7 +545,6 @@ weechat_plugin_init (struct t_weechat_plugin *  plugin, int argc, char *  argv[]
   (void) argv;
 
   weechat_plugin = plugin;
-  detrans_init ();
 
   weechat_printf (NULL, "Hello from %s plugin!",
 		  weechat_plugin_get_name (plugin));
@@ -179,6 +552,36 @@ weechat_plugin_init (struct t_weechat_plugin *  plugin, int argc, char *  argv[]
   weechat_hook_config ("plugins.var.detrans.users", &detrans_users_config_cb, 
                        &detrans_users_config_cb, NULL);
 
+  weechat_hook_config ("plugins.var.detrans.classify",
+                       &detrans_classify_config_cb, NULL, NULL);
+
+  struct t_config_option *  classify
+    = weechat_config_get ("plugins.var.detrans.classify");
+  if (classify != NULL)
+    detrans_classify = weechat_config_string_to_boolean
+                         (weechat_config_string (classify));
+
+  weechat_hook_config ("plugins.var.detrans.mode",
+                       &detrans_mode_config_cb, NULL, NULL);
+
+  struct t_config_option *  mode
+    = weechat_config_get ("plugins.var.detrans.mode");
+  if (mode != NULL)
+    detrans_mode_config_cb (NULL, NULL, NULL, weechat_config_string (mode));
+
+  weechat_hook_config ("plugins.var.detrans.service",
+                       &detrans_service_config_cb, NULL, NULL);
+
+  struct t_config_option *  service
+    = weechat_config_get ("plugins.var.detrans.service");
+  if (service != NULL)
+    detrans_client_set_path (&detrans_client_conn,
+                             weechat_config_string (service));
+
+  weechat_hook_config ("plugins.var.detrans.cache_*",
+                       &detrans_cache_config_cb, NULL, NULL);
+  detrans_cache_config ();
+
   struct t_config_option *  option = weechat_config_get ("plugins.var.detrans.users");
   const char *  detrans_users_opt = NULL;
 
@@ -200,7 +603,19 @@ weechat_plugin_init (struct t_weechat_plugin *  plugin, int argc, char *  argv[]
     weechat_printf (NULL, "%s: user (%zu) [%s]", PLUGIN_NAME, i,
 		    detrans_users[i]);
 
+  weechat_hook_info ("detrans_stats",
+                     N_("de-transliteration statistics"), NULL,
+                     &detrans_stats_info_cb, NULL, NULL);
+
+  weechat_hook_infolist ("detrans_stats",
+                         N_("de-transliteration statistics; latency_N is "
+                            "the number of messages that took from 2^N to "
+                            "2^(N+1) nanoseconds"),
+                         NULL, NULL, &detrans_stats_infolist_cb, NULL, NULL);
+
   detrans_hook = weechat_hook_modifier ("irc_in2_privmsg", &detrans_cb, &detrans_cb, NULL);
+  detrans_batch_hook = weechat_hook_modifier ("irc_batch", &detrans_batch_cb,
+                                              NULL, NULL);
 
   return WEECHAT_RC_OK;
 }
@@ -212,6 +627,8 @@ weechat_plugin_end (struct t_weechat_plugin *plugin)
   /* make C compiler happy */
   (void) plugin;
 
+  detrans_client_free (&detrans_client_conn);
+  detrans_arena_free (&detrans_arena);
   detrans_free ();
   if (detrans_hook)
     {
@@ -219,6 +636,12 @@ weechat_plugin_end (struct t_weechat_plugin *plugin)
       detrans_hook = NULL;
     }
 
+  if (detrans_batch_hook)
+    {
+      weechat_unhook (detrans_batch_hook);
+      detrans_batch_hook = NULL;
+    }
+
   free_detrans_users ();
 
   return WEECHAT_RC_OK;